@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <xc.h>
+#include <stdio.h>
+#include "battlog.h"
+#include "alert.h"
+#include "nvm.h"
+
+/*
+ * The alert log is a ring of ALERT_BLOCKS pages. When the last slot of
+ * a page is programmed, the next page is erased; so there is always a
+ * blank page, and at boot the next slot is the first blank one after
+ * a used one. A slot is used as soon as one of its words is programmed.
+ */
+static uint8_t alert_blk;	/* next slot */
+static uint8_t alert_slot;
+
+static uint8_t
+alert_used(uint8_t b, uint8_t s)
+{
+	const struct alert_entry *a = &alertlog[b].a_entry[s];
+
+	return (a->time != 0xffffffff || a->type != ALERT_T_FREE);
+}
+
+void
+alert_log_init(void)
+{
+	uint8_t b, s, n = 0;
+	uint8_t prev;
+
+	/* the used state of the slot before (0, 0) is the last one's */
+	prev = alert_used(ALERT_BLOCKS - 1, ALERT_ENTRIES - 1);
+	alert_blk = alert_slot = 0xff;
+	for (b = 0; b < ALERT_BLOCKS; b++) {
+		for (s = 0; s < ALERT_ENTRIES; s++) {
+			if (alert_used(b, s)) {
+				n++;
+				prev = 1;
+				continue;
+			}
+			if (prev && alert_blk == 0xff) {
+				alert_blk = b;
+				alert_slot = s;
+			}
+			prev = 0;
+		}
+	}
+	if (alert_blk == 0xff) {
+		/* blank, or no blank slot left: start over at 0 */
+		alert_blk = alert_slot = 0;
+		if (n != 0) {
+			alert_page_erase(&alertlog[0]);
+			n -= ALERT_ENTRIES;
+		}
+	}
+	printf("alert log: %d entries, next %d/%d\n",
+	    n, alert_blk, alert_slot);
+}
+
+void
+alert_log_add(const struct alert_entry *e)
+{
+	alert_write(&alertlog[alert_blk].a_entry[alert_slot], e);
+	if (++alert_slot == ALERT_ENTRIES) {
+		alert_slot = 0;
+		alert_blk = (alert_blk + 1) % ALERT_BLOCKS;
+		alert_page_erase(&alertlog[alert_blk]);
+	}
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * PAC195x alerts: each over-current, under-current or under-voltage
+ * episode of a channel is recorded in a small ring of flash pages,
+ * apart from the journal, with its peak values. They are kept there
+ * across log resets.
+ */
+
+struct alert_entry {
+	uint32_t time;		/* start, UTC (s) or since boot, see type */
+	uint8_t type;
+#define ALERT_T_OC	0x01	/* charge current above the limit */
+#define ALERT_T_UC	0x02	/* discharge current above the limit */
+#define ALERT_T_UV	0x04	/* voltage below the limit */
+#define ALERT_T_NOTIME	0x80	/* time is seconds since boot */
+#define ALERT_T_FREE	0xff	/* blank slot */
+	uint8_t instance;
+	int16_t i_peak;		/* 0.01A, the largest in absolute value */
+	int16_t v_min;		/* 0.01V */
+	uint16_t duration;	/* 0.1s */
+} __packed;
+
+#define ALERT_ENTRIES	21	/* per page */
+struct alert_block {
+	struct alert_entry a_entry[ALERT_ENTRIES];
+	uint8_t a_pad[256 - ALERT_ENTRIES * sizeof(struct alert_entry)];
+} __packed;
+
+#define ALERT_BLOCKS	4
+
+/* below the journal, in the reserved program flash */
+extern const struct alert_block alertlog[ALERT_BLOCKS] __at(0x17c00);
+
+void alert_log_init(void);
+void alert_log_add(const struct alert_entry *);
+
+/* NMEA2000 alert, not in pic18_n2k's nmea2000_pgn.h */
+#ifndef NMEA2000_ALERT
+#define NMEA2000_ALERT		126983UL
+struct nmea2000_alert_data {
+	uint8_t type;		/* alert type | category << 4 */
+#define ALERT_TYPE_ALARM	2
+#define ALERT_TYPE_WARNING	5
+#define ALERT_CAT_TECHNICAL	1
+	uint8_t system;
+	uint8_t subsystem;
+	uint16_t id;
+	uint8_t src_name[8];	/* ISO NAME of the data source */
+	uint8_t src_instance;
+	uint8_t src_index;
+	uint8_t occurrence;
+	uint8_t flags;		/* silence/ack/escalation status and support */
+	uint8_t ack_name[8];
+	uint8_t condition;	/* trigger condition | threshold status << 4 */
+#define ALERT_TRIGGER_AUTO	1
+#define ALERT_THRESH_NORMAL	0
+#define ALERT_THRESH_EXCEEDED	1
+#define ALERT_THRESH_LOW	3
+	uint8_t priority;
+	uint8_t state;
+#define ALERT_STATE_NORMAL	1
+#define ALERT_STATE_ACTIVE	2
+} __packed;
+#endif
@@ -0,0 +1,567 @@
+/*
+ * Copyright (c) 2022 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * journal data structure (record every 10mn)
+ * For current, in mA: 18 bits, including sign
+ * voltage, max 20.47V needs 11 bits
+ * temperature -40C to 60C: 8 bits (K - 233)
+ * valid: 1bit
+ * instance: 2 bits, in the bank of 4 instances of the unit (LR_M_BANK)
+ =>  total 40 bits, or 5 bytes
+ 51 entries per block of 256 bytes: 1 bytes free (for block flags)
+ In 32k flash, 128 blocks -> 6528 entries, or 272 hours (11 days)
+   with 4 channels active
+ With the delta format below, an entry is 2.7 bytes on average:
+   about twice as many entries in the same flash.
+ * Also used by host tools (bmemu), hence the explicit packing
+ * (a no-op on the pic18).
+ */
+
+#ifdef __XC8
+#define BATTLOG_PACKED
+#else
+#define BATTLOG_PACKED __attribute__((__packed__))
+#endif
+
+union log_entry {
+	uint8_t data[5];
+	struct BATTLOG_PACKED {
+		uint8_t temp;
+		uint8_t u_low; /* low bits of voltage */
+		uint16_t i_low; /* low bits current */
+		uint8_t u_high : 3; /* high bits of voltage */
+		uint8_t nvalid : 1; /* 0 = entry valid */
+		uint8_t i_high: 2; /* high bits of current */
+		uint8_t instance: 2; /* batt instance */
+	} s;
+};
+
+#define LOG_ENTRIES 51
+#define LOG_DATA (LOG_ENTRIES * sizeof(union log_entry))
+
+struct log_block {
+	union {
+		union log_entry u_entry[LOG_ENTRIES];
+		uint8_t u_data[LOG_DATA];
+	} b_u;
+#define b_entry b_u.u_entry
+#define b_data b_u.u_data
+#define b_fmt b_u.u_data[LOG_DATA - 1]
+	uint8_t b_flags;
+#define B_FILL_STAT 0x03
+#define B_FILL_FREE 0x03
+#define B_FILL_PART 0x01
+#define B_FILL_FULL 0x00
+#define B_FILL_GEN  0xfc
+#define B_GEN_INC   0x04
+};
+
+/*
+ * b_fmt is B_FMT_DELTA if b_data holds delta records (below), in the
+ * first LOG_RDATA bytes. In the old format b_fmt is the last byte of
+ * the last entry: 0xff if it's free, with nvalid clear otherwise; it
+ * can't be B_FMT_DELTA.
+ */
+#define B_FMT_DELTA 0xf8
+#define LOG_RDATA (LOG_DATA - 1)
+#define LOG_IS_DELTA(b) ((b)->b_fmt == B_FMT_DELTA)
+
+/*
+ * Delta format: b_data is a sequence of variable-length records, up to
+ * the first byte with bit 7 set (0xff: erased flash). A record starts
+ * with a header byte:
+ * bit 7: 0 (valid)
+ * bits 6-5: battery instance
+ * bits 4-3: record type
+ * bits 2-0: a small delta (-4 to 3), depending on type
+ * LR_BASE:  followed by a log_entry with absolute values; the base for
+ *           the next records of this instance. The first record of an
+ *           instance in a block is always a LR_BASE.
+ * LR_SHORT: bits 2-0 are the voltage delta, followed by the current delta
+ * LR_DELTA: bits 2-0 are the temperature delta, followed by the current
+ *           and voltage deltas
+ * LR_MARK:  bits 2-0 give the kind of mark:
+ *   LR_M_BOOT: boot marker, no payload (a zero log_entry in the old format)
+ *   LR_M_ENV:  envelope of the entry just before, for the same instance:
+ *           followed by (max current - average), (average - min current)
+ *           in 0.01A, and (average - min voltage) in 0.01V, as unsigned
+ *           varints. Only written when the values moved significantly
+ *           during the interval; otherwise min and max are the average.
+ *   LR_M_TIME: followed by a UTC time (seconds since 1970) and the log
+ *           interval (seconds), 4 and 2 bytes little-endian. The first
+ *           group of entries (one per instance) after it was logged at
+ *           this time, the next ones each interval after. Written at the
+ *           start of each block, and when the time or interval changes,
+ *           if the time is known (from NMEA2000).
+ *   LR_M_BANK: followed by one byte, the battery instance of the records
+ *           with instance 0 after it; the others follow. Written at the
+ *           start of each block and at boot, if not 0: the logs of a
+ *           unit with the default instances (0 to 3) don't have it.
+ * Deltas are from the previous record of this instance, zigzag-encoded
+ * as varints (7 bits per byte, bit 7 set if more bytes follow).
+ * A record is 2 or 3 bytes most of the time, instead of 5.
+ */
+#define LR_NVALID	0x80
+#define LR_INST_SHIFT	5
+#define LR_TYPE		0x18
+#define LR_BASE		0x00
+#define LR_SHORT	0x08
+#define LR_DELTA	0x10
+#define LR_MARK		0x18
+#define LR_SMALL	0x07
+#define LR_M_BOOT	0x00
+#define LR_M_ENV	0x01
+#define LR_M_TIME	0x02
+#define LR_M_BANK	0x03
+#define LR_MAXLEN	(1 + sizeof(union log_entry)) /* longest entry record */
+#define LR_ENVLEN	(1 + 3 * 3) /* longest envelope record */
+#define LR_TIMELEN	(1 + 4 + 2)
+#define LR_BANKLEN	(1 + 1)
+
+/* last values of an instance, for delta encoding/decoding */
+struct log_last {
+	int32_t i;
+	uint16_t u;
+	uint8_t t;
+	uint8_t valid;
+};
+
+/* min/max values of an instance during a log interval */
+struct log_env {
+	int32_t i_min; /* mA */
+	int32_t i_max; /* mA */
+	uint16_t u_min; /* 0.01V */
+	uint8_t instance;
+};
+
+/* time of the next group of entries */
+struct log_time {
+	uint32_t time; /* UTC, s since 1970 */
+	uint16_t interval; /* s */
+};
+
+/* decoded LR_MARK records other than LR_M_BOOT */
+struct log_aux {
+	uint8_t type; /* LR_M_ENV, LR_M_TIME or LR_M_BANK */
+	struct log_env env;
+	struct log_time time;
+	uint8_t bank;
+};
+
+/*
+ * PRIVATE_LOG commands added to the ones of nmea2000_pgn.h.
+ * PRIVATE_LOG_INTERVAL: set the log interval (in seconds; 0 to just
+ * query it), answered with a PRIVATE_LOG_INTERVAL_REPLY. The reply also
+ * has the battery instance of channel 0 of the burst replies; older
+ * firmwares don't send it, their channel 0 is instance 0.
+ * PRIVATE_LOG_BURST: get the last 1s samples, kept in RAM only. The
+ * replies are sent oldest first; the last one has BURST_LAST set.
+ * PRIVATE_LOG_SCHED: get the firmware tasks, with their longest run
+ * time since boot, answered with a PRIVATE_LOG_SCHED_REPLY.
+ */
+#define PRIVATE_LOG_INTERVAL	3
+#define PRIVATE_LOG_BURST	4
+#define PRIVATE_LOG_SCHED	5
+#define PRIVATE_LOG_INTERVAL_REPLY 12
+#define PRIVATE_LOG_BURST_REPLY	13
+#define PRIVATE_LOG_SCHED_REPLY	14
+
+struct private_log_interval {
+	uint8_t cmd;
+	uint8_t sid;
+	uint16_t interval;
+	uint8_t inst_base; /* in replies only: instance of channel 0 */
+} BATTLOG_PACKED;
+
+struct burst_sample {
+	int16_t current; /* 0.01A */
+	int16_t voltage; /* 0.01V */
+} BATTLOG_PACKED;
+
+struct private_log_burst_reply {
+	uint8_t cmd;
+	uint8_t sid;
+	uint16_t seq; /* of the first sample; +1 each second */
+	uint8_t chans; /* channels in each sample, bit 0: channel 0 */
+#define BURST_CHANS	0x0f
+#define BURST_LAST	0x80
+	struct burst_sample data[]; /* for each second, each instance */
+} BATTLOG_PACKED;
+
+struct sched_stat {
+	uint8_t period; /* in ticks */
+	uint8_t phase;
+#define SCHED_T_PAC	0x80 /* runs once the PAC reads are complete */
+	uint16_t wcet; /* us */
+} BATTLOG_PACKED;
+
+struct private_log_sched_reply {
+	uint8_t cmd;
+	uint8_t sid;
+	uint8_t ticks; /* per second */
+	struct sched_stat task[]; /* in the order they run */
+} BATTLOG_PACKED;
+
+#define LOG_BLOCKS ((uint8_t)128)
+#define LOG_BLOCKS_MASK (LOG_BLOCKS - 1)
+
+/*
+ * index of a page in PRIVATE_LOG requests and replies: the generation
+ * in the high byte, the page in the low one. LOG_IDX_DELTA is set in
+ * the replies for a page with delta records.
+ */
+#define LOG_IDX_DELTA	0x0080
+
+static inline void
+utolog(uint16_t u, union log_entry *e)
+{
+	e->s.u_low = u & 0xff;
+	e->s.u_high = (u >> 8) & 0x7;
+}
+
+static inline uint16_t
+logtou(union log_entry *e)
+{
+	uint16_t u;
+
+	u = e->s.u_low;
+	u |= (uint16_t)(e->s.u_high & 0x7) << 8;
+	return u;
+}
+
+static inline void
+itolog(int64_t i, union log_entry *e)
+{
+	e->s.i_low = i & 0xffff;
+	e->s.i_high = (i >> 16) & 0x3;
+}
+
+static inline int32_t
+logtoi(union log_entry *e)
+{
+	int32_t i;
+	i = e->s.i_low;
+	i |= (uint32_t)(e->s.i_high & 0x3) << 16;
+	if (e->s.i_high & 0x2) {
+		i |= 0xfffe0000;
+	}
+	return i;
+}
+
+static inline uint8_t
+log_uvarint(uint32_t z, uint8_t *p)
+{
+	uint8_t n = 0;
+
+	while (z >= 0x80) {
+		p[n++] = (z & 0x7f) | 0x80;
+		z >>= 7;
+	}
+	p[n++] = z;
+	return n;
+}
+
+static inline uint8_t
+log_varint(int32_t d, uint8_t *p)
+{
+	/* zigzag: small negative values get small codes too */
+	if (d < 0)
+		return log_uvarint(~((uint32_t)d << 1), p);
+	return log_uvarint((uint32_t)d << 1, p);
+}
+
+/* returns the number of bytes used, 0 if truncated or too long */
+static inline uint8_t
+log_unuvarint(const uint8_t *p, uint8_t room, uint32_t *z)
+{
+	uint8_t n;
+
+	*z = 0;
+	for (n = 0; n < room && n < 3; n++) {
+		*z |= (uint32_t)(p[n] & 0x7f) << (7 * n);
+		if ((p[n] & 0x80) == 0)
+			return n + 1;
+	}
+	return 0;
+}
+
+static inline uint8_t
+log_unvarint(const uint8_t *p, uint8_t room, int32_t *d)
+{
+	uint32_t z;
+	uint8_t n;
+
+	if ((n = log_unuvarint(p, room, &z)) == 0)
+		return 0;
+	if (z & 1)
+		*d = ~(z >> 1);
+	else
+		*d = z >> 1;
+	return n;
+}
+
+static inline int8_t
+log_small(uint8_t h)
+{
+	/* sign-extend the 3-bits delta */
+	if (h & 0x4)
+		return (int8_t)(h | ~LR_SMALL);
+	return h & LR_SMALL;
+}
+
+/* length of the record at p, 0 at the end of the records */
+static inline uint8_t
+log_rec_len(const uint8_t *p, uint8_t room)
+{
+	uint8_t n, r, k;
+	int32_t d;
+	uint32_t z;
+
+	if (room == 0 || (p[0] & LR_NVALID))
+		return 0;
+	switch (p[0] & LR_TYPE) {
+	case LR_MARK:
+		if ((p[0] & LR_SMALL) == LR_M_TIME)
+			return (room < LR_TIMELEN) ? 0 : LR_TIMELEN;
+		if ((p[0] & LR_SMALL) == LR_M_BANK)
+			return (room < LR_BANKLEN) ? 0 : LR_BANKLEN;
+		if ((p[0] & LR_SMALL) != LR_M_ENV)
+			return 1;
+		/* 3 unsigned varints */
+		for (n = 1, k = 0; k < 3; k++) {
+			if ((r = log_unuvarint(&p[n], room - n, &z)) == 0)
+				return 0;
+			n += r;
+		}
+		return n;
+	case LR_BASE:
+		return (room < LR_MAXLEN) ? 0 : LR_MAXLEN;
+	}
+	n = 1;
+	if ((r = log_unvarint(&p[n], room - n, &d)) == 0)
+		return 0;
+	n += r;
+	if ((p[0] & LR_TYPE) == LR_DELTA) {
+		if ((r = log_unvarint(&p[n], room - n, &d)) == 0)
+			return 0;
+		n += r;
+	}
+	return n;
+}
+
+/*
+ * encode entry e (a boot marker if NULL) to p, at most LR_MAXLEN bytes.
+ * Returns the record length.
+ */
+static inline uint8_t
+log_rec_encode(struct log_last *last, const union log_entry *e, uint8_t *p)
+{
+	struct log_last *l;
+	uint8_t inst, n;
+	int32_t di;
+	int16_t du, dt;
+
+	if (e == NULL) {
+		p[0] = LR_MARK | LR_M_BOOT;
+		return 1;
+	}
+	inst = e->s.instance;
+	l = &last[inst];
+	di = logtoi((union log_entry *)e) - l->i;
+	du = (int16_t)logtou((union log_entry *)e) - (int16_t)l->u;
+	dt = (int16_t)e->s.temp - (int16_t)l->t;
+	if (!l->valid || dt < -4 || dt > 3) {
+		p[0] = LR_BASE | (inst << LR_INST_SHIFT);
+		for (n = 0; n < sizeof(union log_entry); n++)
+			p[n + 1] = e->data[n];
+		n++;
+		l->valid = 1;
+	} else if (dt == 0 && du >= -4 && du <= 3) {
+		p[0] = LR_SHORT | (inst << LR_INST_SHIFT) | (du & LR_SMALL);
+		n = 1 + log_varint(di, &p[1]);
+	} else {
+		p[0] = LR_DELTA | (inst << LR_INST_SHIFT) | (dt & LR_SMALL);
+		n = 1 + log_varint(di, &p[1]);
+		n += log_varint(du, &p[n]);
+	}
+	l->i += di;
+	l->u += du;
+	l->t += dt;
+	return n;
+}
+
+/*
+ * encode envelope env to p, at most LR_ENVLEN bytes; it has to follow
+ * the entry of the same instance. Returns the record length.
+ */
+static inline uint8_t
+log_env_encode(const struct log_last *last, const struct log_env *env,
+    uint8_t *p)
+{
+	const struct log_last *l = &last[env->instance];
+	int32_t d;
+	uint8_t n;
+
+	p[0] = LR_MARK | (env->instance << LR_INST_SHIFT) | LR_M_ENV;
+	/* in 0.01A, rounded; never below/above the average */
+	d = env->i_max - l->i;
+	n = 1 + log_uvarint(d > 0 ? (d + 5) / 10 : 0, &p[1]);
+	d = l->i - env->i_min;
+	n += log_uvarint(d > 0 ? (d + 5) / 10 : 0, &p[n]);
+	d = (int32_t)l->u - (int32_t)env->u_min;
+	n += log_uvarint(d > 0 ? d : 0, &p[n]);
+	return n;
+}
+
+/* encode time record tm to p, LR_TIMELEN bytes */
+static inline uint8_t
+log_time_encode(const struct log_time *tm, uint8_t *p)
+{
+	p[0] = LR_MARK | LR_M_TIME;
+	p[1] = tm->time & 0xff;
+	p[2] = (tm->time >> 8) & 0xff;
+	p[3] = (tm->time >> 16) & 0xff;
+	p[4] = (tm->time >> 24) & 0xff;
+	p[5] = tm->interval & 0xff;
+	p[6] = tm->interval >> 8;
+	return LR_TIMELEN;
+}
+
+/* encode bank record to p, LR_BANKLEN bytes */
+static inline uint8_t
+log_bank_encode(uint8_t bank, uint8_t *p)
+{
+	p[0] = LR_MARK | LR_M_BANK;
+	p[1] = bank;
+	return LR_BANKLEN;
+}
+
+/*
+ * decode the record at p to e. For an envelope, time or bank record, e is
+ * marked not valid (with the instance set) and the record goes to aux,
+ * if not NULL. Returns the record length, or 0 at the end of the
+ * records or if the record is invalid.
+ */
+static inline uint8_t
+log_rec_decode(struct log_last *last, const uint8_t *p, uint8_t room,
+    union log_entry *e, struct log_aux *aux)
+{
+	struct log_last *l;
+	uint8_t h, n, r, k;
+	int32_t di, du;
+	uint32_t z[3];
+
+	if (room == 0 || (p[0] & LR_NVALID))
+		return 0;
+	h = p[0];
+	l = &last[(h >> LR_INST_SHIFT) & 0x3];
+	switch (h & LR_TYPE) {
+	case LR_MARK:
+		for (n = 0; n < sizeof(union log_entry); n++)
+			e->data[n] = 0;
+		if ((h & LR_SMALL) == LR_M_TIME) {
+			if (room < LR_TIMELEN)
+				return 0;
+			e->s.nvalid = 1;
+			if (aux != NULL) {
+				aux->type = LR_M_TIME;
+				aux->time.time = p[1] |
+				    ((uint32_t)p[2] << 8) |
+				    ((uint32_t)p[3] << 16) |
+				    ((uint32_t)p[4] << 24);
+				aux->time.interval = p[5] |
+				    ((uint16_t)p[6] << 8);
+			}
+			return LR_TIMELEN;
+		}
+		if ((h & LR_SMALL) == LR_M_BANK) {
+			if (room < LR_BANKLEN)
+				return 0;
+			e->s.nvalid = 1;
+			if (aux != NULL) {
+				aux->type = LR_M_BANK;
+				aux->bank = p[1];
+			}
+			return LR_BANKLEN;
+		}
+		if ((h & LR_SMALL) != LR_M_ENV)
+			return 1;
+		if (!l->valid)
+			return 0;
+		n = 1;
+		for (k = 0; k < 3; k++) {
+			if ((r = log_unuvarint(&p[n], room - n, &z[k])) == 0)
+				return 0;
+			n += r;
+		}
+		e->s.instance = (h >> LR_INST_SHIFT) & 0x3;
+		e->s.nvalid = 1;
+		if (aux != NULL) {
+			aux->type = LR_M_ENV;
+			aux->env.instance = e->s.instance;
+			aux->env.i_max = l->i + (int32_t)z[0] * 10;
+			aux->env.i_min = l->i - (int32_t)z[1] * 10;
+			aux->env.u_min = l->u - (uint16_t)z[2];
+		}
+		return n;
+	case LR_BASE:
+		if (room < LR_MAXLEN)
+			return 0;
+		for (n = 0; n < sizeof(union log_entry); n++)
+			e->data[n] = p[n + 1];
+		l->i = logtoi(e);
+		l->u = logtou(e);
+		l->t = e->s.temp;
+		l->valid = 1;
+		break;
+	default:
+		if (!l->valid)
+			return 0;
+		n = 1;
+		if ((r = log_unvarint(&p[n], room - n, &di)) == 0)
+			return 0;
+		n += r;
+		if ((h & LR_TYPE) == LR_DELTA) {
+			if ((r = log_unvarint(&p[n], room - n, &du)) == 0)
+				return 0;
+			n += r;
+			l->t += log_small(h);
+		} else {
+			du = log_small(h);
+		}
+		l->i += di;
+		l->u += du;
+		itolog(l->i, e);
+		utolog(l->u, e);
+		e->s.temp = l->t;
+		break;
+	}
+	e->s.instance = (h >> LR_INST_SHIFT) & 0x3;
+	e->s.nvalid = 0;
+	return (h & LR_TYPE) == LR_BASE ? LR_MAXLEN : n;
+}
@@ -0,0 +1,658 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * host build: mock NMEA2000 stack, at the message level. The address
+ * claim always succeeds; frames sent by the firmware are counted.
+ * A peer on the bus syncs the log periodically, the way wxbm does:
+ * it gets again the last page it got (which may have been partial)
+ * and asks for the next pages until the firmware answers with an error.
+ * The peer decodes the entries as wxbm does. It can also set the log
+ * interval, and get the 1s samples once.
+ * A GPS on the bus sends the system time every second, from can_time_at.
+ */
+
+#include <xc.h>
+#include <string.h>
+#include <nmea2000.h>
+#include <nmea2000_pgn.h>
+#include "battlog.h"
+#include "alert.h"
+#include "sim.h"
+
+#define PEER_ADDR	0x20
+#define MIRROR_ADDR	0x21	/* a second requester, syncing along */
+#define GPS_ADDR	0x30
+#define SIM_EPOCH_DAYS	20454	/* 2026-01-01, the simulation starts at 0:00 */
+#define RXQ_SIZE	16
+#define CAN_FRAME_US	540	/* 8 bytes frame at 250kbit/s */
+
+union nmea2000_id rid;
+uint8_t rdata[NMEA2000_DATA_LENGTH];
+uint8_t nmea2000_addr;
+uint8_t nmea2000_status;
+
+int can_sync_interval = 3600;
+int can_log_interval;
+uint64_t can_burst_at;
+int64_t can_time_at;
+uint64_t can_reset_at;
+int can_mirror;
+
+static struct rx_frame {
+	union nmea2000_id id;
+	uint8_t data[NMEA2000_DATA_LENGTH];
+	uint64_t t;	/* when it was received */
+} rxq[RXQ_SIZE];
+static int rxq_prod, rxq_cons;
+
+static u_long tx_frames, tx_msgs, tx_fail, rx_frames;
+static uint64_t rx_lat_sum, rx_lat_max; /* us, until nmea2000_receive() */
+
+/* peer state */
+static int peer_syncing;
+static int peer_have_page;
+static uint16_t peer_idx;	/* last page we got */
+static uint8_t peer_sid, peer_fastid;
+static u_long peer_syncs, peer_pages, peer_entries, peer_bytes, peer_errs;
+static u_long peer_envs, peer_timed, peer_resets;
+/* last DC status of each instance, as a display would show it */
+static struct nmea2000_dc_status_data dc_last[4];
+static u_long dc_msgs;
+static u_long alert_msgs[2];	/* active, back to normal */
+static uint8_t sched_reply[NMEA2000_DATA_FASTLENGTH];	/* last one */
+static int sched_reply_len;
+/* device time of the entries; saved at the start of a page */
+static struct peer_time {
+	int valid;
+	uint32_t time;
+	uint16_t interval;
+	uint8_t seen;	/* instances already in this group */
+} peer_time, peer_time_page;
+static uint16_t peer_time_idx;	/* page of peer_time_page */
+static struct log_last peer_last[4];	/* delta decoding state */
+static int peer_off;			/* next offset in the page */
+static int peer_interval_set;
+static uint16_t peer_burst_seq;		/* next sample expected */
+static u_long peer_burst_samples, peer_burst_pkts;
+static uint64_t peer_sync_start, peer_sync_max;
+
+/* the second requester: plain page sync, with its own decode state */
+static struct mirror {
+	int syncing;
+	uint64_t sync_start;
+	int have_page;
+	uint16_t idx;
+	uint8_t sid, fastid;
+	struct log_last last[4];
+	int off;
+	u_long syncs, pages, entries, bytes, errs, timeouts;
+} mirror;
+
+void
+nmea2000_init(void)
+{
+	nmea2000_addr = NMEA2000_USER_ADDRESS;
+	nmea2000_status = NMEA2000_S_CLAIMING;
+	rxq_prod = rxq_cons = 0;
+}
+
+void
+nmea2000_poll(uint8_t ticks)
+{
+	/* nobody else claims our address */
+	nmea2000_status = NMEA2000_S_OK;
+}
+
+int
+can_rx_pending(void)
+{
+	return rxq_prod != rxq_cons;
+}
+
+void
+nmea2000_receive(void)
+{
+	uint64_t lat;
+
+	if (can_rx_pending()) {
+		rid = rxq[rxq_cons].id;
+		memcpy(rdata, rxq[rxq_cons].data, sizeof(rdata));
+		lat = sim_us - rxq[rxq_cons].t;
+		rx_lat_sum += lat;
+		if (lat > rx_lat_max)
+			rx_lat_max = lat;
+		rxq_cons = (rxq_cons + 1) % RXQ_SIZE;
+		rx_frames++;
+		user_receive();
+	}
+	C1INTLbits.RXIF = can_rx_pending();
+}
+
+/* PGN 126992 from GPS_ADDR, the current simulated time */
+static void
+gps_time(void)
+{
+	struct rx_frame *f = &rxq[rxq_prod];
+	static uint8_t sid;
+	uint32_t tod = (sim_us / 1000000) % 86400 * 10000;
+	uint16_t date = SIM_EPOCH_DAYS + sim_us / 86400000000ULL;
+
+	if ((rxq_prod + 1) % RXQ_SIZE == rxq_cons) {
+		fprintf(stderr, "can: rx queue full\n");
+		return;
+	}
+	PGN2ID(126992UL, f->id);
+	f->id.saddr = GPS_ADDR;
+	f->id.priority = 3;
+	f->data[0] = sid++;
+	f->data[1] = 0xf0; /* GPS */
+	f->data[2] = date & 0xff;
+	f->data[3] = date >> 8;
+	f->data[4] = tod & 0xff;
+	f->data[5] = (tod >> 8) & 0xff;
+	f->data[6] = (tod >> 16) & 0xff;
+	f->data[7] = tod >> 24;
+	f->t = sim_us;
+	rxq_prod = (rxq_prod + 1) % RXQ_SIZE;
+}
+
+static void
+log_request(uint8_t saddr, uint8_t *fastid, uint8_t sid, uint8_t cmd,
+    uint16_t idx)
+{
+	struct rx_frame *f = &rxq[rxq_prod];
+
+	if ((rxq_prod + 1) % RXQ_SIZE == rxq_cons) {
+		fprintf(stderr, "can: rx queue full\n");
+		return;
+	}
+	f->id.id = 0;
+	f->id.saddr = saddr;
+	f->id.daddr = nmea2000_addr;
+	f->id.iso_pg = (PRIVATE_LOG >> 8) & 0xff;
+	f->id.priority = NMEA2000_PRIORITY_REQUEST;
+	*fastid = (*fastid + 1) & 0x7;
+	f->data[0] = *fastid << 5;
+	f->data[1] = sizeof(struct private_log_request);
+	f->data[2] = cmd;
+	f->data[3] = sid;
+	f->data[4] = idx & 0xff;
+	f->data[5] = idx >> 8;
+	f->data[6] = f->data[7] = 0xff;
+	f->t = sim_us;
+	rxq_prod = (rxq_prod + 1) % RXQ_SIZE;
+}
+
+static void
+peer_request(uint8_t cmd, uint16_t idx)
+{
+	log_request(PEER_ADDR, &peer_fastid, peer_sid, cmd, idx);
+}
+
+static void
+mirror_request(uint8_t cmd, uint16_t idx)
+{
+	log_request(MIRROR_ADDR, &mirror.fastid, mirror.sid, cmd, idx);
+}
+
+/* erase the log, and sync it again from the start */
+static void
+peer_reset(void)
+{
+	struct rx_frame *f = &rxq[rxq_prod];
+
+	if ((rxq_prod + 1) % RXQ_SIZE == rxq_cons) {
+		fprintf(stderr, "can: rx queue full\n");
+		return;
+	}
+	f->id.id = 0;
+	f->id.saddr = PEER_ADDR;
+	f->id.daddr = nmea2000_addr;
+	f->id.iso_pg = (PRIVATE_LOG >> 8) & 0xff;
+	f->id.priority = NMEA2000_PRIORITY_REQUEST;
+	peer_fastid = (peer_fastid + 1) & 0x7;
+	SIDINC(peer_sid);
+	f->data[0] = peer_fastid << 5;
+	f->data[1] = sizeof(struct private_log_reset);
+	f->data[2] = PRIVATE_LOG_RESET;
+	f->data[3] = peer_sid;
+	f->data[4] = PRIVATE_LOG_RESET_MAGIC & 0xff;
+	f->data[5] = PRIVATE_LOG_RESET_MAGIC >> 8;
+	f->data[6] = f->data[7] = 0xff;
+	f->t = sim_us;
+	rxq_prod = (rxq_prod + 1) % RXQ_SIZE;
+	peer_have_page = 0;
+	peer_time.valid = 0;
+	peer_resets++;
+}
+
+void
+can_peer_tick(void)
+{
+	if (can_time_at >= 0 && sim_us >= can_time_at)
+		gps_time();
+	if (nmea2000_status != NMEA2000_S_OK)
+		return;
+	/* a log reset cancels the transfer without a reply */
+	if (mirror.syncing && sim_us - mirror.sync_start > 10000000) {
+		mirror.syncing = 0;
+		mirror.have_page = 0;
+		mirror.timeouts++;
+	}
+	/* in the same second as the peer: both transfers interleave */
+	if (can_mirror && !mirror.syncing &&
+	    (sim_us / 1000000) % can_mirror == 0) {
+		mirror.syncing = 1;
+		mirror.sync_start = sim_us;
+		SIDINC(mirror.sid);
+		if (mirror.have_page)
+			mirror_request(PRIVATE_LOG_REQUEST, mirror.idx);
+		else
+			mirror_request(PRIVATE_LOG_REQUEST_FIRST, 0);
+	}
+	if (peer_syncing)
+		return;
+	if (can_reset_at != 0 && sim_us >= can_reset_at) {
+		can_reset_at = 0;
+		peer_reset();
+		return;
+	}
+	if ((sim_us / 1000000) % 86400 == 45000) {
+		/* the task run times, once a day */
+		SIDINC(peer_sid);
+		peer_request(PRIVATE_LOG_SCHED, 0);
+		return;
+	}
+	if (can_log_interval != 0 && !peer_interval_set) {
+		peer_interval_set = 1;
+		SIDINC(peer_sid);
+		peer_request(PRIVATE_LOG_INTERVAL, can_log_interval);
+		return;
+	}
+	if (can_burst_at != 0 && sim_us >= can_burst_at) {
+		can_burst_at = 0;
+		SIDINC(peer_sid);
+		peer_burst_pkts = 0;
+		peer_request(PRIVATE_LOG_BURST, 0);
+		return;
+	}
+	if (can_sync_interval == 0)
+		return;
+	if ((sim_us / 1000000) % can_sync_interval != 0)
+		return;
+	peer_syncing = 1;
+	peer_sync_start = sim_us;
+	SIDINC(peer_sid);
+	if (peer_have_page)
+		peer_request(PRIVATE_LOG_REQUEST, peer_idx);
+	else
+		peer_request(PRIVATE_LOG_REQUEST_FIRST, 0);
+}
+
+static void
+peer_sync_done(void)
+{
+	uint64_t t = sim_us - peer_sync_start;
+
+	peer_syncing = 0;
+	peer_syncs++;
+	if (t > peer_sync_max)
+		peer_sync_max = t;
+}
+
+static void
+peer_entry(uint16_t idx, union log_entry *e)
+{
+	uint8_t bit = 1 << e->s.instance;
+
+	peer_entries++;
+	if (e->s.temp == 0 && logtoi(e) == 0 && logtou(e) == 0) {
+		/* boot or interval change: times unknown until next record */
+		peer_time.valid = 0;
+	} else if (peer_time.valid) {
+		if (peer_time.seen & bit) {
+			peer_time.time += peer_time.interval;
+			peer_time.seen = 0;
+		}
+		peer_time.seen |= bit;
+		peer_timed++;
+	}
+	if (sim_verbose)
+		printf("peer entry 0x%x %d %dmA %d0mV %dK at %ld\n", idx,
+		    e->s.instance, logtoi(e), logtou(e), e->s.temp + 233,
+		    peer_time.valid ? (long)peer_time.time : -1L);
+}
+
+static void
+peer_time_rec(uint16_t idx, struct log_time *tm)
+{
+	if (sim_verbose)
+		printf("peer time 0x%x %u interval %u\n", idx, tm->time,
+		    tm->interval);
+	peer_time.valid = 1;
+	peer_time.time = tm->time;
+	peer_time.interval = tm->interval;
+	peer_time.seen = 0;
+}
+
+static void
+peer_env(uint16_t idx, struct log_env *env)
+{
+	peer_envs++;
+	if (sim_verbose)
+		printf("peer env 0x%x %d %d/%dmA %d0mV\n", idx,
+		    env->instance, env->i_min, env->i_max, env->u_min);
+}
+
+static void
+peer_decode(uint16_t idx, const uint8_t *data, int len)
+{
+	union log_entry e;
+	struct log_aux aux;
+	int i, n;
+
+	i = sizeof(struct private_log_reply);
+	if ((idx & LOG_IDX_DELTA) == 0) {
+		for (; i + sizeof(e) <= len; i += sizeof(e)) {
+			memcpy(e.data, &data[i], sizeof(e));
+			peer_entry(idx, &e);
+		}
+		return;
+	}
+	if (i >= len || (data[i] != 0 && data[i] != peer_off)) {
+		peer_errs++;
+		return;
+	}
+	if (data[i] == 0) {
+		memset(peer_last, 0, sizeof(peer_last));
+		/* we may get the same page again: replay its times */
+		if ((idx & ~0x100) == peer_time_idx)
+			peer_time = peer_time_page;
+		peer_time_page = peer_time;
+		peer_time_idx = idx & ~0x100;
+	}
+	peer_off = data[i];
+	for (i++; i < len; i += n) {
+		n = log_rec_decode(peer_last, &data[i], len - i, &e, &aux);
+		if (n == 0) {
+			peer_errs++;
+			return;
+		}
+		peer_off += n;
+		if (!e.s.nvalid)
+			peer_entry(idx, &e);
+		else if (aux.type == LR_M_ENV)
+			peer_env(idx, &aux.env);
+		else if (aux.type == LR_M_TIME)
+			peer_time_rec(idx, &aux.time);
+		else if (sim_verbose)
+			printf("peer bank 0x%x %d\n", idx, aux.bank);
+	}
+}
+
+static void
+peer_burst(const uint8_t *data, int len)
+{
+	const struct private_log_burst_reply *br = (const void *)data;
+	int i, n, nchans = 0;
+
+	for (i = 0; i < 4; i++) {
+		if (br->chans & (1 << i))
+			nchans++;
+	}
+	if (nchans == 0) {
+		printf("burst: no channels\n");
+		return;
+	}
+	n = (len - sizeof(*br)) / sizeof(struct burst_sample) / nchans;
+	if (peer_burst_pkts++ == 0) {
+		peer_burst_samples = 0;
+		printf("burst: from sample %u\n", br->seq);
+	} else if (br->seq != peer_burst_seq) {
+		printf("burst: sample %u, expected %u\n", br->seq,
+		    peer_burst_seq);
+	}
+	for (i = 0; i < n && sim_verbose; i++) {
+		printf("burst %u %dmA %d0mV\n", br->seq + i,
+		    br->data[i * nchans].current * 10,
+		    br->data[i * nchans].voltage);
+	}
+	peer_burst_seq = br->seq + n;
+	peer_burst_samples += n;
+	if (br->chans & BURST_LAST) {
+		printf("burst: %lu samples in %lu packets, "
+		    "to sample %u at %.1fs\n", peer_burst_samples,
+		    peer_burst_pkts, peer_burst_seq - 1, sim_us / 1e6);
+	}
+}
+
+/* a message from the firmware for the peer */
+static void
+peer_receive(const uint8_t *data, int len)
+{
+	uint16_t idx;
+
+	switch(data[0]) {
+	case PRIVATE_LOG_REPLY:
+		idx = data[2] | ((uint16_t)data[3] << 8);
+		peer_bytes += len;
+		peer_decode(idx, data, len);
+		if ((idx & 0x100) == 0)
+			break; /* more to come for this page */
+		peer_pages++;
+		peer_idx = idx & ~0x100;
+		peer_have_page = 1;
+		peer_request(PRIVATE_LOG_REQUEST_NEXT, peer_idx);
+		break;
+	case PRIVATE_LOG_ERROR:
+		if (data[2] == PRIVATE_LOG_ERROR_NOTFOUND)
+			peer_have_page = 0;
+		peer_sync_done();
+		break;
+	case PRIVATE_LOG_INTERVAL_REPLY:
+		printf("log interval %ds", data[2] | (data[3] << 8));
+		if (len > 4)
+			printf(", channel 0 is instance %d", data[4]);
+		printf("\n");
+		break;
+	case PRIVATE_LOG_BURST_REPLY:
+		peer_burst(data, len);
+		break;
+	case PRIVATE_LOG_SCHED_REPLY:
+		memcpy(sched_reply, data, len);
+		sched_reply_len = len;
+		break;
+	}
+}
+
+/* same checks as peer_decode(), without the time tracking */
+static void
+mirror_decode(uint16_t idx, const uint8_t *data, int len)
+{
+	union log_entry e;
+	struct log_aux aux;
+	int i, n;
+
+	i = sizeof(struct private_log_reply);
+	if ((idx & LOG_IDX_DELTA) == 0) {
+		mirror.entries += (len - i) / sizeof(e);
+		return;
+	}
+	if (i >= len || (data[i] != 0 && data[i] != mirror.off)) {
+		mirror.errs++;
+		return;
+	}
+	if (data[i] == 0)
+		memset(mirror.last, 0, sizeof(mirror.last));
+	mirror.off = data[i];
+	for (i++; i < len; i += n) {
+		n = log_rec_decode(mirror.last, &data[i], len - i, &e, &aux);
+		if (n == 0) {
+			mirror.errs++;
+			return;
+		}
+		mirror.off += n;
+		if (!e.s.nvalid)
+			mirror.entries++;
+	}
+}
+
+static void
+mirror_receive(const uint8_t *data, int len)
+{
+	uint16_t idx;
+
+	switch(data[0]) {
+	case PRIVATE_LOG_REPLY:
+		if (data[1] != mirror.sid) {
+			/* not our request: the firmware mixed them up */
+			mirror.errs++;
+			break;
+		}
+		idx = data[2] | ((uint16_t)data[3] << 8);
+		mirror.bytes += len;
+		mirror_decode(idx, data, len);
+		if ((idx & 0x100) == 0)
+			break;
+		mirror.pages++;
+		mirror.idx = idx & ~0x100;
+		mirror.have_page = 1;
+		mirror_request(PRIVATE_LOG_REQUEST_NEXT, mirror.idx);
+		break;
+	case PRIVATE_LOG_ERROR:
+		if (data[2] == PRIVATE_LOG_ERROR_NOTFOUND)
+			mirror.have_page = 0;
+		mirror.syncing = 0;
+		mirror.syncs++;
+		break;
+	}
+}
+
+static char
+send_msg(struct nmea2000_msg *msg, int frames)
+{
+	if (nmea2000_status != NMEA2000_S_OK) {
+		tx_fail++;
+		return 0;
+	}
+	tx_msgs++;
+	tx_frames += frames;
+	/* the stack waits for the frames to be on the bus */
+	sim_us += frames * CAN_FRAME_US;
+	if (msg->id.iso_pg == ((PRIVATE_LOG >> 8) & 0xff) &&
+	    msg->id.daddr == PEER_ADDR)
+		peer_receive(msg->data, msg->dlc);
+	if (msg->id.iso_pg == ((PRIVATE_LOG >> 8) & 0xff) &&
+	    msg->id.daddr == MIRROR_ADDR)
+		mirror_receive(msg->data, msg->dlc);
+	if (msg->id.iso_pg == ((NMEA2000_DC_STATUS >> 8) & 0xff) &&
+	    msg->id.daddr == (NMEA2000_DC_STATUS & 0xff)) {
+		const struct nmea2000_dc_status_data *d = msg->data;
+
+		dc_msgs++;
+		if (sim_verbose && d->soc != dc_last[d->instance & 3].soc)
+			printf("dc status %d soc %d%% %umn at %.0fs\n",
+			    d->instance, d->soc, d->timeremain, sim_us / 1e6);
+		dc_last[d->instance & 3] = *d;
+	}
+	if (msg->id.page == ((NMEA2000_ALERT >> 16) & 1) &&
+	    msg->id.iso_pg == ((NMEA2000_ALERT >> 8) & 0xff) &&
+	    msg->id.daddr == (NMEA2000_ALERT & 0xff)) {
+		const struct nmea2000_alert_data *d = msg->data;
+
+		alert_msgs[d->state == ALERT_STATE_ACTIVE ? 0 : 1]++;
+		if (sim_verbose)
+			printf("alert %d #%d type 0x%x threshold %d state %d "
+			    "at %.1fs\n", d->id, d->occurrence, d->type,
+			    d->condition >> 4, d->state, sim_us / 1e6);
+	}
+	return 1;
+}
+
+char
+nmea2000_send_single_frame(struct nmea2000_msg *msg)
+{
+	return send_msg(msg, 1);
+}
+
+char
+nmea2000_send_fast_frame(struct nmea2000_msg *msg, uint8_t fastid)
+{
+	int frames = 1;
+
+	if (msg->dlc > 6)
+		frames += (msg->dlc - 6 + 6) / 7;
+	return send_msg(msg, frames);
+}
+
+void
+can_report(double days)
+{
+	printf("can: %lu msgs %lu frames sent (%.0f frames/day), "
+	    "%lu failed, %lu frames received\n",
+	    tx_msgs, tx_frames, tx_frames / days, tx_fail, rx_frames);
+	if (rx_frames)
+		printf("can: rx latency %.0fus avg %luus max\n",
+		    (double)rx_lat_sum / rx_frames, (u_long)rx_lat_max);
+	printf("log sync: %lu syncs, %lu pages %lu entries, "
+	    "longest %.1fms\n",
+	    peer_syncs, peer_pages, peer_entries, peer_sync_max / 1000.0);
+	printf("log sync: %lu bytes, %.2f bytes/entry, %lu decode errors\n",
+	    peer_bytes, peer_entries ? (double)peer_bytes / peer_entries : 0,
+	    peer_errs);
+	printf("log sync: %lu envelopes, %lu entries with device time, "
+	    "%lu resets\n", peer_envs, peer_timed, peer_resets);
+	if (can_mirror) {
+		printf("mirror sync: %lu syncs, %lu pages %lu entries "
+		    "%lu bytes, %lu errors %lu timeouts\n", mirror.syncs,
+		    mirror.pages, mirror.entries, mirror.bytes, mirror.errs,
+		    mirror.timeouts);
+	}
+	printf("dc status: %lu msgs", dc_msgs);
+	for (int c = 0; c < 4; c++) {
+		if (dc_last[c].type == DCSTAT_TYPE_BATT && dc_last[c].soc != 0)
+			printf(", %d: %d%% %umn", c, dc_last[c].soc,
+			    dc_last[c].timeremain);
+	}
+	printf("\n");
+	printf("alerts: %lu active %lu normal\n", alert_msgs[0], alert_msgs[1]);
+	if (sched_reply_len != 0) {
+		struct private_log_sched_reply *r = (void *)sched_reply;
+		int n = (sched_reply_len - sizeof(*r)) / sizeof(r->task[0]);
+
+		printf("sched: %d tasks at %dHz, period/phase wcet:",
+		    n, r->ticks);
+		for (int i = 0; i < n; i++) {
+			printf(" %d/%d%s %uus", r->task[i].period,
+			    r->task[i].phase & ~SCHED_T_PAC,
+			    (r->task[i].phase & SCHED_T_PAC) ? "p" : "",
+			    r->task[i].wcet);
+		}
+		printf("\n");
+	}
+}
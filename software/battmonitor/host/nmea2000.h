@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * host build: the parts of the pic18_n2k nmea2000.h API used by the
+ * firmware, implemented by can_host.c
+ */
+
+#ifndef HOST_NMEA2000_H_
+#define HOST_NMEA2000_H_
+
+#include <stdint.h>
+#include "nmea2000_user.h"
+
+#define NMEA2000_DATA_LENGTH	8
+#define NMEA2000_DATA_FASTLENGTH 223
+
+#define NMEA2000_PRIORITY_HIGH		0
+#define NMEA2000_PRIORITY_SECURITY	1
+#define NMEA2000_PRIORITY_CONTROL	3
+#define NMEA2000_PRIORITY_REQUEST	6
+#define NMEA2000_PRIORITY_INFO		6
+#define NMEA2000_PRIORITY_ACK		6
+#define NMEA2000_PRIORITY_LOW		7
+
+#define NMEA2000_ADDR_GLOBAL	255
+
+#define FASTPACKET_IDX_MASK	0x1f
+#define FASTPACKET_ID_MASK	0xe0
+
+union nmea2000_id {
+	uint32_t id;
+	struct {
+		uint8_t saddr;
+		uint8_t daddr;
+		uint8_t iso_pg;
+		unsigned page : 1;
+		unsigned dpage : 1;
+		unsigned priority : 3;
+		unsigned : 3;
+	};
+};
+
+struct nmea2000_msg {
+	union nmea2000_id id;
+	uint8_t dlc;
+	void *data;
+};
+
+#define PGN2ID(pgn, i) { \
+	(i).id = 0; \
+	(i).page = ((pgn) >> 16) & 0x1; \
+	(i).iso_pg = ((pgn) >> 8) & 0xff; \
+	(i).daddr = (pgn) & 0xff; \
+    }
+
+#define SIDINC(sid) { \
+	(sid)++; \
+	if ((sid) > 252) \
+		(sid) = 0; \
+    }
+
+extern union nmea2000_id rid;
+extern uint8_t rdata[NMEA2000_DATA_LENGTH];
+extern uint8_t nmea2000_addr;
+
+extern uint8_t nmea2000_status;
+#define NMEA2000_S_ABORT	0
+#define NMEA2000_S_CLAIMING	1
+#define NMEA2000_S_OK		2
+
+void nmea2000_init(void);
+void nmea2000_poll(uint8_t);
+void nmea2000_receive(void);
+char nmea2000_send_single_frame(struct nmea2000_msg *);
+char nmea2000_send_fast_frame(struct nmea2000_msg *, uint8_t);
+
+/* provided by the user code */
+void user_receive(void);
+void user_handle_iso_request(unsigned long);
+
+#endif /* HOST_NMEA2000_H_ */
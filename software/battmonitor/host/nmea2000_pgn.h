@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* host build: the PGNs and payloads of nmea2000_pgn.h the firmware uses */
+
+#ifndef HOST_NMEA2000_PGN_H_
+#define HOST_NMEA2000_PGN_H_
+
+#define ISO_ADDRESS_CLAIM	60928UL
+#define ISO_REQUEST		59904UL
+
+#define NMEA2000_BATTERY_STATUS	127508UL
+struct nmea2000_battery_status_data {
+	uint8_t instance;
+	int16_t voltage;	/* 0.01V */
+	int16_t current;	/* 0.01A */
+	uint16_t temp;		/* 0.01K */
+	uint8_t sid;
+} __packed;
+
+#define NMEA2000_DC_STATUS	127506UL
+struct nmea2000_dc_status_data {
+	uint8_t sid;
+	uint8_t instance;
+	uint8_t type;
+#define DCSTAT_TYPE_BATT	0
+	uint8_t soc;		/* % */
+	uint8_t soh;		/* % */
+	uint16_t timeremain;	/* minutes */
+	uint16_t ripple;	/* 0.01V */
+} __packed;
+
+#define PRIVATE_LOG		39936UL
+struct private_log_request {
+	uint8_t cmd;
+#define PRIVATE_LOG_REQUEST_FIRST 0
+#define PRIVATE_LOG_REQUEST_NEXT 1
+#define PRIVATE_LOG_REQUEST	2
+#define PRIVATE_LOG_RESET	9
+#define PRIVATE_LOG_REPLY	10
+#define PRIVATE_LOG_ERROR	11
+	uint8_t sid;
+	uint16_t idx;
+} __packed;
+
+struct private_log_reply {
+	uint8_t cmd;
+	uint8_t sid;
+	uint16_t idx;
+	uint8_t data[];
+} __packed;
+
+struct private_log_error {
+	uint8_t cmd;
+	uint8_t sid;
+	uint8_t error;
+#define PRIVATE_LOG_ERROR_NOTFOUND 0
+#define PRIVATE_LOG_ERROR_LAST	1
+} __packed;
+
+struct private_log_reset {
+	uint8_t cmd;
+	uint8_t sid;
+	uint16_t magic;
+#define PRIVATE_LOG_RESET_MAGIC 0x18e1
+} __packed;
+
+#endif /* HOST_NMEA2000_PGN_H_ */
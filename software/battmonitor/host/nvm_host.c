@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * host build: mock NVM. The journal lives in RAM, with the flash
+ * semantics: erase sets all bits, programming can only clear bits.
+ * Erases and writes are counted per page, for wear estimations.
+ */
+
+#include <xc.h>
+#include <stdlib.h>
+#include <string.h>
+#include "battlog.h"
+/* the firmware sees a read-only array, we write it */
+#define battlog battlog_ro
+#define alertlog alertlog_ro
+#include "alert.h"
+#include "nvm.h"
+#undef battlog
+#undef alertlog
+#include "sim.h"
+
+struct log_block battlog[LOG_BLOCKS];
+struct log_block curlog;
+struct alert_block alertlog[ALERT_BLOCKS];
+
+static u_long erases[LOG_BLOCKS];
+static u_long writes[LOG_BLOCKS];
+static u_long reads;
+static u_long bad_writes;
+static u_long alert_erases, alert_writes;
+
+static int
+page_index(const struct log_block *b)
+{
+	int i = b - battlog;
+
+	if (i < 0 || i >= LOG_BLOCKS) {
+		fprintf(stderr, "nvm: bad page address %p\n", b);
+		abort();
+	}
+	return i;
+}
+
+void
+page_erase(const struct log_block *b)
+{
+	int i = page_index(b);
+
+	memset(&battlog[i], 0xff, sizeof(battlog[i]));
+	erases[i]++;
+}
+
+void
+page_read(const struct log_block *b)
+{
+	int i = page_index(b);
+
+	memcpy(&curlog, &battlog[i], sizeof(curlog));
+	reads++;
+}
+
+void
+page_write(const struct log_block *b)
+{
+	int i = page_index(b);
+	uint8_t *f = (uint8_t *)&battlog[i];
+	const uint8_t *r = (const uint8_t *)&curlog;
+	int bad = 0;
+
+	for (size_t j = 0; j < sizeof(curlog); j++) {
+		if (r[j] & ~f[j])
+			bad++;
+		f[j] &= r[j];
+	}
+	if (bad) {
+		/* the firmware wrote a 1 over a 0 without erase */
+		fprintf(stderr, "nvm: page %d: %d bytes not erased\n", i, bad);
+		bad_writes++;
+	}
+	writes[i]++;
+}
+
+static int
+alert_index(const void *p, size_t size)
+{
+	const uint8_t *a = p;
+	const uint8_t *base = (const uint8_t *)alertlog;
+
+	if (a < base || a + size > base + sizeof(alertlog)) {
+		fprintf(stderr, "nvm: bad alert log address %p\n", p);
+		abort();
+	}
+	return a - base;
+}
+
+void
+alert_page_erase(const struct alert_block *b)
+{
+	int i = alert_index(b, sizeof(*b));
+
+	memset((uint8_t *)alertlog + i, 0xff, sizeof(*b));
+	alert_erases++;
+}
+
+void
+alert_write(const struct alert_entry *a, const struct alert_entry *e)
+{
+	uint8_t *f = (uint8_t *)alertlog + alert_index(a, sizeof(*a));
+	const uint8_t *r = (const uint8_t *)e;
+	int bad = 0;
+
+	for (size_t j = 0; j < sizeof(*e); j++) {
+		if (r[j] & ~f[j])
+			bad++;
+		f[j] &= r[j];
+	}
+	if (bad) {
+		fprintf(stderr, "nvm: alert slot %td: %d bytes not erased\n",
+		    a - &alertlog[0].a_entry[0], bad);
+		bad_writes++;
+	}
+	alert_writes++;
+}
+
+void
+nvm_init(int partial, int erasing, int oldfmt)
+{
+	struct log_last last[4];
+	union log_entry e;
+	int i, off;
+
+	/* a blank part */
+	memset(battlog, 0xff, sizeof(battlog));
+	memset(alertlog, 0xff, sizeof(alertlog));
+	if (oldfmt) {
+		/*
+		 * a log from the firmwares with fixed-size entries only:
+		 * generation 0x04 in blocks 0-40, the current one being
+		 * 40, and generation 0 after it.
+		 */
+		for (i = 0; i < LOG_BLOCKS; i++) {
+			for (off = 0; off < LOG_ENTRIES; off++) {
+				if (i == 40 && off == 20)
+					break;
+				memset(&e, 0, sizeof(e));
+				e.s.instance = off % 3;
+				e.s.temp = 293 - 233;
+				itolog(-1500 + (i * LOG_ENTRIES + off) % 3000,
+				    &e);
+				utolog(1250 + off, &e);
+				battlog[i].b_entry[off] = e;
+			}
+			battlog[i].b_flags = (i <= 40 ? 0x04 : 0x00) |
+			    (i == 40 ? B_FILL_PART : B_FILL_FULL);
+		}
+		return;
+	}
+	if (erasing) {
+		/*
+		 * a log reset interrupted after erasing blocks 1-9: a new
+		 * log in block 0, and an old one in blocks 10 and up.
+		 */
+		for (i = 10; i < LOG_BLOCKS; i++) {
+			memset(&battlog[i], 0, sizeof(battlog[i]));
+			battlog[i].b_fmt = B_FMT_DELTA;
+			battlog[i].b_flags = (3 * B_GEN_INC) |
+			    (i == 60 ? B_FILL_PART : B_FILL_FULL);
+		}
+		memset(last, 0, sizeof(last));
+		battlog[0].b_fmt = B_FMT_DELTA;
+		battlog[0].b_flags = B_FILL_PART;
+		log_rec_encode(last, NULL, &battlog[0].b_data[0]);
+	}
+	if (!partial)
+		return;
+	/*
+	 * block 0 with 10 entries, and a commit interrupted while
+	 * programming a later one.
+	 */
+	memset(last, 0, sizeof(last));
+	battlog[0].b_fmt = B_FMT_DELTA;
+	battlog[0].b_flags = B_FILL_PART;
+	for (i = 0, off = 0; i < 10; i++) {
+		memset(&e, 0, sizeof(e));
+		e.s.instance = i % 3;
+		itolog(i * 100, &e);
+		utolog(1270 + i, &e);
+		off += log_rec_encode(last, &e, &battlog[0].b_data[off]);
+	}
+	memset(&battlog[0].b_data[off + 5], 0x5a, 3);
+}
+
+void
+nvm_report(double days)
+{
+	u_long te = 0, tw = 0, me = 0;
+
+	for (int i = 0; i < LOG_BLOCKS; i++) {
+		te += erases[i];
+		tw += writes[i];
+		if (erases[i] > me)
+			me = erases[i];
+	}
+	printf("flash: %lu erases %lu writes %lu reads, "
+	    "%.1f erases %.1f writes per day, max %lu erases on a page\n",
+	    te, tw, reads, te / days, tw / days, me);
+	if (bad_writes)
+		printf("flash: %lu writes without erase\n", bad_writes);
+	printf("alert log: %lu writes %lu erases\n",
+	    alert_writes, alert_erases);
+	for (int b = 0; b < ALERT_BLOCKS; b++) {
+		for (int i = 0; i < ALERT_ENTRIES; i++) {
+			const struct alert_entry *a = &alertlog[b].a_entry[i];
+
+			if (a->type == ALERT_T_FREE)
+				continue;
+			printf("  %d/%d: %d type 0x%x at %us, "
+			    "peak %.2fA %.2fV, %.1fs\n", b, i, a->instance,
+			    a->type, a->time, a->i_peak / 100.0,
+			    a->v_min / 100.0, a->duration / 10.0);
+		}
+	}
+}
@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * host build: mock PAC195x, at the i2c.h API level. Registers are
+ * computed from the simulated batteries (sim.c) when a refresh
+ * command is received, the way the chip latches its accumulators.
+ * Transfers take the simulated time they would take on the bus.
+ * Multi-byte values are returned in host byte order, which is what
+ * i2c_readreg_be() does on the PIC.
+ * The limits are compared to the values at each 10Hz tick, not at each
+ * sample, and the sample counts of the *LIMIT_SMPL registers are ignored.
+ */
+
+#include <xc.h>
+#include <string.h>
+#include <math.h>
+#include "i2c.h"
+#include "pac195x.h"
+#include "sim.h"
+
+#define PAC_NCHAN	4
+#define PAC_ACC_HZ	1024	/* CTRL_MODE_1024 */
+#define I2C_BYTE_US	90	/* 100kHz bus */
+
+/* calibration factors applied by the firmware */
+static const double pac_cal[PAC_NCHAN] = {
+	0.988689144013892, 1.00930129713152, 4.06331342566096, 1
+};
+
+static pac_ctrl_t pac_ctrl_act;
+static uint64_t pac_acc_start;
+static uint32_t pac_acccnt;
+static int64_t pac_accv[PAC_NCHAN];
+static int16_t pac_vbus[PAC_NCHAN];
+static int16_t pac_vsense[PAC_NCHAN];
+static int16_t pac_oclimit[PAC_NCHAN], pac_uclimit[PAC_NCHAN];
+static int16_t pac_uvlimit[PAC_NCHAN];
+static uint8_t pac_alert1[3], pac_alert2[3], pac_alert_en[3];
+static uint8_t pac_alertst[3];	/* latched, cleared when read */
+
+static u_long i2c_xfers, i2c_bytes;
+
+static int16_t
+pac_vbus_code(int c)
+{
+	/* full scale 32V, 16 bits, half range */
+	return lrint(sim_voltage(c, sim_us) / 0.00048778104);
+}
+
+static int64_t
+pac_vsense_code(int c)
+{
+	/* vsense code per sample, for the current at this time */
+	return llrint(sim_current(c, sim_us) * 100 / 0.075 / pac_cal[c]);
+}
+
+static int16_t
+pac_sat16(int64_t v)
+{
+	if (v > INT16_MAX)
+		return INT16_MAX;
+	if (v < INT16_MIN)
+		return INT16_MIN;
+	return v;
+}
+
+static void
+pac_refresh_v(void)
+{
+	for (int c = 0; c < PAC_NCHAN; c++) {
+		pac_vbus[c] = pac_vbus_code(c);
+		pac_vsense[c] = pac_sat16(pac_vsense_code(c));
+	}
+}
+
+static void
+pac_refresh(void)
+{
+	pac_acccnt = (sim_us - pac_acc_start) * PAC_ACC_HZ / 1000000;
+	pac_acc_start = sim_us;
+	for (int c = 0; c < PAC_NCHAN; c++)
+		pac_accv[c] = pac_vsense_code(c) * (int64_t)pac_acccnt;
+	pac_refresh_v();
+}
+
+static char
+pac_read(uint8_t reg, uint8_t *data, uint8_t size)
+{
+	int64_t v;
+
+	i2c_xfers++;
+	i2c_bytes += size;
+	switch(reg) {
+	case PAC_PRODUCT:
+		*data = 0x50; /* PAC1954 */
+		return 1;
+	case PAC_MANUF:
+		*data = 0x54;
+		return 1;
+	case PAC_REV:
+		*data = 0x02;
+		return 1;
+	case PAC_CTRL_ACT:
+		if (size != sizeof(pac_ctrl_act))
+			return 0;
+		memcpy(data, &pac_ctrl_act, size);
+		return size;
+	case PAC_ACCCNT:
+		if (size != sizeof(pac_acccnt))
+			return 0;
+		memcpy(data, &pac_acccnt, size);
+		return size;
+	case PAC_ACCV1:
+	case PAC_ACCV2:
+	case PAC_ACCV3:
+	case PAC_ACCV4:
+		/* 56 bits signed */
+		if (size != 7)
+			return 0;
+		v = pac_accv[reg - PAC_ACCV1];
+		for (int i = 0; i < 7; i++) {
+			data[i] = v & 0xff;
+			v >>= 8;
+		}
+		return size;
+	case PAC_VBUS1_AVG:
+	case PAC_VBUS2_AVG:
+	case PAC_VBUS3_AVG:
+	case PAC_VBUS4_AVG:
+		if (size != sizeof(int16_t))
+			return 0;
+		memcpy(data, &pac_vbus[reg - PAC_VBUS1_AVG], size);
+		return size;
+	case PAC_VSENSE1:
+	case PAC_VSENSE2:
+	case PAC_VSENSE3:
+	case PAC_VSENSE4:
+		if (size != sizeof(int16_t))
+			return 0;
+		memcpy(data, &pac_vsense[reg - PAC_VSENSE1], size);
+		return size;
+	case PAC_ALERTST:
+		if (size != sizeof(pac_alertst))
+			return 0;
+		memcpy(data, pac_alertst, size);
+		memset(pac_alertst, 0, sizeof(pac_alertst));
+		return size;
+	}
+	printf("pac: read unknown reg 0x%x\n", reg);
+	return 0;
+}
+
+static char
+pac_write(uint8_t reg, uint8_t *data, uint8_t size)
+{
+	uint8_t dis;
+
+	i2c_xfers++;
+	i2c_bytes += size;
+	switch(reg) {
+	case PAC_CTRL:
+		if (size != sizeof(pac_ctrl_act))
+			return 0;
+		/* the channels disabled at power up stay disabled */
+		dis = pac_ctrl_act.ctrl_chan_dis;
+		memcpy(&pac_ctrl_act, data, size);
+		pac_ctrl_act.ctrl_chan_dis = dis;
+		return 1;
+	case PAC_ACCUMCFG:
+	case PAC_NEG_PWR_FSR:
+	case PAC_OCLIMIT_SMPL:
+	case PAC_UCLIMIT_SMPL:
+	case PAC_UVLIMIT_SMPL:
+		return 1;
+	case PAC_OCLIMIT1:
+	case PAC_OCLIMIT2:
+	case PAC_OCLIMIT3:
+	case PAC_OCLIMIT4:
+		if (size != sizeof(int16_t))
+			return 0;
+		memcpy(&pac_oclimit[reg - PAC_OCLIMIT1], data, size);
+		return 1;
+	case PAC_UCLIMIT1:
+	case PAC_UCLIMIT2:
+	case PAC_UCLIMIT3:
+	case PAC_UCLIMIT4:
+		if (size != sizeof(int16_t))
+			return 0;
+		memcpy(&pac_uclimit[reg - PAC_UCLIMIT1], data, size);
+		return 1;
+	case PAC_UVLIMIT1:
+	case PAC_UVLIMIT2:
+	case PAC_UVLIMIT3:
+	case PAC_UVLIMIT4:
+		if (size != sizeof(int16_t))
+			return 0;
+		memcpy(&pac_uvlimit[reg - PAC_UVLIMIT1], data, size);
+		return 1;
+	case PAC_ALERT1:
+	case PAC_ALERT2:
+	case PAC_ALERT_EN:
+		if (size != 3)
+			return 0;
+		memcpy(reg == PAC_ALERT1 ? pac_alert1 :
+		    reg == PAC_ALERT2 ? pac_alert2 : pac_alert_en, data, size);
+		return 1;
+	}
+	printf("pac: write unknown reg 0x%x\n", reg);
+	return 0;
+}
+
+static char
+pac_cmd(uint8_t reg)
+{
+	i2c_xfers++;
+	switch(reg) {
+	case PAC_REFRESH:
+		pac_refresh();
+		return 1;
+	case PAC_REFRESH_V:
+		pac_refresh_v();
+		return 1;
+	}
+	printf("pac: unknown command 0x%x\n", reg);
+	return 0;
+}
+
+/*
+ * blocking transfers: the firmware busy-waits for the duration of
+ * the transfer.
+ */
+char
+i2c_readreg(const uint8_t address, uint8_t reg, uint8_t *data, uint8_t size)
+{
+	sim_us += (size + 3) * I2C_BYTE_US;
+	return pac_read(reg, data, size);
+}
+
+char
+i2c_readreg_be(const uint8_t address, uint8_t reg, uint8_t *data,
+    uint8_t size)
+{
+	sim_us += (size + 3) * I2C_BYTE_US;
+	return pac_read(reg, data, size);
+}
+
+char
+i2c_writereg(const uint8_t address, uint8_t reg, uint8_t *data, uint8_t size)
+{
+	sim_us += (size + 2) * I2C_BYTE_US;
+	return pac_write(reg, data, size);
+}
+
+char
+i2c_writereg_be(const uint8_t address, uint8_t reg, uint8_t *data,
+    uint8_t size)
+{
+	return i2c_writereg(address, reg, data, size);
+}
+
+char
+i2c_writecmd(const uint8_t address, uint8_t reg)
+{
+	sim_us += 2 * I2C_BYTE_US;
+	return pac_cmd(reg);
+}
+
+/*
+ * queued transfers: they complete one at a time from host_sleep(),
+ * taking the time they would take on a 100kHz bus.
+ */
+static struct i2c_xfer *i2c_q[I2C_QUEUE_SIZE];
+static int i2c_qprod, i2c_qcons;
+static u_long i2c_queued, i2c_qmax;
+
+char
+i2c_queue(struct i2c_xfer *x)
+{
+	int next = (i2c_qprod + 1) & I2C_QUEUE_MASK;
+	int depth;
+
+	if (x->status == I2C_XS_QUEUED || next == i2c_qcons)
+		return 0;
+	x->status = I2C_XS_QUEUED;
+	i2c_q[i2c_qprod] = x;
+	i2c_qprod = next;
+	i2c_queued++;
+	depth = (i2c_qprod - i2c_qcons) & I2C_QUEUE_MASK;
+	if (depth > i2c_qmax)
+		i2c_qmax = depth;
+	return 1;
+}
+
+void
+i2c_abort(void)
+{
+	while (i2c_qcons != i2c_qprod) {
+		i2c_q[i2c_qcons]->status = I2C_XS_ERROR;
+		i2c_qcons = (i2c_qcons + 1) & I2C_QUEUE_MASK;
+	}
+}
+
+/* time to run the next queued transfer, 0 if none */
+int
+i2c_host_pending(void)
+{
+	struct i2c_xfer *x;
+
+	if (i2c_qcons == i2c_qprod)
+		return 0;
+	x = i2c_q[i2c_qcons];
+	/* address, register, (restart, address), data */
+	return (x->size + ((x->flags & I2C_XF_READ) ? 3 : 2)) * I2C_BYTE_US;
+}
+
+void
+i2c_host_run(void)
+{
+	struct i2c_xfer *x = i2c_q[i2c_qcons];
+	char r;
+
+	i2c_qcons = (i2c_qcons + 1) & I2C_QUEUE_MASK;
+	if (x->flags & I2C_XF_READ)
+		r = pac_read(x->reg, x->data, x->size);
+	else if (x->size == 0)
+		r = pac_cmd(x->reg);
+	else
+		r = pac_write(x->reg, x->data, x->size);
+	x->status = r ? I2C_XS_DONE : I2C_XS_ERROR;
+}
+
+/*
+ * compare the values to the limits, latch the alert status; return
+ * the asserted alert pins: bit 0 for Alert1, bit 1 for Alert2.
+ */
+int
+pac_alert_pins(void)
+{
+	int pins = 0;
+
+	for (int c = 0; c < PAC_NCHAN; c++) {
+		int64_t vs = pac_vsense_code(c);
+		int16_t vb = pac_vbus_code(c);
+
+		if (pac_ctrl_act.ctrl_chan_dis & (8 >> c))
+			continue;
+		if (vs > pac_oclimit[c])
+			pac_alertst[0] |= PAC_AL0_OC(c) & pac_alert_en[0];
+		if (vs < pac_uclimit[c])
+			pac_alertst[0] |= PAC_AL0_UC(c) & pac_alert_en[0];
+		if (vb < pac_uvlimit[c])
+			pac_alertst[1] |= PAC_AL1_UV(c) & pac_alert_en[1];
+	}
+	for (int i = 0; i < 3; i++) {
+		if (pac_alertst[i] & pac_alert1[i])
+			pins |= 1;
+		if (pac_alertst[i] & pac_alert2[i])
+			pins |= 2;
+	}
+	return pins;
+}
+
+void
+pac_init(void)
+{
+	/* channel 4 is not wired */
+	pac_ctrl_act.ctrl_chan_dis = 0x1;
+	pac_acc_start = sim_us;
+}
+
+void
+pac_report(double days)
+{
+	printf("i2c: %lu transfers (%lu queued, max depth %lu) %lu bytes, "
+	    "%.0f transfers/day\n",
+	    i2c_xfers, i2c_queued, i2c_qmax, i2c_bytes, i2c_xfers / days);
+}
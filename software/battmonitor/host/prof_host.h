@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* host build: PROF_ENTER/PROF_EXIT time the code between them */
+
+#ifndef HOST_PROF_H_
+#define HOST_PROF_H_
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROF_HAVE_TSC
+#endif
+
+struct prof {
+	const char *name;
+	uint64_t calls;
+	uint64_t ns;
+	uint64_t max_ns;
+	uint64_t cycles;
+	uint64_t sim_max_us;	/* simulated time */
+	/* current call */
+	uint64_t t0_ns;
+	uint64_t t0_cycles;
+	uint64_t t0_sim_us;
+};
+
+extern uint64_t sim_us;
+
+#define PROF_ENTER(p)	prof_enter(&prof_##p)
+#define PROF_EXIT(p)	prof_exit(&prof_##p)
+
+#include "prof.h"
+
+#define PROF_POINT(p)	extern struct prof prof_##p;
+PROF_POINTS
+#undef PROF_POINT
+
+static inline uint64_t
+prof_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void
+prof_enter(struct prof *p)
+{
+#ifdef PROF_HAVE_TSC
+	p->t0_cycles = __rdtsc();
+#endif
+	p->t0_ns = prof_now_ns();
+	p->t0_sim_us = sim_us;
+}
+
+static inline void
+prof_exit(struct prof *p)
+{
+	uint64_t ns = prof_now_ns() - p->t0_ns;
+
+#ifdef PROF_HAVE_TSC
+	p->cycles += __rdtsc() - p->t0_cycles;
+#endif
+	p->ns += ns;
+	if (ns > p->max_ns)
+		p->max_ns = ns;
+	if (sim_us - p->t0_sim_us > p->sim_max_us)
+		p->sim_max_us = sim_us - p->t0_sim_us;
+	p->calls++;
+}
+
+#endif /* HOST_PROF_H_ */
@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * host build of the battery monitor firmware, for profiling.
+ * main.c runs unmodified against mocks of the PIC peripherals, the
+ * PAC195x and the NMEA2000 stack; SLEEP() advances the simulated time
+ * to the next event. At the end of each simulated day, the time spent
+ * in the profiling points of prof.h is reported. The times and cycles
+ * are the host's: they are only meaningful relative to each other.
+ */
+
+#include <xc.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "serial.h"
+#include "ntc_tab.h"
+#include "sim.h"
+#include "trace_dec.h"
+
+void irqh_tu16a(void);
+void irqh_can(void);
+void irqh_hlvd(void);
+void irqh_ioc(void);
+int fw_main(void);
+
+uint64_t sim_us;
+int sim_verbose;
+
+static uint64_t sim_end;
+static uint64_t sim_pfail;	/* power-fail warning, 0: none */
+static uint64_t sim_next_tick;
+static int sim_day;
+static u_long printf_calls;
+static u_long trace_records, trace_bytes;
+static u_long ticks_missed;	/* the firmware was busy for 100ms */
+
+#define PROF_POINT(p)	struct prof prof_##p = { .name = #p };
+PROF_POINTS
+#undef PROF_POINT
+
+static struct prof *profs[] = {
+#define PROF_POINT(p)	&prof_##p,
+PROF_POINTS
+#undef PROF_POINT
+};
+
+/* serial.c */
+char uart_txbuf[UART_BUFSIZE];
+unsigned char uart_txbuf_prod;
+volatile unsigned char uart_txbuf_cons;
+
+void
+usart_putchar(char c)
+{
+	if (sim_verbose)
+		putchar(c);
+}
+
+unsigned char
+usart_txroom(void)
+{
+	return UART_BUFSIZE - 1;
+}
+
+/* trace records are decoded as they are sent */
+void
+usart_putraw(char c)
+{
+	trace_bytes++;
+	if (trace_dec_byte(sim_verbose ? stdout : NULL, c))
+		trace_records++;
+}
+
+int
+host_printf(const char *fmt, ...)
+{
+	va_list ap;
+	int r = 0;
+
+	printf_calls++;
+	if (sim_verbose) {
+		va_start(ap, fmt);
+		r = vprintf(fmt, ap);
+		va_end(ap);
+	}
+	return r;
+}
+
+/*
+ * the simulated batteries: a house bank with solar, an engine battery
+ * (the engine is started at 8:00, cranking for 3s)
+ */
+static double sim_noise[4];
+
+double
+sim_current(int c, uint64_t t)
+{
+	double h = fmod(t / 3600e6, 24);
+	double sun = sin((h - 6) * M_PI / 12);
+
+	switch(c) {
+	case 0:
+		return (sun > 0 ? 15 * sun : 0) - 4 + sim_noise[c];
+	case 1:
+		if (h >= 8 && h < 8 + 3 / 3600.0)
+			return -150 + sim_noise[c];
+		return -0.05 + sim_noise[c];
+	case 2:
+		return (sun > 0 ? 3 * sun : 0) + sim_noise[c];
+	}
+	return 0;
+}
+
+double
+sim_voltage(int c, uint64_t t)
+{
+	return 12.8 + sim_current(c, t) * 0.02;
+}
+
+double
+sim_temp(int c, uint64_t t)
+{
+	double h = fmod(t / 3600e6, 24);
+
+	return 20 + 5 * sin((h - 9) * M_PI / 12) + c;
+}
+
+/* NTC value for a temperature, the reverse of adctotemp() */
+static double
+sim_ntc(int c)
+{
+	double k = (sim_temp(c, sim_us) + 273.15) * 100;
+	int i;
+
+	for (i = 1; temps[i].val != 0; i++) {
+		if (k >= temps[i].temp) {
+			return temps[i].val +
+			    (k - temps[i].temp) *
+			    (temps[i - 1].val - temps[i].val) /
+			    (temps[i - 1].temp - temps[i].temp);
+		}
+	}
+	return 0;
+}
+
+/*
+ * one 12-bit conversion, with a few LSB of noise. The noise has its
+ * own generator, so that it doesn't change the random() sequence.
+ */
+static uint16_t
+sim_adc_conv(double v)
+{
+	static uint32_t seed = 1;
+	long r;
+
+	seed = seed * 1103515245 + 12345;
+	r = lround(v + ((int)((seed >> 16) % 5) - 2));
+	if (r < 0)
+		return 0;
+	if (r > 4095)
+		return 4095;
+	return r;
+}
+
+static void
+sim_adc(void)
+{
+	double v;
+	uint32_t acc;
+	int i;
+
+	switch(ADPCH) {
+	case 0:
+		v = sim_ntc(0);
+		break;
+	case 1:
+		v = sim_ntc(1);
+		break;
+	case 4:
+		v = sim_ntc(2);
+		break;
+	default:
+		v = 0;
+	}
+	if ((ADCON2 & 0x7) == 0x3) {
+		/* burst average: ADRPT conversions, ADTIF at end */
+		acc = 0;
+		for (i = 0; i < ADRPT; i++)
+			acc += sim_adc_conv(v);
+		acc >>= (ADCON2 >> 4) & 0x7;
+		ADCNT = ADRPT;
+		ADFLTRH = acc >> 8;
+		ADFLTRL = acc & 0xff;
+		PIR1bits.ADTIF = 1;
+	}
+	acc = sim_adc_conv(v);
+	ADRESH = acc >> 8;
+	ADRESL = acc & 0xff;
+	ADCON0bits.GO = 0;
+	PIR1bits.ADIF = 1;
+}
+
+static void
+sim_report_day(void)
+{
+	printf("day %d: %lu printf, %lu trace records (%lu bytes), "
+	    "%lu ticks missed\n", sim_day,
+	    printf_calls, trace_records, trace_bytes, ticks_missed);
+	for (size_t i = 0; i < sizeof(profs) / sizeof(profs[0]); i++) {
+		struct prof *p = profs[i];
+
+		if (p->calls == 0) {
+			printf("  %-18s 0 calls\n", p->name);
+			continue;
+		}
+		printf("  %-18s %8lu calls %10.0fns avg %10lu max "
+		    "%8.0f cycles avg %8luus sim max\n",
+		    p->name, (u_long)p->calls,
+		    (double)p->ns / p->calls, (u_long)p->max_ns,
+		    (double)p->cycles / p->calls, (u_long)p->sim_max_us);
+		p->calls = p->ns = p->max_ns = p->cycles = 0;
+		p->sim_max_us = 0;
+	}
+	printf_calls = 0;
+	trace_records = trace_bytes = 0;
+	ticks_missed = 0;
+}
+
+static void
+sim_advance(uint64_t t)
+{
+	sim_us = t;
+	if (sim_us / 86400000000ULL > (uint64_t)sim_day) {
+		sim_report_day();
+		sim_day++;
+	}
+	if (sim_us >= sim_end) {
+		double days = sim_end / 86400e6;
+
+		nvm_report(days);
+		pac_report(days);
+		can_report(days);
+		exit(0);
+	}
+}
+
+/*
+ * the PAC alert pins: Alert1 is wired to RB1, Alert2 to RB0, with
+ * pull-ups. A falling edge sets the IOC flag, if enabled.
+ */
+static void
+sim_alert_pins(void)
+{
+	int pins = pac_alert_pins();
+	uint8_t old = (PORTBbits.RB1 << 1) | PORTBbits.RB0;
+	uint8_t new = ((pins & 1) ? 0 : 2) | ((pins & 2) ? 0 : 1);
+	uint8_t fall = old & ~new & IOCBN;
+
+	PORTBbits.RB0 = new & 1;
+	PORTBbits.RB1 = (new >> 1) & 1;
+	if (fall) {
+		IOCBF |= fall;
+		if (PIE0bits.IOCIE)
+			irqh_ioc();
+	}
+}
+
+/*
+ * The firmware sleeps until the next interrupt: the end of an ADC
+ * conversion, a CAN frame from the peer, an I2C transfer, or the 10Hz
+ * timer.
+ */
+void
+host_sleep(void)
+{
+	uint64_t t;
+	int d;
+
+	if (ADCON0bits.GO) {
+		sim_advance(sim_us + 50);
+		sim_adc();
+		return;
+	}
+	if (can_rx_pending()) {
+		sim_advance(sim_us + 500);
+		C1INTLbits.RXIF = 1;
+		if (PIE0bits.CANIE)
+			irqh_can();
+		return;
+	}
+	if ((d = i2c_host_pending()) != 0) {
+		sim_advance(sim_us + d);
+		i2c_host_run();
+		return;
+	}
+	t = sim_next_tick;
+	if (t > sim_us)
+		sim_advance(t);
+	sim_next_tick += SIM_TICK_US;
+	while (sim_next_tick <= sim_us) {
+		/* the timer interrupt flag is still set */
+		sim_next_tick += SIM_TICK_US;
+		ticks_missed++;
+	}
+	if (t % 1000000 == 0) {
+		for (int c = 0; c < 4; c++)
+			sim_noise[c] = (random() % 1000 - 500) / 1000.0;
+		can_peer_tick();
+	}
+	if (sim_pfail != 0 && t >= sim_pfail) {
+		sim_pfail = 0;
+		if (PIE2bits.HLVDIE)
+			irqh_hlvd();
+	}
+	sim_alert_pins();
+	irqh_tu16a();
+}
+
+void
+host_reset(void)
+{
+	printf("firmware reset\n");
+	exit(1);
+}
+
+/* timer0 at 9.765625kHz; busy loops reading it make the time advance */
+static uint8_t tmr0h;
+
+uint8_t
+host_tmr0l(void)
+{
+	uint16_t v;
+
+	sim_us += 10;
+	v = sim_us * 10 / 1024;
+	tmr0h = v >> 8;
+	return v & 0xff;
+}
+
+uint8_t
+host_tmr0h(void)
+{
+	return tmr0h;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: bmsim [-CIOv] [-b hours] [-d days] "
+	    "[-E hours] [-i log interval (s)] [-m sync interval (s)] "
+	    "[-P hours] [-r seed] "
+	    "[-s sync interval (s)] [-T hours]\n");
+	fprintf(stderr, "	-b: get the 1s samples after this time\n");
+	fprintf(stderr, "	-C: start with a partially committed log block\n");
+	fprintf(stderr, "	-E: reset the log after this time\n");
+	fprintf(stderr, "	-I: start with an interrupted log erase\n");
+	fprintf(stderr, "	-m: sync the log from a second address too\n");
+	fprintf(stderr, "	-O: start with a log in the old format, "
+	    "generation 0x04\n");
+	fprintf(stderr, "	-P: power-fail warning after this time\n");
+	fprintf(stderr, "	-T: system time on the bus after this time "
+	    "(<0: never)\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	int ch;
+	int partial = 0;
+	int erasing = 0;
+	int oldfmt = 0;
+	double days = 1;
+
+	while ((ch = getopt(argc, argv, "b:Cd:E:Ii:m:OP:r:s:T:v")) != -1) {
+		switch(ch) {
+		case 'b':
+			can_burst_at = atof(optarg) * 3600e6;
+			break;
+		case 'C':
+			partial = 1;
+			break;
+		case 'E':
+			can_reset_at = atof(optarg) * 3600e6;
+			break;
+		case 'I':
+			erasing = 1;
+			break;
+		case 'i':
+			can_log_interval = atoi(optarg);
+			break;
+		case 'd':
+			days = atof(optarg);
+			break;
+		case 'm':
+			can_mirror = atoi(optarg);
+			break;
+		case 'O':
+			oldfmt = 1;
+			break;
+		case 'P':
+			sim_pfail = atof(optarg) * 3600e6;
+			break;
+		case 'r':
+			srandom(atoi(optarg));
+			break;
+		case 's':
+			can_sync_interval = atoi(optarg);
+			break;
+		case 'T':
+			can_time_at = atof(optarg) * 3600e6;
+			break;
+		case 'v':
+			sim_verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (days <= 0 || can_sync_interval < 0 || can_mirror < 0)
+		usage();
+	sim_end = days * 86400e6;
+	sim_next_tick = SIM_TICK_US;
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	nvm_init(partial, erasing, oldfmt);
+	pac_init();
+	PORTBbits.RB7 = 1; /* console connected */
+	PORTBbits.RB0 = PORTBbits.RB1 = 1; /* alert pins pulled up */
+	fw_main();
+	return 0;
+}
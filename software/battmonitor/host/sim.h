@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* host build: simulation state shared by the mocks */
+
+#ifndef HOST_SIM_H_
+#define HOST_SIM_H_
+
+#include <stdint.h>
+
+/* the mocks print with the real printf(), see xc.h */
+#undef printf
+int printf(const char *, ...);
+
+#define SIM_TICK_US	100000	/* the firmware's 10Hz timer */
+
+extern uint64_t sim_us;		/* simulated time since reset */
+extern int sim_verbose;
+
+/* what the simulated batteries do */
+double sim_current(int, uint64_t);	/* A */
+double sim_voltage(int, uint64_t);	/* V */
+double sim_temp(int, uint64_t);		/* degC */
+
+/* nvm_host.c */
+void nvm_init(int, int, int);
+void nvm_report(double);
+
+/* can_host.c */
+int can_rx_pending(void);
+void can_peer_tick(void);
+void can_report(double);
+extern int can_sync_interval;	/* s between log syncs, 0: none */
+extern int can_log_interval;	/* log interval to set, 0: default */
+extern uint64_t can_burst_at;	/* when to get the 1s samples, 0: never */
+extern int64_t can_time_at;	/* when the time is on the bus, <0: never */
+extern uint64_t can_reset_at;	/* when to reset the log, 0: never */
+extern int can_mirror;		/* s between second requester syncs */
+
+/* pac_host.c */
+void pac_init(void);
+int i2c_host_pending(void);
+void i2c_host_run(void);
+int pac_alert_pins(void);	/* asserted: 1 Alert1, 2 Alert2 */
+void pac_report(double);
+
+#endif /* HOST_SIM_H_ */
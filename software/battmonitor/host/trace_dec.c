@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * decoder for the firmware trace records (../trace.h): bytes are fed
+ * one at a time; text is copied as is, records are printed with
+ * their format, one per line. With a NULL out, records are only
+ * counted.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "trace.h"
+#include "trace_dec.h"
+
+static const char *trace_fmt[] = {
+#define TRACE_POINT(p, l, f)	f,
+TRACE_POINTS
+#undef TRACE_POINT
+};
+
+static struct {
+	uint8_t state;		/* 0: text, 1: id, 2: args */
+	uint8_t n;
+	uint8_t id;
+	uint8_t got;
+	uint8_t args[TRACE_MAXARGS * 2];
+} dec;
+
+static void
+trace_print(FILE *out)
+{
+	const char *f;
+	uint32_t v;
+	uint8_t a = 0, l;
+
+	if (dec.id >= TR_COUNT) {
+		fprintf(out, "trace: unknown id %d\n", dec.id);
+		return;
+	}
+	for (f = trace_fmt[dec.id]; *f != '\0'; f++) {
+		if (*f != '%' || *++f == '%') {
+			putc(*f, out);
+			continue;
+		}
+		l = (*f == 'l');
+		if (l)
+			f++;
+		if (a + l >= dec.n) {
+			fprintf(out, "<missing>");
+			continue;
+		}
+		v = dec.args[a * 2] | (dec.args[a * 2 + 1] << 8);
+		a++;
+		if (l) {
+			v |= (uint32_t)(dec.args[a * 2] |
+			    (dec.args[a * 2 + 1] << 8)) << 16;
+			a++;
+		}
+		switch (*f) {
+		case 'd':
+			fprintf(out, "%ld",
+			    l ? (long)(int32_t)v : (long)(int16_t)v);
+			break;
+		case 'x':
+			fprintf(out, "%lx", (unsigned long)v);
+			break;
+		default:
+			fprintf(out, "%lu", (unsigned long)v);
+			break;
+		}
+	}
+	putc('\n', out);
+}
+
+/* returns 1 when a record has been decoded */
+int
+trace_dec_byte(FILE *out, uint8_t c)
+{
+	switch (dec.state) {
+	case 0:
+		if ((c & TRACE_MARK_MASK) == TRACE_MARK) {
+			dec.n = c & ~TRACE_MARK_MASK;
+			dec.got = 0;
+			dec.state = 1;
+		} else if (c != '\r' && out != NULL) {
+			putc(c, out);
+		}
+		return 0;
+	case 1:
+		dec.id = c;
+		dec.state = 2;
+		break;
+	case 2:
+		dec.args[dec.got++] = c;
+		break;
+	}
+	if (dec.got < dec.n * 2)
+		return 0;
+	if (out != NULL)
+		trace_print(out);
+	dec.state = 0;
+	return 1;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * xc.h replacement for the host build: the special function registers
+ * used by the firmware are plain variables (sfr.c), which the
+ * simulation (sim.c) reads and updates. Compiler extensions and
+ * instructions are mapped to no-ops or to simulation hooks.
+ */
+
+#ifndef HOST_XC_H_
+#define HOST_XC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* firmware printf() output is counted, and only shown with -v */
+#define printf host_printf
+#include <stdio.h>
+
+typedef uint32_t __uint24;
+typedef int32_t __int24;
+#define __at(a)
+#define __packed __attribute__((__packed__))
+#define __interrupt(...)
+#define asm(x)
+#define di()
+#define ei()
+#define NOP()
+#define CLRWDT()
+#define SLEEP()		host_sleep()
+#define RESET()		host_reset()
+
+void host_sleep(void);
+void host_reset(void);
+
+/* timer0 counts with the simulated time */
+#define TMR0L		host_tmr0l()
+#define TMR0H		host_tmr0h()
+uint8_t host_tmr0l(void);
+uint8_t host_tmr0h(void);
+
+#include "prof_host.h"
+
+#ifdef SFR_DEFINE
+#define SFR(t, n)	volatile t n
+#else
+#define SFR(t, n)	extern volatile t n
+#endif
+
+/* registers used both as a byte and as bits */
+#define SFRU(n, bits)	SFR(union { uint8_t reg; struct { bits } b; }, n##_u)
+
+#define B(n)		unsigned n : 1;
+#define BN(n, w)	unsigned n : w;
+#define PAD(w)		unsigned : w;
+
+SFRU(INTCON0, PAD(5) B(IPEN) B(GIEL) B(GIE));
+#define INTCON0		INTCON0_u.reg
+#define INTCON0bits	INTCON0_u.b
+#define GIEH		GIE
+SFRU(ADCON0, B(GO) PAD(1) B(FM) PAD(1) B(CS) PAD(1) B(CONT) B(ADON));
+#define ADCON0		ADCON0_u.reg
+#define ADCON0bits	ADCON0_u.b
+SFRU(T0CON0, BN(OUTPS, 4) B(MD16) B(OUT) PAD(1) B(T0EN));
+#define T0CON0		T0CON0_u.reg
+#define T0CON0bits	T0CON0_u.b
+SFRU(WDTCON0, B(SEN) BN(PS, 5) PAD(2));
+#define WDTCON0		WDTCON0_u.reg
+#define WDTCON0bits	WDTCON0_u.b
+SFRU(TU16ACON0, PAD(2) B(PRIE) PAD(4) B(ON));
+#define TU16ACON0	TU16ACON0_u.reg
+#define TU16ACON0bits	TU16ACON0_u.b
+SFRU(TU16ACON1, B(PRIF) PAD(2) B(CLR) PAD(4));
+#define TU16ACON1	TU16ACON1_u.reg
+#define TU16ACON1bits	TU16ACON1_u.b
+SFRU(I2C1CON0, PAD(7) B(EN));
+#define I2C1CON0	I2C1CON0_u.reg
+#define I2C1CON0bits	I2C1CON0_u.b
+SFRU(HLVDCON0, B(INTL) B(INTH) PAD(5) B(EN));
+#define HLVDCON0	HLVDCON0_u.reg
+#define HLVDCON0bits	HLVDCON0_u.b
+SFRU(I2C1PIE, PAD(2) B(PCIE) PAD(4) B(CNTIE));
+#define I2C1PIE		I2C1PIE_u.reg
+#define I2C1PIEbits	I2C1PIE_u.b
+SFRU(I2C1ERR, PAD(2) B(NACKIE) PAD(3) B(NACKIF) PAD(1));
+#define I2C1ERR		I2C1ERR_u.reg
+#define I2C1ERRbits	I2C1ERR_u.b
+SFRU(T2CON, PAD(7) B(TMR2ON));
+#define T2CON		T2CON_u.reg
+#define T2CONbits	T2CON_u.b
+
+SFR(struct { B(LATC0) B(LATC1) PAD(1) B(LATC3) B(LATC4) B(LATC5) PAD(1) B(LATC7) }, LATCbits);
+SFR(struct { PAD(2) B(LATB2) PAD(1) B(LATB4) B(LATB5) PAD(2) }, LATBbits);
+SFR(struct { PAD(2) B(RC2) PAD(5) }, PORTCbits);
+SFR(struct { B(RB0) B(RB1) PAD(5) B(RB7) }, PORTBbits);
+SFR(struct { B(TRISC0) B(TRISC1) PAD(1) B(TRISC3) B(TRISC4) B(TRISC5) PAD(1) B(TRISC7) }, TRISCbits);
+SFR(struct { B(TRISB0) B(TRISB1) B(TRISB2) PAD(1) B(TRISB4) B(TRISB5) PAD(2) }, TRISBbits);
+SFR(struct { PAD(3) B(ODCC3) B(ODCC4) PAD(3) }, ODCONCbits);
+SFR(struct { PAD(5) B(IOCIP) B(CANIP) B(TU16AIP) }, IPR0bits);
+SFR(struct { PAD(1) B(TMR2IP) PAD(6) }, IPR3bits);
+SFR(struct { B(U1RXIP) B(U1TXIP) PAD(6) }, IPR4bits);
+SFR(struct { B(I2C1RXIP) B(I2C1TXIP) B(I2C1IP) B(I2C1EIP) PAD(4) }, IPR7bits);
+SFR(struct { PAD(5) B(IOCIE) B(CANIE) B(TU16AIE) }, PIE0bits);
+SFR(struct { B(TMR0IE) B(TMR2IE) PAD(6) }, PIE3bits);
+SFR(struct { B(U1RXIE) B(U1TXIE) PAD(6) }, PIE4bits);
+SFR(struct { B(ADIF) B(ADTIF) PAD(6) }, PIR1bits);
+SFR(struct { B(HLVDIF) PAD(7) }, PIR2bits);
+SFR(struct { B(HLVDIE) PAD(7) }, PIE2bits);
+SFR(struct { B(HLVDIP) PAD(7) }, IPR2bits);
+SFR(struct { B(TMR0IF) B(TMR2IF) PAD(6) }, PIR3bits);
+SFR(struct { B(U1RXIF) B(U1TXIF) PAD(6) }, PIR4bits);
+SFR(struct { PAD(1) B(RXIF) PAD(6) }, C1INTLbits);
+SFR(struct { PAD(3) B(RXOVIF) PAD(4) }, C1INTHbits);
+SFR(struct { PAD(1) B(RXIE) PAD(6) }, C1INTUbits);
+SFR(struct { PAD(3) B(RXOVIF) PAD(4) }, C1FIFOSTA1Lbits);
+
+SFR(uint8_t, PMD0); SFR(uint8_t, PMD1); SFR(uint8_t, PMD2);
+SFR(uint8_t, PMD3); SFR(uint8_t, PMD4); SFR(uint8_t, PMD5);
+SFR(uint8_t, PMD6); SFR(uint8_t, PMD7); SFR(uint8_t, PMD8);
+SFR(uint8_t, ANSELA); SFR(uint8_t, ANSELB); SFR(uint8_t, ANSELC);
+SFR(uint8_t, LATA); SFR(uint8_t, TRISA);
+SFR(uint8_t, CANRXPPS); SFR(uint8_t, RB2PPS);
+SFR(uint8_t, IOCBN); SFR(uint8_t, IOCBF);
+SFR(uint8_t, RC3PPS); SFR(uint8_t, RC4PPS);
+SFR(uint8_t, RC3I2C); SFR(uint8_t, RC4I2C);
+SFR(uint8_t, I2C1SCLPPS); SFR(uint8_t, I2C1SDAPPS);
+SFR(uint8_t, I2C1CON1); SFR(uint8_t, I2C1CON2);
+SFR(uint8_t, I2C1CLK); SFR(uint8_t, I2C1BAUD);
+SFR(uint8_t, WDTCON1); SFR(uint8_t, CPUDOZE);
+SFR(uint8_t, IPR1); SFR(uint8_t, IPR2); SFR(uint8_t, IPR3);
+SFR(uint8_t, IPR4); SFR(uint8_t, IPR5); SFR(uint8_t, IPR6);
+SFR(uint8_t, IPR7); SFR(uint8_t, IPR8); SFR(uint8_t, IPR9);
+SFR(uint8_t, IPR10); SFR(uint8_t, IPR11); SFR(uint8_t, IPR12);
+SFR(uint8_t, IPR13); SFR(uint8_t, IPR14); SFR(uint8_t, IPR15);
+SFR(uint8_t, INTCON1);
+SFR(uint8_t, HLVDCON1);
+SFR(uint8_t, T0CON1);
+SFR(uint8_t, T2CLKCON); SFR(uint8_t, T2PR);
+SFR(uint8_t, TU16AHLT); SFR(uint8_t, TU16APS);
+SFR(uint8_t, TU16APRH); SFR(uint8_t, TU16APRL);
+SFR(uint8_t, TU16ACLK); SFR(uint8_t, TUCHAIN);
+SFR(uint8_t, ADCON1); SFR(uint8_t, ADCON2); SFR(uint8_t, ADCON3);
+SFR(uint8_t, ADCLK); SFR(uint8_t, ADREF); SFR(uint8_t, ADPCH);
+SFR(uint8_t, ADACQH); SFR(uint8_t, ADACQL);
+SFR(uint8_t, ADRESH); SFR(uint8_t, ADRESL);
+SFR(uint8_t, ADRPT); SFR(uint8_t, ADCNT);
+SFR(uint8_t, ADFLTRH); SFR(uint8_t, ADFLTRL);
+SFR(uint8_t, U1RXB); SFR(uint8_t, U1TXB);
+SFR(uint32_t, TBLPTR); SFR(uint8_t, TABLAT);
+
+#endif /* HOST_XC_H_ */
@@ -210,6 +210,194 @@ i2c_writecmd(const uint8_t address, uint8_t reg)
 	return i2c_writereg(address, reg, NULL, 0);
 }                                     
 
+/* queued transfers */
+static struct i2c_xfer *i2c_q[I2C_QUEUE_SIZE];
+static uint8_t i2c_qprod;
+static volatile uint8_t i2c_qcons;
+static uint8_t i2c_idx; /* data bytes transferred */
+static uint8_t i2c_retry;
+static uint8_t i2c_nack;
+static uint8_t i2c_phase;
+#define I2C_P_REG	0 /* sending register address */
+#define I2C_P_DATA	1 /* reading or writing data */
+
+static void
+i2c_intr_disable(void)
+{
+	PIE7bits.I2C1IE = 0;
+	PIE7bits.I2C1EIE = 0;
+	PIE7bits.I2C1RXIE = 0;
+	PIE7bits.I2C1TXIE = 0;
+}
+
+/* start the transfer at head of queue; interrupts are disabled */
+static void
+i2c_start(void)
+{
+	struct i2c_xfer *x = i2c_q[i2c_qcons];
+
+	i2c_idx = 0;
+	i2c_nack = 0;
+	i2c_phase = I2C_P_REG;
+	I2C1STAT1bits.CLRBF = 1;
+	I2C1PIR = 0;
+	I2C1ERRbits.NACKIF = 0;
+	I2C1ADB1 = x->address;
+	I2C1CNTH = 0;
+	I2C1CON1bits.ACKDT = 0;
+	if (x->flags & I2C_XF_READ) {
+		/* send register address, restart when count reaches 0 */
+		I2C1CON0bits.RSEN = 1;
+		I2C1CON1bits.ACKCNT = 0;
+		I2C1CNTL = 1;
+	} else {
+		I2C1CON0bits.RSEN = 0;
+		I2C1CON1bits.ACKCNT = 1;
+		I2C1CNTL = x->size + 1;
+		i2c_phase = I2C_P_DATA;
+		if (x->size != 0)
+			PIE7bits.I2C1TXIE = 1;
+	}
+	I2C1TXB = x->reg;
+	I2C1CON0bits.S = 1;
+}
+
+/* complete the transfer at head of queue, and start the next one */
+static void
+i2c_next(uint8_t status)
+{
+	i2c_q[i2c_qcons]->status = status;
+	i2c_qcons = (i2c_qcons + 1) & I2C_QUEUE_MASK;
+	i2c_retry = 0;
+	if (i2c_qcons != i2c_qprod)
+		i2c_start();
+	else
+		i2c_intr_disable();
+}
+
+char
+i2c_queue(struct i2c_xfer *x)
+{
+	uint8_t next;
+
+	if (x->status == I2C_XS_QUEUED)
+		return 0;
+	di();
+	next = (i2c_qprod + 1) & I2C_QUEUE_MASK;
+	if (next == i2c_qcons) {
+		ei();
+		return 0;
+	}
+	x->status = I2C_XS_QUEUED;
+	i2c_q[i2c_qprod] = x;
+	if (i2c_qprod == i2c_qcons) {
+		/* queue was empty */
+		i2c_qprod = next;
+		i2c_retry = 0;
+		i2c_start();
+		PIE7bits.I2C1IE = 1;
+		PIE7bits.I2C1EIE = 1;
+	} else {
+		i2c_qprod = next;
+	}
+	ei();
+	return 1;
+}
+
+/* give up on queued transfers, e.g. if the bus is stuck */
+void
+i2c_abort(void)
+{
+	di();
+	i2c_intr_disable();
+	while (i2c_qcons != i2c_qprod) {
+		i2c_q[i2c_qcons]->status = I2C_XS_ERROR;
+		i2c_qcons = (i2c_qcons + 1) & I2C_QUEUE_MASK;
+	}
+	/* reset the module */
+	I2C1CON0bits.EN = 0;
+	I2C1CON0bits.EN = 1;
+	ei();
+	printf("i2c abort: ");
+	i2c_status();
+}
+
+void __interrupt(__irq(I2C1), __low_priority, base(IVECT_BASE))
+irqh_i2c1(void)
+{
+	struct i2c_xfer *x = i2c_q[i2c_qcons];
+
+	if (I2C1PIRbits.CNTIF) {
+		I2C1PIRbits.CNTIF = 0;
+		if (i2c_phase == I2C_P_REG && i2c_nack == 0) {
+			/* register address sent: restart and read */
+			i2c_phase = I2C_P_DATA;
+			I2C1CON1bits.ACKCNT = 1;
+			I2C1ADB1 = x->address | 1;
+			I2C1CNTL = x->size;
+			PIE7bits.I2C1RXIE = 1;
+			I2C1CON0bits.S = 1;
+			I2C1CON0bits.RSEN = 0;
+		}
+	}
+	if (I2C1PIRbits.PCIF) {
+		/* stop condition: end of transfer */
+		I2C1PIRbits.PCIF = 0;
+		PIE7bits.I2C1RXIE = 0;
+		PIE7bits.I2C1TXIE = 0;
+		if (i2c_nack) {
+			if (++i2c_retry < 5)
+				i2c_start();
+			else
+				i2c_next(I2C_XS_ERROR);
+		} else if (i2c_idx != x->size) {
+			i2c_next(I2C_XS_ERROR);
+		} else {
+			i2c_next(I2C_XS_DONE);
+		}
+	}
+}
+
+void __interrupt(__irq(I2C1E), __low_priority, base(IVECT_BASE))
+irqh_i2c1e(void)
+{
+	if (I2C1ERRbits.NACKIF) {
+		/* the module sends a stop, we'll retry from there */
+		I2C1ERRbits.NACKIF = 0;
+		i2c_nack = 1;
+	}
+}
+
+void __interrupt(__irq(I2C1RX), __low_priority, base(IVECT_BASE))
+irqh_i2c1rx(void)
+{
+	struct i2c_xfer *x = i2c_q[i2c_qcons];
+
+	if (i2c_idx < x->size) {
+		if (x->flags & I2C_XF_SWAP)
+			x->data[x->size - 1 - i2c_idx] = I2C1RXB;
+		else
+			x->data[i2c_idx] = I2C1RXB;
+		i2c_idx++;
+	} else {
+		(void)I2C1RXB;
+	}
+}
+
+void __interrupt(__irq(I2C1TX), __low_priority, base(IVECT_BASE))
+irqh_i2c1tx(void)
+{
+	struct i2c_xfer *x = i2c_q[i2c_qcons];
+
+	if (x->flags & I2C_XF_SWAP)
+		I2C1TXB = x->data[x->size - 1 - i2c_idx];
+	else
+		I2C1TXB = x->data[i2c_idx];
+	i2c_idx++;
+	if (i2c_idx == x->size)
+		PIE7bits.I2C1TXIE = 0;
+}
+
 static void
 i2c_status(void)
 {
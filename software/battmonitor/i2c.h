@@ -44,10 +44,64 @@
 	I2C1CLK = 3; /* clock = mfintosc  (500khz) */ \
 	I2C1BAUD = 0; /* prescale = 1 */ \
 	I2C1CON0bits.EN = 1; \
+	I2C_INTR_INIT; \
     }
 
+/*
+ * interrupts for queued transfers, low priority. They are enabled
+ * only while the queue is not empty.
+ */
+#define I2C_INTR_INIT { \
+	I2C1PIE = 0; \
+	I2C1PIEbits.CNTIE = 1; /* restart for reads */ \
+	I2C1PIEbits.PCIE = 1; /* stop: end of transfer */ \
+	I2C1ERR = 0; \
+	I2C1ERRbits.NACKIE = 1; \
+	IPR7bits.I2C1IP = 0; \
+	IPR7bits.I2C1EIP = 0; \
+	IPR7bits.I2C1RXIP = 0; \
+	IPR7bits.I2C1TXIP = 0; \
+    }
+
+/*
+ * blocking transfers. They busy-wait on the I2C module, so they can only be
+ * used when no queued transfer is in progress (e.g. at init time).
+ */
 char i2c_readreg(const uint8_t address, uint8_t reg, uint8_t *data, uint8_t size);
 char i2c_readreg_be(const uint8_t address, uint8_t reg, uint8_t *data, uint8_t size);
 char i2c_writereg(const uint8_t address, uint8_t reg, uint8_t *data, uint8_t size);
 char i2c_writereg_be(const uint8_t address, uint8_t reg, uint8_t *data, uint8_t size);
 char i2c_writecmd(const uint8_t address, uint8_t reg);
+
+/*
+ * queued transfers: they run from interrupts, in order. The caller
+ * polls status, and must not touch the descriptor or its data
+ * while it's queued.
+ */
+struct i2c_xfer {
+	uint8_t address;
+	uint8_t reg;
+	uint8_t *data;
+	uint8_t size;
+	uint8_t flags;
+#define I2C_XF_READ	0x01 /* read size bytes, else write */
+#define I2C_XF_SWAP	0x02 /* MSB first (_be functions) */
+	volatile uint8_t status;
+#define I2C_XS_IDLE	0
+#define I2C_XS_QUEUED	1
+#define I2C_XS_DONE	2
+#define I2C_XS_ERROR	3
+};
+
+/*
+ * The busiest 10Hz tick (4 in main.c's sched_tasks[]), with 4 channels
+ * and an alert, queues 15 transfers: 4 VBUS_AVG, ACCCNT, 4 ACCV,
+ * REFRESH_V, ALERT_STATUS and 4 VSENSE. A transfer that doesn't fit
+ * is not queued and its value is lost: check this budget when adding
+ * one.
+ */
+#define I2C_QUEUE_SIZE 16
+#define I2C_QUEUE_MASK 0x0f
+
+char i2c_queue(struct i2c_xfer *);
+void i2c_abort(void);
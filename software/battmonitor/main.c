@@ -36,7 +36,14 @@
 #include "serial.h"
 #include "i2c.h"
 #include "ntc_tab.h"
+#include "ntc_lut.h"
 #include "pac195x.h"
+#include "battlog.h"
+#include "nvm.h"
+#include "alert.h"
+#include "soc.h"
+#include "prof.h"
+#include "trace.h"
 
 unsigned int devid, revid; 
 
@@ -56,14 +63,39 @@ unsigned int timer0_read(void);
 #define LEDBATT_G LATCbits.LATC1
 
 #define NDOWN LATCbits.LATC7
+
+#define HLVD_SEL 0x0d /* power-fail trip point, below the 5V rail */
 #define NCANOK PORTCbits.RC2
+#define ALERT_PINS 0x03 /* RB0: PAC GPIO/Alert2, RB1: PAC Slow/Alert1 */
 
 static char counter_10hz;
-static char counter_1hz;
+#define SCHED_TICKS 10 /* 10Hz ticks, see sched_tasks[] */
+static uint8_t sched_tick; /* tick in the second */
+static uint8_t sched_request; /* PRIVATE_LOG_SCHED received */
+static uint8_t sched_addr; /* from */
+static uint16_t poll_count; /* timer0 at the last nmea2000_poll() */
 static uint16_t seconds;
+
+/*
+ * UTC time (s since 1970), from the NMEA2000 system time or date/time
+ * when some device on the bus sends it. Otherwise the host has to
+ * compute the log entries times from when it gets them.
+ */
+static uint32_t time_now;
+static uint8_t time_valid;
+#define TIME_SLEW	2 /* s; a larger step gets a new time record */
+#ifndef NMEA2000_SYSTEM_TIME
+#define NMEA2000_SYSTEM_TIME	126992UL
+#endif
+#ifndef NMEA2000_DATETIME
+#define NMEA2000_DATETIME	129033UL
+#endif
 static volatile union softintrs {
 	struct softintrs_bits {
 		char int_10hz : 1;	/* 0.1s timer */
+		char int_canrx : 1;	/* CAN frames in can_rxring */
+		char int_pfail : 1;	/* power going down */
+		char int_alert : 1;	/* PAC195x alert pin asserted */
 	} bits;
 	char byte;
 } softintrs;
@@ -79,396 +111,774 @@ uint16_t batt_temp[4];
 static int32_t voltages_acc[4];
 pac_ctrl_t pac_ctrl;
 
-/* for journal */
-static int64_t l600_current_acc[4];
-static __uint24 l600_current_count;
-static uint32_t l600_voltages_acc[4];
+/*
+ * calibration data, in Q20 fixed point.
+ * current: mA per VSENSE LSB (0.75mA), adjusted for each channel.
+ * voltage: 0.01V per VBUS LSB (0.488mV), adjusted by 0.99955132.
+ */
+#define Q20(x)	((int32_t)((x) * 1048576.0 + 0.5))
+static const int32_t pac_cal_i[4] = {
+	Q20(0.75 * 0.988689144013892),
+	Q20(0.75 * 1.00930129713152),
+	Q20(0.75 * 4.06331342566096),
+	Q20(0.75),
+};
+#define PAC_CAL_V Q20(0.048778104)
 
 /*
- * journal data structure (record every 10mn)
- * For current, in mA: 18 bits, including sign
- * voltage, max 20.47V needs 11 bits
- * temperature -40C to 60C: 8 bits (K - 233)
- * valid: 1bit
- * instance: 2 bits
- =>  total 40 bits, or 5 bytes
- 51 entries per block of 256 bytes: 1 bytes free (for block flags)
- In 32k flash, 128 blocks -> 6528 entries, or 272 hours (11 days)
-   with 4 channels active
+ * return acc * cal / (n * 2^20), rounded to nearest.
+ * acc * cal has to fit in 63 bits: with acc up to 2^38 (3600s of
+ * 16 bits samples at 1024Hz) and cal below 2^22 we're fine.
  */
+static int32_t
+pac_scale(int64_t acc, int32_t cal, uint32_t n)
+{
+	int64_t v = acc * cal;
+	int64_t d = (int64_t)n << 20;
 
-union log_entry {
-	uint8_t data[5];
-	struct {
-		uint8_t temp;
-		uint8_t u_low; /* low bits of voltage */
-		uint16_t i_low; /* low bits current */
-		uint8_t u_high : 3; /* high bits of voltage */
-		uint8_t nvalid : 1; /* 0 = entry valid */
-		uint8_t i_high: 2; /* high bits of current */
-		uint8_t instance: 2; /* batt instance */
-	} s;
-};
+	if (v < 0)
+		v -= d / 2;
+	else
+		v += d / 2;
+	return v / d;
+}
 
-#define LOG_ENTRIES 51
+/* for journal, over log_interval */
+static int64_t l600_current_acc[4];
+static __uint24 l600_current_count;
+static uint32_t l600_voltages_acc[4];
+static uint16_t l600_voltages_count;
 
-struct log_block {
-	union log_entry b_entry[LOG_ENTRIES];
-	uint8_t b_flags;
-#define B_FILL_STAT 0x03
-#define B_FILL_FREE 0x03
-#define B_FILL_PART 0x01
-#define B_FILL_FULL 0x00
-#define B_FILL_GEN  0xfc
-};
+/*
+ * min/max of the 1s values over log_interval, in 0.01A/0.01V. Logged
+ * as an envelope only when they are away from the average by more
+ * than LOG_ENV_I (mA) or LOG_ENV_V (0.01V), to keep the log compact.
+ */
+static int16_t env_i_min[4];
+static int16_t env_i_max[4];
+static int16_t env_v_min[4];
+static uint8_t pac_started; /* the first 1s values after reset are partial */
+#define LOG_ENV_I	1000
+#define LOG_ENV_V	10
 
-#define LOG_BLOCKS ((uint8_t)128)
-#define LOG_BLOCKS_MASK (LOG_BLOCKS - 1)
+static void
+env_reset(char c)
+{
+	env_i_min[c] = INT16_MAX;
+	env_i_max[c] = INT16_MIN;
+	env_v_min[c] = INT16_MAX;
+}
 
-extern const struct log_block battlog[LOG_BLOCKS] __at(0x18000);
+/*
+ * seconds between log entries. Kept in RAM only, set back to the default
+ * on reset. With LOG_INTERVAL_MAX the accumulators above can't overflow
+ * (see pac_scale()).
+ */
+#define LOG_INTERVAL_DEFAULT	600
+#define LOG_INTERVAL_MIN	60
+#define LOG_INTERVAL_MAX	3600
+static uint16_t log_interval = LOG_INTERVAL_DEFAULT;
 
-extern struct log_block curlog __at(0x3700);
+/*
+ * 1s samples of the last BURST_SECS seconds, for PRIVATE_LOG_BURST
+ * requests. They are never written to flash.
+ */
+#ifndef BURST_SECS
+#define BURST_SECS 180
+#endif
+static struct burst_sample burst[BURST_SECS][4];
+static uint8_t burst_head; /* slot of the next sample */
+static uint8_t burst_count; /* samples in burst */
+static uint16_t burst_seq; /* sequence number of the next sample */
 
 /* current log entry (to be updated) */
 uint8_t log_cblk;
-uint8_t log_centry;
+uint8_t log_centry; /* offset of the next record in b_data */
 uint8_t log_gen;
+static struct log_last log_last[4]; /* delta encoding state */
 
-/* log requests/replies */
-uint8_t logreq_len;
-uint8_t logreq_id; /* current id for fast frame */
+/*
+ * CAN receive: nmea2000_receive() runs from interrupt, and user_receive()
+ * queues the frames we care about to can_rxring. They are processed
+ * from the main loop. Our transmits and nmea2000_poll() run with the
+ * CAN interrupt disabled, so the stack is not reentered.
+ */
+struct can_rxframe {
+	union nmea2000_id id;
+	uint8_t data[NMEA2000_DATA_LENGTH];
+};
+#define CAN_RXRING_SIZE 16
+#define CAN_RXRING_MASK 0x0f
+static struct can_rxframe can_rxring[CAN_RXRING_SIZE];
+static volatile uint8_t can_rxring_prod;
+static uint8_t can_rxring_cons;
+static volatile uint16_t can_rxring_ovf; /* frames dropped, ring full */
+static volatile uint16_t can_fifo_ovf; /* CAN controller FIFO overflows */
+static volatile uint8_t iso_request_batt; /* pending ISO requests */
+static volatile uint8_t iso_request_dc;
+static volatile uint8_t iso_request_addr;
+
+#define CAN_LOCK()	{ PIE0bits.CANIE = 0; }
+#define CAN_UNLOCK()	{ PIE0bits.CANIE = 1; }
+
+static char
+can_send_single(struct nmea2000_msg *m)
+{
+	char r;
+
+	CAN_LOCK();
+	r = nmea2000_send_single_frame(m);
+	CAN_UNLOCK();
+	return r;
+}
+
+static char
+can_send_fast(struct nmea2000_msg *m, uint8_t id)
+{
+	char r;
+
+	CAN_LOCK();
+	r = nmea2000_send_fast_frame(m, id);
+	CAN_UNLOCK();
+	return r;
+}
 
+/* PRIVATE_LOG replies are built here, one at a time */
 union __packed {
 	uint8_t _data[233 + 8];
-	struct private_log_request rq;
 	struct private_log_reply rp;
 	struct private_log_error er;
-	struct private_log_reset rst;
+	struct private_log_interval iv;
+	struct private_log_burst_reply br;
+	struct private_log_sched_reply sc;
 } private_log_cmd;
 static unsigned char fastid;
 
-static inline void
-utolog(uint16_t u, union log_entry *e)
+/*
+ * New entries are added to curlog, in RAM, and written to flash when
+ * the block is full, every LOG_COMMIT_INTERVAL update_log() periods, or
+ * on a power-fail warning. This saves flash writes, which are slow and
+ * run with interrupts disabled.
+ */
+#ifndef LOG_COMMIT_INTERVAL
+#define LOG_COMMIT_INTERVAL 6 /* 1 hour */
+#endif
+static uint8_t log_dirty; /* curlog has uncommitted entries */
+static uint8_t log_periods; /* update_log() periods since last commit */
+static uint8_t log_need_time; /* time record needed before next entries */
+static uint8_t log_need_bank; /* bank record needed before next entries */
+
+/*
+ * A log reset erases block 0, where the new log starts, and the other
+ * blocks in background, one per main loop iteration; until then they
+ * are seen as free. log_gen is 0 only in the first pass over the
+ * blocks after an erase (it skips 0 when wrapping), so at boot, blocks
+ * in use after the current one with log_gen 0 are from an interrupted
+ * erase, which is resumed.
+ */
+static uint8_t log_erase_next; /* next block to erase, 0: none */
+static const struct log_block log_free = { .b_flags = 0xff };
+
+static void
+log_commit(void)
 {
-	e->s.u_low = u & 0xff;
-	e->s.u_high = (u >> 8) & 0x7;
+	if (log_dirty) {
+		TRACE(log_commit, log_cblk, log_centry);
+		page_write(&battlog[log_cblk]);
+		log_dirty = 0;
+	}
+	log_periods = 0;
 }
 
-static inline uint16_t
-logtou(union log_entry *e)
+/* next generation number; 0 is for the first pass after an erase */
+static void
+log_gen_next(void)
 {
-	uint16_t u;
-
-	u = e->s.u_low;
-	u |= (uint16_t)(e->s.u_high & 0x7) << 8;
-	return u;
+	log_gen += B_GEN_INC;
+	if (log_gen == 0)
+		log_gen = B_GEN_INC;
 }
 
-static inline void
-itolog(int64_t i, union log_entry *e)
+/* switch to next block; the current one has been written */
+static void
+log_next_block(void)
 {
-	e->s.i_low = i & 0xffff;
-	e->s.i_high = (i >> 16) & 0x3;
+	/* point to next block */
+	log_cblk = (log_cblk + 1) & LOG_BLOCKS_MASK;
+	log_centry = 0;
+	if (log_cblk == 0) /* rollover; update gen number */
+		log_gen_next();
+	/* erase and load new block */
+	if (log_cblk == log_erase_next)
+		log_erase_next = (log_erase_next + 1) & LOG_BLOCKS_MASK;
+	page_erase(&battlog[log_cblk]);
+	page_read(&battlog[log_cblk]);
+	/* the first record of each instance will be a base */
+	memset(log_last, 0, sizeof(log_last));
+	log_need_time = 1;
+	log_need_bank = 1;
 }
 
-static inline int32_t
-logtoi(union log_entry *e)
+/* write current block, and go to the next one */
+static void
+log_close(void)
 {
-	int32_t i;
-	i = e->s.i_low;
-	i |= (uint32_t)(e->s.i_high & 0x3) << 16;
-	if (e->s.i_high & 0x2) {
-		i |= 0xfffe0000;
-	}
-	return i;
+	curlog.b_flags &= ~B_FILL_STAT;
+	log_commit();
+	log_next_block();
 }
 
+/* append the n bytes of records rec to curlog; they have to fit */
 static void
-page_erase(__uint24 addr)
+log_put(const uint8_t *rec, uint8_t n)
 {
-	uint8_t err = 0;
-
-	printf("erase 0x%lx\n", (uint32_t)addr);
-
-	NVMADR = addr;
-	NVMCON1bits.CMD = 0x06;
-	INTCON0bits.GIE = 0;
-
-	NVMLOCK = 0x55;
-	NVMLOCK = 0xAA;
-	NVMCON0bits.GO = 1;
-
-	while (NVMCON0bits.GO)
-		; /* wait */
+	uint8_t i;
 
-	if (NVMCON1bits.WRERR) {
-		err++;
-	}
-	NVMCON1bits.CMD = 0;
-	INTCON0bits.GIE = 1;
-	if (err) {
-		printf("erase 0x%lx failed\n", (uint32_t)addr);
-	}
+	for (i = 0; i < n; i++)
+		curlog.b_data[log_centry++] = rec[i];
+	curlog.b_fmt = B_FMT_DELTA;
+	curlog.b_flags = log_gen | B_FILL_PART;
+	log_dirty = 1;
+	if (log_centry == LOG_RDATA)
+		log_close();
 }
 
+/* add a bank record, if our instances are not the default ones */
 static void
-page_read(__uint24 addr)
+log_add_bank(void)
 {
-	uint8_t err = 0;
+	uint8_t rec[LR_BANKLEN];
 
-	printf("read 0x%lx\n", (uint32_t)addr);
-
-	NVMADR = addr;
-	NVMCON1bits.CMD = 0x02;
-	NVMCON0bits.GO = 1;
+	log_need_bank = 0;
+	if (BATT_INST_BASE == 0)
+		return;
+	log_bank_encode(BATT_INST_BASE, rec);
+	if (LR_BANKLEN > LOG_RDATA - log_centry) {
+		/* only at boot: otherwise it starts the block */
+		log_close();
+		log_need_bank = 0;
+	}
+	log_put(rec, LR_BANKLEN);
+}
 
-	while (NVMCON0bits.GO)
-		; /* wait */
+/* encode entry e and its envelope env (if not NULL) to rec */
+static uint8_t
+log_encode(const union log_entry *e, const struct log_env *env, uint8_t *rec)
+{
+	uint8_t n;
 
-	NVMCON1bits.CMD = 0;
+	n = log_rec_encode(log_last, e, rec);
+	if (env != NULL)
+		n += log_env_encode(log_last, env, &rec[n]);
+	return n;
 }
 
+/*
+ * add entry e (a boot marker if NULL) to the log, followed by its
+ * envelope if env is not NULL. Both go to the same block.
+ */
 static void
-page_write(__uint24 addr)
+log_add(const union log_entry *e, const struct log_env *env)
 {
-	uint8_t err = 0;
-
-	printf("write 0x%lx\n", (uint32_t)addr);
-
-	NVMADR = addr;
-	NVMCON1bits.CMD = 0x05;
-	INTCON0bits.GIE = 0;
-
-	NVMLOCK = 0x55;
-	NVMLOCK = 0xAA;
-	NVMCON0bits.GO = 1;
-
-	while (NVMCON0bits.GO)
-		; /* wait */
-
-	if (NVMCON1bits.WRERR) {
-		err++;
-	}
-	NVMCON1bits.CMD = 0;
-	INTCON0bits.GIE = 1;
-	if (err) {
-		printf("write 0x%lx failed\n", (uint32_t)addr);
+	uint8_t rec[LR_MAXLEN + LR_ENVLEN];
+	uint8_t n;
+
+	if (log_need_bank)
+		log_add_bank();
+	n = log_encode(e, env, rec);
+	if (n > LOG_RDATA - log_centry) {
+		/* doesn't fit; start a new block, with new bases */
+		log_close();
+		log_add_bank();
+		n = log_encode(e, env, rec);
 	}
+	TRACE(log_new, log_cblk, log_centry, n);
+	log_put(rec, n);
 }
 
+/* add a time record: the next entries are from now */
 static void
-next_log_entry(void)
+log_add_time(void)
 {
-	printf("write log entry %d/%d\n", log_cblk, log_centry);
-	/* mark entry as valid */
-	curlog.b_entry[log_centry].s.nvalid = 0;
-	curlog.b_flags = log_gen | B_FILL_PART;
-	log_centry++;
-	if (log_centry == LOG_ENTRIES) {
-		/* next block */
-		/* write current block */
-		curlog.b_flags = log_gen | B_FILL_FULL;
-		page_write(&battlog[log_cblk]);
-		/* point to next block */
-		log_cblk = (log_cblk + 1) & LOG_BLOCKS_MASK;
-		log_centry = 0;
-		if (log_cblk == 0) /* rollover; update gen number */
-			log_gen += 0x4;
-		/* erase and load new block */
-		page_erase(&battlog[log_cblk]);
-		page_read(&battlog[log_cblk]);
-	} else {
-		/* update current block */
-		page_write(&battlog[log_cblk]);
-	}
+	struct log_time tm;
+	uint8_t rec[LR_TIMELEN];
+
+	tm.time = time_now;
+	tm.interval = log_interval;
+	log_time_encode(&tm, rec);
+	if (LR_TIMELEN > LOG_RDATA - log_centry)
+		log_close();
+	TRACE(log_time, log_cblk, log_centry, TRACE_L(time_now));
+	log_put(rec, LR_TIMELEN);
+	log_need_time = 0;
+}
+
+/* the current block, either in RAM or in flash */
+static const struct log_block *
+log_block(uint8_t page)
+{
+	if (page == log_cblk)
+		return &curlog;
+	if (log_erase_next != 0 && page >= log_erase_next)
+		return &log_free; /* not erased yet */
+	return &battlog[page];
 }
 
+/* length of the record at offset c in block b, 0 if there's none */
+static uint8_t
+log_block_rec_len(const struct log_block *b, uint8_t c)
+{
+	if (LOG_IS_DELTA(b))
+		return log_rec_len(&b->b_data[c], LOG_RDATA - c);
+	/* old format, fixed-size entries */
+	if (c == LOG_DATA ||
+	    b->b_entry[c / sizeof(union log_entry)].s.nvalid == 1)
+		return 0;
+	return sizeof(union log_entry);
+}
+
+/* start a new log in block 0; log_erase_step() erases the others */
 static void
 log_erase(void)
 {
-	for (uint8_t c = 0; c < LOG_BLOCKS; c++) {
-		page_erase(&battlog[c]);
-	}
 	log_cblk = log_centry = log_gen = 0;
+	page_erase(&battlog[log_cblk]);
+	page_read(&battlog[log_cblk]);
+	memset(log_last, 0, sizeof(log_last));
+	log_dirty = 0;
+	log_erase_next = 1;
+	log_need_bank = 1;
+	/* commit a mark now: block 0 has to be found at boot */
+	log_add(NULL, NULL);
+	log_commit();
+	log_need_time = 1;
+}
+
+/* erase the next block of a log reset, if not blank already */
+static void
+log_erase_step(void)
+{
+	const struct log_block *b = &battlog[log_erase_next];
+
+	if (b->b_flags != 0xff)
+		page_erase(b);
+	log_erase_next = (log_erase_next + 1) & LOG_BLOCKS_MASK;
 }
 
 static void
 update_log(void)
 {
 	char c;
-	double v;
-	int32_t v_i;
+	int32_t v_i, v_u;
+	union log_entry e;
+	struct log_env env;
 
+	if (time_valid && log_need_time)
+		log_add_time();
 	for (c = 0; c < 4; c++) {
-		printf("log entry %d/%d ", log_cblk, log_centry);
 		if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) != 0)
 			continue;
-		/* batt_i = acc_value * 0.00075 * 1000 */
-		v = (double)l600_current_acc[c] * 0.75 / l600_current_count;
-		/* adjust with calibration data */
-		switch(c) {
-		case 0:
-			v = v * 0.988689144013892;
-			break;
-		case 1:
-			v = v * 1.00930129713152;
-			break;
-		case 2:
-			v = v * 4.06331342566096;
-			break;
-		}
-		v_i = v + 0.5;
-		printf(" %d %4.4fA %ld", c, v / 1000, v_i);
-		itolog(v_i, &curlog.b_entry[log_centry]);
-		/* volt = vbus * 0.000488 */
-		/* batt_v = voltages_acc * 0.000488 * 100 / 6000; */
-		/* adjust by 0.99955132 from calibration data */
-		v = (double)l600_voltages_acc[c] * 0.000008129684;
-		v_i = v + 0.5;
-		printf(" %4.3fV %ld", v / 100, v_i);
-		utolog(v_i, &curlog.b_entry[log_centry]);
-		curlog.b_entry[log_centry].s.instance = c;
+		/* current in mA */
+		v_i = pac_scale(l600_current_acc[c], pac_cal_i[c],
+		    l600_current_count);
+		itolog(v_i, &e);
+		/* voltage in 0.01V, averaged over 600s of 10Hz samples */
+		v_u = pac_scale(l600_voltages_acc[c], PAC_CAL_V,
+		    l600_voltages_count);
+		utolog(v_u, &e);
+		TRACE(log_entry, log_cblk, log_centry, c, TRACE_L(v_i), v_u);
+		e.s.instance = c;
 		if (batt_temp[c] == 0xffff) {
-			curlog.b_entry[log_centry].s.temp = 0xff;
+			e.s.temp = 0xff;
+		} else {
+			e.s.temp = (uint8_t)((batt_temp[c] - 23300) / 100);
+		}
+		env.instance = c;
+		env.i_min = (int32_t)env_i_min[c] * 10;
+		env.i_max = (int32_t)env_i_max[c] * 10;
+		env.u_min = env_v_min[c];
+		if (env_i_min[c] <= env_i_max[c] &&
+		    (env.i_max - v_i > LOG_ENV_I ||
+		     v_i - env.i_min > LOG_ENV_I ||
+		     v_u - env_v_min[c] > LOG_ENV_V)) {
+			TRACE(log_env, c, TRACE_L(env.i_min),
+			    TRACE_L(env.i_max), env_v_min[c]);
+			log_add(&e, &env);
 		} else {
-			curlog.b_entry[log_centry].s.temp =
-			    (uint8_t)((batt_temp[c] - 23300) / 100);
+			log_add(&e, NULL);
 		}
-		next_log_entry();
 		l600_current_acc[c] = 0;
 		l600_voltages_acc[c] = 0;
+		env_reset(c);
 	}
 	l600_current_count = 0;
+	l600_voltages_count = 0;
+	if (++log_periods >= LOG_COMMIT_INTERVAL)
+		log_commit();
 }
 
+/*
+ * log block transmission: send_log_block() only records the request,
+ * log_tx_step() sends one fast packet each time it's called from the
+ * main loop. A new request replaces the one in progress (of the same
+ * requester, see below).
+ */
+struct log_tx {
+	uint8_t active;
+	uint8_t burst; /* sending burst samples, not a page */
+	uint8_t sid;
+	uint8_t page;
+	uint8_t entry; /* offset of the next record to send */
+	uint16_t seq; /* next burst sample to send */
+	uint8_t retry;
+};
+#define LOG_TX_RETRY 16
+
+/*
+ * PRIVATE_LOG requests are handled per source address: each requester
+ * has a session, with its own fast packet reassembly and transmission,
+ * so that several peers can sync the log at the same time. The main
+ * loop sends for the active sessions in turn. When all sessions are
+ * in use, a new requester takes over the least recently used one.
+ */
+#define LOG_SESSIONS 3
+#ifndef NMEA2000_ADDR_GLOBAL
+#define NMEA2000_ADDR_GLOBAL 255
+#endif
+#define LOG_SESSION_FREE NMEA2000_ADDR_GLOBAL /* never a source */
+static struct log_session {
+	uint8_t addr; /* of the requester */
+	uint8_t rx_id; /* fast packet id of the request */
+	uint8_t rx_len; /* request bytes still to come */
+	uint16_t lru; /* log_session_lru when last used */
+	union __packed {
+		uint8_t _data[8];
+		struct private_log_request rq;
+		struct private_log_reset rst;
+		struct private_log_interval iv;
+	} req;
+	struct log_tx tx;
+} log_sessions[LOG_SESSIONS];
+static uint16_t log_session_lru;
+static uint8_t log_session_next; /* next one to send for */
+
 static void
-send_log_block(uint8_t sid, uint8_t page)
+log_tx_cancel(struct log_session *s)
 {
-	uint8_t c, i, j, r = 0;
+	if (s->tx.active) {
+		TRACE(log_cancel, s->tx.page, s->tx.sid);
+		s->tx.active = 0;
+	}
+}
 
-	printf("send page %d\n", page);
+static void
+send_log_block(struct log_session *s, uint8_t sid, uint8_t page)
+{
+	TRACE(log_page, page);
+	log_tx_cancel(s);
+	s->tx.sid = sid;
+	s->tx.page = page;
+	s->tx.entry = 0;
+	s->tx.burst = 0;
+	s->tx.retry = 0;
+	s->tx.active = 1;
+}
 
-	c = 0;
-	while (c < LOG_ENTRIES && r == 0) {
-		fastid = (fastid + 1) & 0x7;
-		msg.id.id = 0;
-		msg.id.iso_pg = (PRIVATE_LOG >> 8) & 0xff;
-		msg.id.daddr = rid.saddr;
-		msg.id.priority = NMEA2000_PRIORITY_ACK;
-		msg.dlc = sizeof(struct private_log_reply);
-		private_log_cmd.rp.cmd = PRIVATE_LOG_REPLY;
-		msg.data = &private_log_cmd.rp;
-		private_log_cmd.rp.sid = sid;
-		private_log_cmd.rp.idx =
-		   ((uint16_t)(battlog[page].b_flags & B_FILL_GEN) << 8) | page;
-		for (i = 0; c < LOG_ENTRIES; c++) {
-			if (battlog[page].b_entry[c].s.nvalid == 1) {
-				printf("page %d entry %d !valid\n", page, c);
-				private_log_cmd.rp.idx |= 0x100;
-				r++;
-				break;
-			}
-			for (j = 0; j < sizeof(union log_entry); j++) {
-				private_log_cmd.rp.data[i] =
-				    battlog[page].b_entry[c].data[j];
-				i++; msg.dlc++;
-			}
-			if (msg.dlc >= (NMEA2000_DATA_FASTLENGTH - sizeof(union log_entry))) {
-				c++;
-				break;
+static void
+send_burst(struct log_session *s, uint8_t sid)
+{
+	TRACE(log_burst, burst_count);
+	log_tx_cancel(s);
+	s->tx.sid = sid;
+	s->tx.seq = burst_seq - burst_count;
+	s->tx.burst = 1;
+	s->tx.retry = 0;
+	s->tx.active = 1;
+}
+
+/* record the 1s values of batt_i and batt_v */
+static void
+burst_record(void)
+{
+	char c;
+
+	for (c = 0; c < 4; c++) {
+		burst[burst_head][c].current = batt_i[c];
+		burst[burst_head][c].voltage = batt_v[c];
+	}
+	if (++burst_head == BURST_SECS)
+		burst_head = 0;
+	if (burst_count < BURST_SECS)
+		burst_count++;
+	burst_seq++;
+}
+
+static void
+burst_tx_step(struct log_session *s)
+{
+	uint8_t c, i, chans, slot;
+	uint16_t oldest;
+
+	fastid = (fastid + 1) & 0x7;
+	msg.id.id = 0;
+	msg.id.iso_pg = (PRIVATE_LOG >> 8) & 0xff;
+	msg.id.daddr = s->addr;
+	msg.id.priority = NMEA2000_PRIORITY_ACK;
+	msg.dlc = sizeof(struct private_log_burst_reply);
+	msg.data = &private_log_cmd.br;
+	private_log_cmd.br.cmd = PRIVATE_LOG_BURST_REPLY;
+	private_log_cmd.br.sid = s->tx.sid;
+	/* samples may have been overwritten since the last packet */
+	oldest = burst_seq - burst_count;
+	if ((int16_t)(s->tx.seq - oldest) < 0)
+		s->tx.seq = oldest;
+	private_log_cmd.br.seq = s->tx.seq;
+	chans = 0;
+	for (c = 0; c < 4; c++) {
+		if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) == 0)
+			chans |= (1 << c);
+	}
+	slot = (burst_head + BURST_SECS - (uint8_t)(burst_seq - s->tx.seq)) %
+	    BURST_SECS;
+	i = 0;
+	while (s->tx.seq != burst_seq &&
+	    msg.dlc + 4 * sizeof(struct burst_sample) <=
+	    NMEA2000_DATA_FASTLENGTH) {
+		for (c = 0; c < 4; c++) {
+			if (chans & (1 << c)) {
+				private_log_cmd.br.data[i] = burst[slot][c];
+				i++;
+				msg.dlc += sizeof(struct burst_sample);
 			}
 		}
-		if (c == LOG_ENTRIES)
+		if (++slot == BURST_SECS)
+			slot = 0;
+		s->tx.seq++;
+	}
+	if (s->tx.seq == burst_seq)
+		chans |= BURST_LAST;
+	private_log_cmd.br.chans = chans;
+	if (! can_send_fast(&msg, fastid)) {
+		printf("send PRIVATE_LOG_BURST_REPLY failed\n");
+		if (++s->tx.retry < LOG_TX_RETRY) {
+			/* send the same samples again */
+			s->tx.seq = private_log_cmd.br.seq;
+			return;
+		}
+		log_tx_cancel(s);
+		return;
+	}
+	s->tx.retry = 0;
+	if (chans & BURST_LAST)
+		s->tx.active = 0;
+}
+
+/* set (if not 0) and reply with the log interval */
+static void
+log_set_interval(struct log_session *s, uint16_t interval)
+{
+	if (interval != 0 && interval != log_interval) {
+		if (interval < LOG_INTERVAL_MIN ||
+		    interval > LOG_INTERVAL_MAX) {
+			printf("bad log interval %u\n", interval);
+		} else {
+			printf("log interval %u\n", interval);
+			/*
+			 * log what we have (with its own time, it's not
+			 * a full interval), then a boundary so that the
+			 * times of older entries are not computed
+			 * from the new interval.
+			 */
+			log_need_time = 1;
+			if (l600_voltages_count != 0)
+				update_log();
+			log_add(NULL, NULL);
+			log_need_time = 1;
+			log_interval = interval;
+			seconds = 0;
+		}
+	}
+	fastid = (fastid + 1) & 0x7;
+	msg.id.id = 0;
+	msg.id.iso_pg = (PRIVATE_LOG >> 8) & 0xff;
+	msg.id.daddr = s->addr;
+	msg.id.priority = NMEA2000_PRIORITY_ACK;
+	msg.dlc = sizeof(struct private_log_interval);
+	msg.data = &private_log_cmd.iv;
+	private_log_cmd.iv.cmd = PRIVATE_LOG_INTERVAL_REPLY;
+	private_log_cmd.iv.interval = log_interval;
+	private_log_cmd.iv.inst_base = BATT_INST_BASE;
+	if (! can_send_fast(&msg, fastid))
+		printf("send PRIVATE_LOG_INTERVAL_REPLY failed\n");
+}
+
+static void
+log_tx_step(struct log_session *s)
+{
+	uint8_t c, i, j, n, r = 0;
+	uint8_t page = s->tx.page;
+	const struct log_block *b = log_block(page);
+
+	if (nmea2000_status != NMEA2000_S_OK) {
+		log_tx_cancel(s);
+		return;
+	}
+	if (s->tx.burst) {
+		burst_tx_step(s);
+		return;
+	}
+
+	c = s->tx.entry;
+	fastid = (fastid + 1) & 0x7;
+	msg.id.id = 0;
+	msg.id.iso_pg = (PRIVATE_LOG >> 8) & 0xff;
+	msg.id.daddr = s->addr;
+	msg.id.priority = NMEA2000_PRIORITY_ACK;
+	msg.dlc = sizeof(struct private_log_reply);
+	private_log_cmd.rp.cmd = PRIVATE_LOG_REPLY;
+	msg.data = &private_log_cmd.rp;
+	private_log_cmd.rp.sid = s->tx.sid;
+	private_log_cmd.rp.idx =
+	   ((uint16_t)(b->b_flags & B_FILL_GEN) << 8) | page;
+	i = 0;
+	if (LOG_IS_DELTA(b)) {
+		/* the peer decodes deltas from the start of the page */
+		private_log_cmd.rp.idx |= LOG_IDX_DELTA;
+		private_log_cmd.rp.data[i] = c;
+		i++; msg.dlc++;
+	}
+	for (;;) {
+		n = log_block_rec_len(b, c);
+		if (n == 0) {
+			/* end of page */
 			private_log_cmd.rp.idx |= 0x100;
-		printf("send fast len %d/%d, %d entries\n",
-		    msg.dlc, i, c);
-		if (! nmea2000_send_fast_frame(&msg, fastid))
-			printf("send PRIVATE_LOG_REPLY failed\n");
+			r++;
+			break;
+		}
+		if (msg.dlc + n > NMEA2000_DATA_FASTLENGTH)
+			break;
+		for (j = 0; j < n; j++) {
+			private_log_cmd.rp.data[i] = b->b_data[c];
+			i++; c++; msg.dlc++;
+		}
+	}
+	TRACE(log_fast, msg.dlc, i, c);
+	if (! can_send_fast(&msg, fastid)) {
+		printf("send PRIVATE_LOG_REPLY failed\n");
+		if (++s->tx.retry < LOG_TX_RETRY)
+			return; /* try again on next call */
+		log_tx_cancel(s);
+		return;
 	}
+	s->tx.retry = 0;
+	s->tx.entry = c;
+	if (r != 0)
+		s->tx.active = 0;
+}
+
+/* one step of the next session with a transmission, 0 if none */
+static char
+log_tx_run(void)
+{
+	uint8_t i;
+	struct log_session *s;
+
+	for (i = 0; i < LOG_SESSIONS; i++) {
+		s = &log_sessions[log_session_next];
+		if (++log_session_next == LOG_SESSIONS)
+			log_session_next = 0;
+		if (s->tx.active) {
+			PROF_ENTER(log_tx);
+			log_tx_step(s);
+			PROF_EXIT(log_tx);
+			return 1;
+		}
+	}
+	return 0;
 }
 
 static void
-send_log_error(uint8_t sid, uint8_t code)
+send_log_error(struct log_session *s, uint8_t sid, uint8_t code)
 {
+	log_tx_cancel(s);
 	fastid = (fastid + 1) & 0x7;
 	msg.id.id = 0;
 	msg.id.iso_pg = (PRIVATE_LOG >> 8) & 0xff;
-	msg.id.daddr = rid.saddr;
+	msg.id.daddr = s->addr;
 	msg.id.priority = NMEA2000_PRIORITY_ACK;
 	msg.dlc = sizeof(struct private_log_error);
 	msg.data = &private_log_cmd.er;
 	private_log_cmd.er.cmd = PRIVATE_LOG_ERROR;
 	private_log_cmd.er.sid = sid;
 	private_log_cmd.er.error = code;
-	if (! nmea2000_send_fast_frame(&msg, fastid))
+	if (! can_send_fast(&msg, fastid))
 		printf("send PRIVATE_LOG_ERROR failed\n");
 }
 
 static void
-handle_log_request(uint8_t cmd) {
-	uint8_t gen = (private_log_cmd.rq.idx & 0xff00) >> 8;
-	uint8_t page = private_log_cmd.rq.idx & 0xff;
-	uint8_t sid = private_log_cmd.rq.sid;
+handle_log_request(struct log_session *s, uint8_t cmd) {
+	uint8_t gen = (s->req.rq.idx & 0xff00) >> 8;
+	uint8_t page = s->req.rq.idx & LOG_BLOCKS_MASK;
+	uint8_t sid = s->req.rq.sid;
 	uint8_t i;
-	printf("log request sid %d gen %d page %d\n", sid, gen, page);
+	TRACE(log_request, sid, gen, page);
 
 	if (cmd == PRIVATE_LOG_REQUEST_FIRST) {
 		/* look for first log entry - usually next page */
 		for (i = 0, page = (log_cblk + 1) & LOG_BLOCKS_MASK;
 		    i < LOG_BLOCKS; 
 		     page = (page + 1) & LOG_BLOCKS_MASK, i++) {
-			if ((battlog[page].b_flags & B_FILL_STAT) !=
+			if ((log_block(page)->b_flags & B_FILL_STAT) !=
 			    B_FILL_FREE)
 				break;
 		}
 		if (i == LOG_BLOCKS) {
 			/* all entries free (e.g. just after a reset) */
-			send_log_error(sid, PRIVATE_LOG_ERROR_NOTFOUND);
+			send_log_error(s, sid, PRIVATE_LOG_ERROR_NOTFOUND);
 			return;
 		}
-		send_log_block(sid, page);
+		send_log_block(s, sid, page);
 		return;
 	}
 	/* look for gen/page */
-	if ((battlog[page].b_flags & B_FILL_GEN) != gen ||
-	    (battlog[page].b_flags & B_FILL_STAT) == B_FILL_FREE) {
-		send_log_error(sid, PRIVATE_LOG_ERROR_NOTFOUND);
+	if ((log_block(page)->b_flags & B_FILL_GEN) != gen ||
+	    (log_block(page)->b_flags & B_FILL_STAT) == B_FILL_FREE) {
+		send_log_error(s, sid, PRIVATE_LOG_ERROR_NOTFOUND);
 		return;
 	}
 	if (cmd == PRIVATE_LOG_REQUEST) {
 		/* just send this page */
-		send_log_block(sid, page);
+		send_log_block(s, sid, page);
 		return;
 	}
 	/* send next page, if there is one */
 	if (page == log_cblk) {
 		/* this is the last page */
-		send_log_error(sid, PRIVATE_LOG_ERROR_LAST);
+		send_log_error(s, sid, PRIVATE_LOG_ERROR_LAST);
 		return;
 	}
 	page = (page + 1) & LOG_BLOCKS_MASK;
-	if ((battlog[page].b_flags & B_FILL_STAT) == B_FILL_FREE) {
+	if ((log_block(page)->b_flags & B_FILL_STAT) == B_FILL_FREE) {
 		/* next page is free, assume previous was the last */
-		send_log_error(sid, PRIVATE_LOG_ERROR_LAST);
+		send_log_error(s, sid, PRIVATE_LOG_ERROR_LAST);
 		return;
 	}
-	send_log_block(sid, page);
+	send_log_block(s, sid, page);
 }
 
+/* a2d_acc is the oversampled NTC reading, see ntc_tab.h */
 static void
 adctotemp(unsigned char c)
 {
-	char i;
-	for (i = 1; temps[i].val != 0; i++) {
-		if (a2d_acc > temps[i].val) {
-			batt_temp[c] = temps[i - 1].temp -
-			((temps[i - 1].temp - temps[i].temp)  /
-		         (temps[i - 1].val - temps[i].val)  * 
-			 (temps[i - 1].val - a2d_acc));
-			return;
-		}
-	} 
-	batt_temp[c] = 0xffff;
+	const struct ntc_lut *l;
+
+	if (a2d_acc < NTC_LUT_MIN || a2d_acc > NTC_LUT_MAX) {
+		batt_temp[c] = 0xffff;
+		return;
+	}
+	l = &ntc_lut[a2d_acc >> NTC_LUT_SHIFT];
+	batt_temp[c] = l->temp + (((uint16_t)l->slope *
+	    (a2d_acc & ((1 << NTC_LUT_SHIFT) - 1))) >> NTC_LUT_SHIFT);
 }
 
 static void
@@ -490,60 +900,39 @@ send_batt_status(char c)
 	data->current = batt_i[c];
 	data->temp = batt_temp[c];
 	data->sid = sid;
-	data->instance = c;
-	if (! nmea2000_send_single_frame(&msg))
+	data->instance = BATT_INST_BASE + c;
+	if (! can_send_single(&msg))
 		printf("send NMEA2000_BATTERY_STATUS failed\n");
 }
 
-#if 0
-
+/* DC detailed status, with the state of charge of battery c */
 static void
-send_dc_status(void)
+send_dc_status(char c)
 {
 	struct nmea2000_dc_status_data *data = (void *)&nmea2000_data[0];
-	static unsigned char fastid;
 
-	if (input_volt == 0xffff)
+	if (nmea2000_status != NMEA2000_S_OK)
+		return;
+	if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) != 0 || !soc_enabled(c))
 		return;
 
 	fastid = (fastid + 1) & 0x7;
-	printf("power voltage %d.%03dV\n",
-	    (int)(input_volt / 1000), (int)(input_volt % 1000));
-
 	PGN2ID(NMEA2000_DC_STATUS, msg.id);
 	msg.id.priority = NMEA2000_PRIORITY_INFO;
 	msg.dlc = sizeof(struct nmea2000_dc_status_data);
 	msg.data = &nmea2000_data[0];
 	data->sid = sid;
-	data->instance = 0;
-	switch(power_status) {
-	case UNKOWN:
-		return;
-	case OFF:
-		data->type = DCSTAT_TYPE_BATT;
-		if (batt_v > 1240) {
-			data->soc = 100 - ((unsigned long)time_on_batt * 100UL / 7200UL);
-		} else {
-			data->soc = 50 - (1240 - batt_v) * 50 / (1240 - 1100);
-		}
-		data->soh = 0xff;
-		data->timeremain = 0xffff; /* XXX compute */
-		data->ripple = 0xffff;
-		break;
-	default:
-		/* assume operating on mains power */
-		data->type = DCSTAT_TYPE_CONV;
-		data->soc = 0xff;
-		data->soh =
-		    ((unsigned long)input_volt * 100UL + 6000UL) / 12000;
-		data->timeremain = 0xffff;
-		data->ripple = 0xffff;
-		break;
-	}
-	if (! nmea2000_send_fast_frame(&msg, fastid))
+	data->instance = BATT_INST_BASE + c;
+	data->type = DCSTAT_TYPE_BATT;
+	data->soc = soc_get(c);
+	data->soh = 0xff;
+	data->timeremain = soc_time_remain(c);
+	data->ripple = 0xffff;
+	if (! can_send_fast(&msg, fastid))
 		printf("send NMEA2000_DC_STATUS failed\n");
 }
 
+#if 0
 static void
 send_charger_status()
 {
@@ -560,26 +949,27 @@ send_charger_status()
 	data->enable = 1;
 	data->eq_pending = 0;
 	data->eq_time_remain = 0;
-	if (! nmea2000_send_single_frame(&msg))
+	if (! can_send_single(&msg))
 		printf("send NMEA2000_CHARGER_STATUS failed\n");
 }
 #endif
 
+/* called from interrupt, see can_rxring */
 void
 user_handle_iso_request(unsigned long pgn)
 {
-	printf("ISO_REQUEST for %ld from %d\n", pgn, rid.saddr);
 	switch(pgn) {
 	case NMEA2000_BATTERY_STATUS:
-		for (char c = 0; c < 4; c++) {
-			if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) == 0)
-				send_batt_status(c);
-		}
+		iso_request_addr = rid.saddr;
+		iso_request_batt = 1;
+		softintrs.bits.int_canrx = 1;
 		break;
-#if 0
 	case NMEA2000_DC_STATUS:
-		send_dc_status();
+		iso_request_addr = rid.saddr;
+		iso_request_dc = 1;
+		softintrs.bits.int_canrx = 1;
 		break;
+#if 0
 	case NMEA2000_CHARGER_STATUS:
 		send_charger_status();
 		break;
@@ -587,70 +977,223 @@ user_handle_iso_request(unsigned long pgn)
 	}
 }
 
+/* called from interrupt, see can_rxring */
 void
 user_receive()
 {
 	unsigned long pgn;
+	uint8_t next;
 
 	pgn = ((unsigned long)rid.page << 16) | ((unsigned long)rid.iso_pg << 8);
 	if (rid.iso_pg > 239)
 		pgn |= rid.daddr;
 
 	switch(pgn) {
+	case NMEA2000_SYSTEM_TIME:
+	case NMEA2000_DATETIME:
 	case PRIVATE_LOG:
-	    {
-		unsigned char idx = (rdata[0] & FASTPACKET_IDX_MASK);
-		unsigned char id =  (rdata[0] & FASTPACKET_ID_MASK);
-		char i, j;
-
-		if (idx == 0) {
-			/* new head packet */
-			logreq_id = id;
-			logreq_len = rdata[1];
-			for (i = 0; i < 6 && logreq_len > 0; i++) {  
-				private_log_cmd._data[i] = rdata[i+2];
-				logreq_len--;
-			}       
-		} else if (id == logreq_id) {
-			j = 1;
-			/* i = 6 + (idx - 1) * 7 : i = idx * 7 - 1 */   
-			for (i = idx * 7 - 1, j = 1;
-			    i < sizeof(private_log_cmd) && j < 8 &&
-			        logreq_len > 0;
-			    i++, j++) {
-				private_log_cmd._data[i] = rdata[j];  
-				logreq_len--;
-			}
+		next = (can_rxring_prod + 1) & CAN_RXRING_MASK;
+		if (next == can_rxring_cons) {
+			can_rxring_ovf++;
+			break;
+		}
+		can_rxring[can_rxring_prod].id = rid;
+		memcpy(can_rxring[can_rxring_prod].data, rdata,
+		    NMEA2000_DATA_LENGTH);
+		can_rxring_prod = next;
+		softintrs.bits.int_canrx = 1;
+		break;
+	}
+}
+
+/*
+ * the session of requester addr. If there is none and new is set,
+ * take over the free or least recently used one.
+ */
+static struct log_session *
+log_session_get(uint8_t addr, char new)
+{
+	uint8_t i;
+	uint16_t age, oldest = 0;
+	struct log_session *s, *o = NULL;
+
+	for (i = 0; i < LOG_SESSIONS; i++) {
+		s = &log_sessions[i];
+		if (s->addr == addr)
+			goto found;
+		if (!new)
+			continue;
+		if (s->addr == LOG_SESSION_FREE)
+			age = 0xffff;
+		else
+			age = log_session_lru - s->lru;
+		if (o == NULL || age > oldest) {
+			o = s;
+			oldest = age;
+		}
+	}
+	if (!new)
+		return NULL;
+	s = o;
+	if (s->addr != LOG_SESSION_FREE)
+		printf("log session %d replaces %d\n", addr, s->addr);
+	log_tx_cancel(s);
+	s->addr = addr;
+	s->rx_len = 0;
+found:
+	s->lru = ++log_session_lru;
+	return s;
+}
+
+static void
+log_frame(const struct can_rxframe *f)
+{
+	unsigned char idx = (f->data[0] & FASTPACKET_IDX_MASK);
+	unsigned char id =  (f->data[0] & FASTPACKET_ID_MASK);
+	char i, j;
+	struct log_session *s;
+
+	if (f->id.daddr != nmea2000_addr && f->id.daddr != NMEA2000_ADDR_GLOBAL)
+		return; /* e.g. a reply from another device */
+	/* only a head packet may open a session */
+	s = log_session_get(f->id.saddr, idx == 0);
+	if (s == NULL)
+		return;
+	if (idx == 0) {
+		/* new head packet */
+		s->rx_id = id;
+		s->rx_len = f->data[1];
+		for (i = 0; i < 6 && s->rx_len > 0; i++) {  
+			s->req._data[i] = f->data[i+2];
+			s->rx_len--;
+		}       
+	} else if (id == s->rx_id && s->rx_len > 0) {
+		j = 1;
+		/* i = 6 + (idx - 1) * 7 : i = idx * 7 - 1 */   
+		for (i = idx * 7 - 1, j = 1;
+		    i < sizeof(s->req) && j < 8 &&
+			s->rx_len > 0;
+		    i++, j++) {
+			s->req._data[i] = f->data[j];  
+			s->rx_len--;
 		}
+		if (s->rx_len > 0)
+			return;
+	} else {
+		return;
+	}
 
-		if (logreq_len == 0) {
-			switch(private_log_cmd.rq.cmd) {
-			case PRIVATE_LOG_REQUEST:
-			case PRIVATE_LOG_REQUEST_FIRST:
-			case PRIVATE_LOG_REQUEST_NEXT:
-				handle_log_request(private_log_cmd.rq.cmd);
+	if (s->rx_len == 0) {
+		switch(s->req.rq.cmd) {
+		case PRIVATE_LOG_REQUEST:
+		case PRIVATE_LOG_REQUEST_FIRST:
+		case PRIVATE_LOG_REQUEST_NEXT:
+			PROF_ENTER(log_request);
+			handle_log_request(s, s->req.rq.cmd);
+			PROF_EXIT(log_request);
+			break;
+		case PRIVATE_LOG_INTERVAL:
+			if (f->id.daddr != nmea2000_addr)
 				break;
-			case PRIVATE_LOG_RESET:
-				printf("log reset from %d ", rid.saddr);
-				if (rid.daddr != nmea2000_addr) {
-					printf("ignored, wrong daddr %d\n",
-					    rid.daddr);
-				} else if (private_log_cmd.rst.magic != 
-				    PRIVATE_LOG_RESET_MAGIC) {
-					printf("ignored, wrong magic 0x%x\n",
-					    private_log_cmd.rst.magic);
-				} else {
-					log_erase();
-					printf("done\n");
-				}
+			log_set_interval(s, s->req.iv.interval);
+			break;
+		case PRIVATE_LOG_BURST:
+			if (f->id.daddr != nmea2000_addr)
 				break;
-			default:
-				printf("wrong log cmd %d from %d\n",
-				    private_log_cmd.rq.cmd, rid.saddr);
+			send_burst(s, s->req.rq.sid);
+			break;
+		case PRIVATE_LOG_SCHED:
+			if (f->id.daddr != nmea2000_addr)
+				break;
+			sched_request = 1;
+			sched_addr = s->addr;
+			break;
+		case PRIVATE_LOG_RESET:
+			printf("log reset from %d ", f->id.saddr);
+			if (f->id.daddr != nmea2000_addr) {
+				printf("ignored, wrong daddr %d\n",
+				    f->id.daddr);
+			} else if (s->req.rst.magic != 
+			    PRIVATE_LOG_RESET_MAGIC) {
+				printf("ignored, wrong magic 0x%x\n",
+				    s->req.rst.magic);
+			} else {
+				/* the other sessions' pages are gone too */
+				for (i = 0; i < LOG_SESSIONS; i++)
+					log_tx_cancel(&log_sessions[i]);
+				log_erase();
+				printf("done\n");
 			}
+			break;
+		default:
+			printf("wrong log cmd %d from %d\n",
+			    s->req.rq.cmd, f->id.saddr);
+		}
+	}
+}
+
+/* NMEA2000 system time or date/time: both single frame */
+static void
+time_frame(const struct can_rxframe *f, unsigned long pgn)
+{
+	const uint8_t *d = f->data;
+	uint16_t date;
+	uint32_t tod, t;
+	int32_t step;
+
+	if (pgn == NMEA2000_SYSTEM_TIME)
+		d += 2; /* skip sid and source */
+	date = d[0] | ((uint16_t)d[1] << 8); /* days since 1970 */
+	tod = d[2] | ((uint32_t)d[3] << 8) | ((uint32_t)d[4] << 16) |
+	    ((uint32_t)d[5] << 24); /* 0.0001s since midnight */
+	if (date == 0xffff || tod >= 864000000UL)
+		return; /* not available */
+	t = date * 86400UL + tod / 10000;
+	step = (int32_t)(t - time_now);
+	if (!time_valid || step > TIME_SLEW || step < -TIME_SLEW) {
+		TRACE(time_step, TRACE_L(t), f->id.saddr, TRACE_L(step));
+		/* the next entries get a new time record */
+		log_need_time = 1;
+	}
+	time_now = t;
+	time_valid = 1;
+}
+
+/* process frames and requests queued from interrupt */
+static void
+can_rx_process(void)
+{
+	char c;
+	const struct can_rxframe *f;
+	unsigned long pgn;
+
+	while (can_rxring_cons != can_rxring_prod) {
+		f = &can_rxring[can_rxring_cons];
+		pgn = ((unsigned long)f->id.page << 16) |
+		    ((unsigned long)f->id.iso_pg << 8);
+		if (f->id.iso_pg > 239)
+			pgn |= f->id.daddr;
+		if (pgn == PRIVATE_LOG)
+			log_frame(f);
+		else
+			time_frame(f, pgn);
+		can_rxring_cons = (can_rxring_cons + 1) & CAN_RXRING_MASK;
+	}
+	if (iso_request_batt) {
+		iso_request_batt = 0;
+		printf("ISO_REQUEST for %ld from %d\n",
+		    NMEA2000_BATTERY_STATUS, iso_request_addr);
+		for (c = 0; c < 4; c++) {
+			if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) == 0)
+				send_batt_status(c);
 		}
-		break;
-	    }
+	}
+	if (iso_request_dc) {
+		iso_request_dc = 0;
+		printf("ISO_REQUEST for %ld from %d\n",
+		    NMEA2000_DC_STATUS, iso_request_addr);
+		for (c = 0; c < 4; c++)
+			send_dc_status(c);
 	}
 }
 
@@ -662,74 +1205,647 @@ putch(char c)
 	}
 }
 
+/*
+ * PAC reads for the 10Hz tick are queued to the I2C engine, and
+ * processed by pac_done() once the last one completes.
+ */
+static int32_t voltages_acc_cur[4];
+static pac_vbus_t pac_vbus[4];
+static pac_acccnt_t pac_acccnt;
+static int64_t pac_accv[4];
+static struct i2c_xfer pac_xfer_vbus[4];
+static struct i2c_xfer pac_xfer_acccnt;
+static struct i2c_xfer pac_xfer_accv[4];
+static struct i2c_xfer pac_xfer_refresh;
+static struct i2c_xfer *pac_xfer_last; /* NULL if no reads pending */
+static uint8_t pac_tick; /* sched_tick of the pending reads */
+static uint8_t pac_refreshing; /* the pending reads include PAC_REFRESH */
+static char dc_status_next; /* battery for the next DC status */
+
+static void
+pac_queue(struct i2c_xfer *x, uint8_t reg, void *data, uint8_t size,
+    uint8_t flags)
+{
+	x->address = PAC_I2C_ADDR;
+	x->reg = reg;
+	x->data = data;
+	x->size = size;
+	x->flags = flags;
+	if (i2c_queue(x) == 0) {
+		printf("queue PAC 0x%x fail\n", reg);
+		x->status = I2C_XS_ERROR;
+		return;
+	}
+	pac_xfer_last = x;
+}
+
+/* tick tasks: queue the PAC reads for this tick */
+static void
+pac_read_v(uint8_t arg)
+{
+	char c;
+
+	if (pac_xfer_last != NULL) {
+		/* previous reads didn't complete in 100ms */
+		printf("PAC reads timeout\n");
+		i2c_abort();
+		pac_xfer_last = NULL;
+	}
+	pac_tick = sched_tick;
+	pac_refreshing = 0;
+	/* read voltage values */
+	for (c = 0; c < 4; c++) {
+		if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) != 0)
+			continue;
+		pac_queue(&pac_xfer_vbus[c], PAC_VBUS1_AVG + c,
+		    &pac_vbus[c], sizeof(pac_vbus_t),
+		    I2C_XF_READ | I2C_XF_SWAP);
+	}
+}
+
+/* get new values in registers and reset accumulator */
+static void
+pac_refresh(uint8_t arg)
+{
+	pac_queue(&pac_xfer_refresh, PAC_REFRESH, NULL, 0, 0);
+	pac_refreshing = 1;
+}
+
+/* read accumulators latched by the refresh */
+static void
+pac_read_acc(uint8_t arg)
+{
+	char c;
+
+	pac_queue(&pac_xfer_acccnt, PAC_ACCCNT,
+	    &pac_acccnt, sizeof(pac_acccnt),
+	    I2C_XF_READ | I2C_XF_SWAP);
+	for (c = 0; c < 4; c++) {
+		if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) != 0)
+			continue;
+		pac_accv[c] = 0;
+		pac_queue(&pac_xfer_accv[c], PAC_ACCV1 + c,
+		    &pac_accv[c], 7, I2C_XF_READ | I2C_XF_SWAP);
+	}
+}
+
+/* get new values for next voltage read, unless refreshed already */
+static void
+pac_refresh_v(uint8_t arg)
+{
+	if (!pac_refreshing)
+		pac_queue(&pac_xfer_refresh, PAC_REFRESH_V, NULL, 0, 0);
+}
+
 static void
 read_pac_channel(void)
 {
 	char c;
-	static pac_acccnt_t pac_acccnt;
 	int64_t acc_value;
-	double v;
 
-	if (i2c_readreg_be(PAC_I2C_ADDR, PAC_ACCCNT,
-	    &pac_acccnt, sizeof(pac_acccnt)) != sizeof(pac_acccnt)) {
+	if (pac_xfer_acccnt.status != I2C_XS_DONE) {
 		printf("read pac_acccnt fail\n");
 		pac_acccnt.acccnt_count = 0;
 		return;
 	} 
-	printf("\n %d count %lu", NCANOK, pac_acccnt.acccnt_count);
+	TRACE(pac_count, NCANOK, TRACE_L(pac_acccnt.acccnt_count));
 	l600_current_count += pac_acccnt.acccnt_count;
 
 	for (c = 0; c < 4; c++) {
 		if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) != 0)
 			continue;
 
-		acc_value = 0;
-		if (i2c_readreg_be(PAC_I2C_ADDR, PAC_ACCV1 + c,
-		    &acc_value, 7) != 7) {
+		if (pac_xfer_accv[c].status != I2C_XS_DONE) {
 			printf("read acc_value[%d] fail\n", c);
 			continue;
 		}
+		acc_value = pac_accv[c];
 		if (acc_value & 0x0080000000000000) {
 			/* adjust negative value */
 			acc_value |= 0xff00000000000000;
 		}
 		l600_current_acc[c] += acc_value;
-		/* batt_i = acc_value * 0.00075 * 100 */
-		v = (double)acc_value * 0.075 / pac_acccnt.acccnt_count;
-		/* adjust with calibration data */
-		switch(c) {
-		case 0:
-			v = v * 0.988689144013892;
-			break;
-		case 1:
-			v = v * 1.00930129713152;
-			break;
-		case 2:
-			v = v * 4.06331342566096;
+		/* current in 0.01A */
+		batt_i[c] = pac_scale(acc_value, pac_cal_i[c],
+		    pac_acccnt.acccnt_count * 10);
+		/* voltage in 0.01V, averaged over 10 samples */
+		batt_v[c] = pac_scale(voltages_acc[c], PAC_CAL_V, 10);
+		TRACE(pac_chan, c, batt_i[c], batt_v[c]);
+		if (!pac_started)
+			continue;
+		/* the charge of this second, in mA.s: 1024 samples/s */
+		soc_count(c, pac_scale(acc_value, pac_cal_i[c], 1024),
+		    batt_v[c], batt_temp[c]);
+		if (batt_i[c] < env_i_min[c])
+			env_i_min[c] = batt_i[c];
+		if (batt_i[c] > env_i_max[c])
+			env_i_max[c] = batt_i[c];
+		if (batt_v[c] < env_v_min[c])
+			env_v_min[c] = batt_v[c];
+	}
+	pac_started = 1;
+}
+
+/*
+ * PAC195x alerts. The limits below are programmed in the PAC, which
+ * asserts its alert pins after a few consecutive samples beyond them:
+ * the current alerts on Slow/Alert1, the voltage alerts on GPIO/Alert2.
+ * The IOC interrupt makes the next tick read the alert status (which
+ * clears it) and the instantaneous currents; they are read again at each
+ * tick until the status stays clear. The voltages are the tick's
+ * VBUS_AVG, which keeps the I2C queue within its size with 4 channels
+ * (see I2C_QUEUE_SIZE). An alert is broadcast when it starts and when
+ * it ends, and the episode is then recorded, with its peak values, in
+ * the alert log (alert.c).
+ * Limits are in 0.01A and 0.01V, 0 for none. Beyond the full scale of
+ * a channel, they are clamped to it.
+ */
+static const struct alert_limit {
+	int16_t i_charge;	/* over-current */
+	int16_t i_discharge;	/* under-current, as a positive value */
+	int16_t v_min;		/* under-voltage */
+} alert_limits[4] = {
+	{ 2000, 2000, 1150 },	/* house bank */
+	{ 2000, 2400, 1050 },	/* engine battery */
+	{ 2500, 500, 0 },	/* solar panel */
+	{ 0, 0, 0 },
+};
+#define ALERT_SMPL_I	0x55	/* 4 consecutive samples, all channels */
+#define ALERT_SMPL_V	0xff	/* 16 */
+
+static uint8_t alert_name[8]; /* our ISO NAME, as data source */
+static uint8_t alert_pending; /* IOC seen, read the status at next tick */
+static uint8_t alert_reading; /* the status is read at this tick */
+static uint8_t alert_active; /* channels with an alert in progress */
+static uint8_t alert_status[3]; /* pac_alertst_t */
+static struct alert_entry alert_cur[4]; /* in progress */
+static uint8_t alert_occurrence[4];
+static pac_vsense_t pac_vsense[4];
+static struct i2c_xfer pac_xfer_alertst;
+static struct i2c_xfer pac_xfer_vsense[4];
+
+/* value (mA or 0.01V) to a PAC register code, with calibration cal */
+static int16_t
+alert_code(int32_t v, int32_t cal)
+{
+	int64_t code = ((int64_t)v << 20) / cal;
+
+	if (code > INT16_MAX)
+		return INT16_MAX;
+	if (code < INT16_MIN)
+		return INT16_MIN;
+	return code;
+}
+
+/* program the limits and route the alerts to the pins */
+static char
+pac_set_limits(void)
+{
+	char c, err = 0;
+	pac_limit_t l;
+	pac_limit_smpl_t smpl;
+	uint8_t al1[3], al2[3], en[3];
+	const struct alert_limit *al;
+
+	memset(al1, 0, sizeof(al1));
+	memset(al2, 0, sizeof(al2));
+	for (c = 0; c < 4; c++) {
+		if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) != 0)
+			continue;
+		al = &alert_limits[c];
+		if (al->i_charge != 0) {
+			l.limit = alert_code((int32_t)al->i_charge * 10,
+			    pac_cal_i[c]);
+			if (i2c_writereg_be(PAC_I2C_ADDR, PAC_OCLIMIT1 + c,
+			    (uint8_t *)&l, sizeof(l)) == 0)
+				err++;
+			al1[0] |= PAC_AL0_OC(c);
+		}
+		if (al->i_discharge != 0) {
+			l.limit = alert_code((int32_t)al->i_discharge * -10,
+			    pac_cal_i[c]);
+			if (i2c_writereg_be(PAC_I2C_ADDR, PAC_UCLIMIT1 + c,
+			    (uint8_t *)&l, sizeof(l)) == 0)
+				err++;
+			al1[0] |= PAC_AL0_UC(c);
+		}
+		if (al->v_min != 0) {
+			l.limit = alert_code(al->v_min, PAC_CAL_V);
+			if (i2c_writereg_be(PAC_I2C_ADDR, PAC_UVLIMIT1 + c,
+			    (uint8_t *)&l, sizeof(l)) == 0)
+				err++;
+			al2[1] |= PAC_AL1_UV(c);
+		}
+	}
+	*(uint8_t *)&smpl = ALERT_SMPL_I;
+	if (i2c_writereg(PAC_I2C_ADDR, PAC_OCLIMIT_SMPL,
+	    (uint8_t *)&smpl, sizeof(smpl)) == 0 ||
+	    i2c_writereg(PAC_I2C_ADDR, PAC_UCLIMIT_SMPL,
+	    (uint8_t *)&smpl, sizeof(smpl)) == 0)
+		err++;
+	*(uint8_t *)&smpl = ALERT_SMPL_V;
+	if (i2c_writereg(PAC_I2C_ADDR, PAC_UVLIMIT_SMPL,
+	    (uint8_t *)&smpl, sizeof(smpl)) == 0)
+		err++;
+	for (c = 0; c < 3; c++)
+		en[c] = al1[c] | al2[c];
+	if (i2c_writereg(PAC_I2C_ADDR, PAC_ALERT1, al1, sizeof(al1)) == 0 ||
+	    i2c_writereg(PAC_I2C_ADDR, PAC_ALERT2, al2, sizeof(al2)) == 0 ||
+	    i2c_writereg(PAC_I2C_ADDR, PAC_ALERT_EN, en, sizeof(en)) == 0)
+		err++;
+	if (err)
+		printf("wr PAC limits fail\n");
+	return err;
+}
+
+/* the ISO NAME we claim, from nmea2000_user.h */
+static void
+alert_name_init(void)
+{
+	uint32_t n;
+
+	n = (NMEA2000_USER_ID & 0x1fffffUL) |
+	    ((uint32_t)NMEA2000_USER_MANUF << 21);
+	alert_name[0] = n & 0xff;
+	alert_name[1] = (n >> 8) & 0xff;
+	alert_name[2] = (n >> 16) & 0xff;
+	alert_name[3] = (n >> 24) & 0xff;
+	alert_name[4] = NMEA2000_USER_DEVICE_INSTANCE;
+	alert_name[5] = NMEA2000_USER_DEVICE_FUNCTION;
+	alert_name[6] = NMEA2000_USER_DEVICE_CLASS << 1;
+	alert_name[7] = 0x80 | (NMEA2000_USER_INDUSTRY_GROUP << 4) |
+	    NMEA2000_USER_SYSTEM_INSTANCE;
+}
+
+/* NMEA2000 alert for the episode of battery c */
+static void
+send_alert(char c, uint8_t state)
+{
+	struct nmea2000_alert_data *data = (void *)&nmea2000_data[0];
+	const struct alert_entry *a = &alert_cur[c];
+	uint8_t thresh;
+
+	if (nmea2000_status != NMEA2000_S_OK)
+		return;
+
+	if (state == ALERT_STATE_NORMAL)
+		thresh = ALERT_THRESH_NORMAL;
+	else if (a->type & ALERT_T_UV)
+		thresh = ALERT_THRESH_LOW;
+	else
+		thresh = ALERT_THRESH_EXCEEDED;
+	fastid = (fastid + 1) & 0x7;
+	PGN2ID(NMEA2000_ALERT, msg.id);
+	msg.id.priority = NMEA2000_PRIORITY_SECURITY;
+	msg.dlc = sizeof(struct nmea2000_alert_data);
+	msg.data = &nmea2000_data[0];
+	data->type = ((a->type & ALERT_T_UV) ?
+	    ALERT_TYPE_ALARM : ALERT_TYPE_WARNING) |
+	    (ALERT_CAT_TECHNICAL << 4);
+	data->system = 0;
+	data->subsystem = 0;
+	data->id = c;
+	memcpy(data->src_name, alert_name, sizeof(data->src_name));
+	data->src_instance = BATT_INST_BASE + c;
+	data->src_index = 0;
+	data->occurrence = alert_occurrence[c];
+	data->flags = 0xc0; /* no silence, acknowledge or escalation */
+	memset(data->ack_name, 0xff, sizeof(data->ack_name));
+	data->condition = ALERT_TRIGGER_AUTO | (thresh << 4);
+	data->priority = 0;
+	data->state = state;
+	if (! can_send_fast(&msg, fastid))
+		printf("send NMEA2000_ALERT failed\n");
+}
+
+/* the episode of c is over: log it and tell the bus */
+static void
+alert_end(char c)
+{
+	struct alert_entry *a = &alert_cur[c];
+
+	TRACE(alert_end, c, a->type, a->i_peak, a->v_min, a->duration);
+	alert_log_add(a);
+	alert_active &= ~(1 << c);
+}
+
+/* tick task: queue the alert status and current reads, if needed */
+static void
+alert_read(uint8_t arg)
+{
+	char c;
+
+	alert_reading = 0;
+	if (!alert_pending && alert_active == 0)
+		return;
+	alert_pending = 0;
+	alert_reading = 1;
+	pac_queue(&pac_xfer_alertst, PAC_ALERTST,
+	    alert_status, sizeof(alert_status), I2C_XF_READ);
+	for (c = 0; c < 4; c++) {
+		if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) != 0)
+			continue;
+		pac_queue(&pac_xfer_vsense[c], PAC_VSENSE1 + c,
+		    &pac_vsense[c], sizeof(pac_vsense_t),
+		    I2C_XF_READ | I2C_XF_SWAP);
+	}
+}
+
+/* PAC task: start, update or end the alert episodes */
+static void
+alert_task(uint8_t arg)
+{
+	char c;
+	uint8_t type;
+	int16_t i, v;
+	struct alert_entry *a;
+
+	if (!alert_reading)
+		return;
+	if (pac_xfer_alertst.status != I2C_XS_DONE) {
+		printf("read PAC_ALERTST fail\n");
+		return;
+	}
+	for (c = 0; c < 4; c++) {
+		if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) != 0)
+			continue;
+		type = 0;
+		if (alert_status[0] & PAC_AL0_OC(c))
+			type |= ALERT_T_OC;
+		if (alert_status[0] & PAC_AL0_UC(c))
+			type |= ALERT_T_UC;
+		if (alert_status[1] & PAC_AL1_UV(c))
+			type |= ALERT_T_UV;
+		a = &alert_cur[c];
+		if (type == 0) {
+			if (alert_active & (1 << c)) {
+				alert_end(c);
+				send_alert(c, ALERT_STATE_NORMAL);
+			}
+			continue;
+		}
+		i = v = 0;
+		if (pac_xfer_vsense[c].status == I2C_XS_DONE)
+			i = pac_scale(pac_vsense[c].vsense_s, pac_cal_i[c], 10);
+		if (pac_xfer_vbus[c].status == I2C_XS_DONE)
+			v = pac_scale(pac_vbus[c].vbus_s, PAC_CAL_V, 1);
+		if ((alert_active & (1 << c)) == 0) {
+			a->time = time_now;
+			a->type = type | (time_valid ? 0 : ALERT_T_NOTIME);
+			a->instance = BATT_INST_BASE + c;
+			a->i_peak = i;
+			a->v_min = v;
+			a->duration = 1;
+			alert_active |= (1 << c);
+			alert_occurrence[c]++;
+			TRACE(alert_start, c, type, i, v);
+			send_alert(c, ALERT_STATE_ACTIVE);
+			continue;
+		}
+		a->type |= type;
+		if (abs(i) > abs(a->i_peak))
+			a->i_peak = i;
+		if (v < a->v_min)
+			a->v_min = v;
+		if (a->duration != 0xffff)
+			a->duration++;
+	}
+}
+
+/*
+ * power going down: log the episodes in progress. If it comes back,
+ * the alerts still asserted start new ones.
+ */
+static void
+alert_flush(void)
+{
+	char c;
+
+	for (c = 0; c < 4; c++) {
+		if (alert_active & (1 << c))
+			alert_end(c);
+	}
+	alert_pending = 1;
+}
+
+/* PAC tasks, once the reads of their tick are complete */
+
+/* freeze software voltage accumulator. */
+static void
+pac_freeze(uint8_t arg)
+{
+	char c;
+
+	for (c = 0; c < 4; c++) {
+		voltages_acc[c] = voltages_acc_cur[c];
+		l600_voltages_acc[c] += voltages_acc_cur[c];
+		voltages_acc_cur[c] = 0;
+	}
+	l600_voltages_count += 10;
+	SIDINC(sid);
+}
+
+static void
+pac_second(uint8_t arg)
+{
+	PROF_ENTER(read_pac_channel);
+	read_pac_channel();
+	burst_record();
+	PROF_EXIT(read_pac_channel);
+}
+
+static void
+batt_status_task(uint8_t c)
+{
+	send_batt_status(c);
+}
+
+/* one battery each second */
+static void
+dc_status_task(uint8_t arg)
+{
+	char c;
+
+	for (c = 0; c < 4; c++) {
+		dc_status_next = (dc_status_next + 1) & 0x3;
+		if (soc_enabled(dc_status_next)) {
+			send_dc_status(dc_status_next);
 			break;
 		}
-		batt_i[c] = v + 0.5;
-		printf(" %d %4.4fA", c, v / 100);
-		/* volt = vbus * 0.000488 */
-		/* batt_v = voltages_acc * 0.000488 * 100 / 10; */
-		/* adjust by 0.99955132 from calibration data */
-		v = (double)voltages_acc[c] * 0.0048778104;
-		batt_v[c] = v + 0.5;
-		printf(" %4.3fV", v / 100);
 	}
 }
 
+/* other tick tasks */
+static void
+second_task(uint8_t arg)
+{
+	LEDBATT_G = 1;
+	seconds++;
+	time_now++;
+	if (can_rxring_ovf != 0 || can_fifo_ovf != 0) {
+		printf("CAN rx overflow: ring %u fifo %u\n",
+		    can_rxring_ovf, can_fifo_ovf);
+	}
+	if (seconds >= log_interval) {
+		PROF_ENTER(update_log);
+		update_log();
+		PROF_EXIT(update_log);
+		seconds = 0;
+	}
+	ADCON0bits.ADON = 1; /* start a new cycle */
+}
+
+static void
+led_off_task(uint8_t arg)
+{
+	LEDBATT_G = 0;
+}
+
+static void
+adc_task(uint8_t arg)
+{
+	if (ADCON0bits.ADON)
+		ADCON0bits.GO = 1;
+}
+
+static void
+can_poll_task(uint8_t arg)
+{
+	uint16_t ticks, tmrv;
+
+	if (NCANOK || nmea2000_status != NMEA2000_S_OK)
+		return;
+	tmrv = timer0_read();
+	ticks = tmrv - poll_count;
+	if (ticks > TIMER0_5MS) {
+		poll_count = tmrv;
+		CAN_LOCK();
+		nmea2000_poll(ticks / TIMER0_1MS);
+		CAN_UNLOCK();
+	}
+	if (nmea2000_status != NMEA2000_S_OK) {
+		printf("lost CAN bus %d\n",
+		    ticks);
+	}
+}
+
+/*
+ * The schedule: at tick t of the second, the tick tasks with
+ * t % period == phase run, in this order; then the PAC tasks due
+ * at t run once the PAC reads queued at this tick are complete.
+ */
+static const struct sched_task {
+	void (*fn)(uint8_t);
+	uint8_t arg;
+	uint8_t period;	/* in ticks, divides SCHED_TICKS */
+	uint8_t phase;
+	uint8_t flags;
+#define SCHED_PAC	0x01	/* after the PAC reads */
+} sched_tasks[] = {
+	{ pac_read_v,		0, 1,  0, 0 },
+	{ pac_refresh,		0, 10, 3, 0 },
+	{ pac_read_acc,		0, 10, 4, 0 },
+	{ pac_refresh_v,	0, 1,  0, 0 },
+	{ alert_read,		0, 1,  0, 0 },
+	{ second_task,		0, 10, 9, 0 },
+	{ led_off_task,		0, 10, 0, 0 },
+	{ adc_task,		0, 1,  0, 0 },
+	{ can_poll_task,	0, 1,  0, 0 },
+	{ pac_freeze,		0, 10, 3, SCHED_PAC },
+	{ alert_task,		0, 1,  0, SCHED_PAC },
+	{ pac_second,		0, 10, 4, SCHED_PAC },
+	{ batt_status_task,	3, 10, 4, SCHED_PAC },
+	{ batt_status_task,	2, 10, 5, SCHED_PAC },
+	{ batt_status_task,	1, 10, 6, SCHED_PAC },
+	{ batt_status_task,	0, 10, 7, SCHED_PAC },
+	{ dc_status_task,	0, 10, 8, SCHED_PAC },
+};
+#define SCHED_NTASKS (sizeof(sched_tasks) / sizeof(sched_tasks[0]))
+
+static uint16_t sched_wcet[SCHED_NTASKS]; /* longest run, timer0 ticks */
+
+/* run the tasks with these flags due at tick */
+static void
+sched_run(uint8_t tick, uint8_t flags)
+{
+	uint8_t i;
+	uint16_t t0, t1;
+	const struct sched_task *tk;
+
+	t0 = timer0_read();
+	for (i = 0; i < SCHED_NTASKS; i++) {
+		tk = &sched_tasks[i];
+		if (tk->flags != flags || tick % tk->period != tk->phase)
+			continue;
+		tk->fn(tk->arg);
+		/* the end of a task is the start of the next one */
+		t1 = timer0_read();
+		if (t1 - t0 > sched_wcet[i])
+			sched_wcet[i] = t1 - t0;
+		t0 = t1;
+	}
+}
+
+/* all PAC reads for this tick are complete */
+static void
+pac_done(void)
+{
+	char c;
+
+	pac_xfer_last = NULL;
+	for (c = 0; c < 4; c++) {
+		if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) != 0)
+			continue;
+		if (pac_xfer_vbus[c].status == I2C_XS_DONE)
+			voltages_acc_cur[c] += pac_vbus[c].vbus_s;
+		else
+			printf("read v[%d] fail\n", c);
+	}
+	if (pac_xfer_refresh.status != I2C_XS_DONE)
+		printf("PAC_REFRESH%s fail\n", pac_refreshing ? "" : "_V");
+	sched_run(pac_tick, SCHED_PAC);
+}
+
+/* reply to PRIVATE_LOG_SCHED with the schedule and the run times */
+static void
+send_sched(void)
+{
+	uint8_t i;
+	const struct sched_task *tk;
+
+	fastid = (fastid + 1) & 0x7;
+	msg.id.id = 0;
+	msg.id.iso_pg = (PRIVATE_LOG >> 8) & 0xff;
+	msg.id.daddr = sched_addr;
+	msg.id.priority = NMEA2000_PRIORITY_ACK;
+	msg.dlc = sizeof(struct private_log_sched_reply);
+	msg.data = &private_log_cmd.sc;
+	private_log_cmd.sc.cmd = PRIVATE_LOG_SCHED_REPLY;
+	private_log_cmd.sc.ticks = SCHED_TICKS;
+	for (i = 0; i < SCHED_NTASKS; i++) {
+		tk = &sched_tasks[i];
+		private_log_cmd.sc.task[i].period = tk->period;
+		private_log_cmd.sc.task[i].phase =
+		    tk->phase | ((tk->flags & SCHED_PAC) ? SCHED_T_PAC : 0);
+		/* timer0 at 9.765625kHz */
+		private_log_cmd.sc.task[i].wcet =
+		    (uint32_t)sched_wcet[i] * 1024 / 10;
+		msg.dlc += sizeof(struct sched_stat);
+	}
+	if (! can_send_fast(&msg, fastid))
+		printf("send PRIVATE_LOG_SCHED_REPLY failed\n");
+}
+
 int
 main(void)
 {
 	char c;
 	uint8_t i2cr;
+	uint8_t e, n;
+	union log_entry le;
 	pac_accumcfg_t pac_accumcfg;
 	pac_neg_pwr_fsr_t pac_neg_pwr_fsr;
-	static unsigned int poll_count;
 	uint16_t t0;
-	static int32_t voltages_acc_cur[4];
-	uint8_t new_boot;
 
 
 	devid = 0;
@@ -752,7 +1868,7 @@ main(void)
 	asm("movff TABLAT, _devid + 1;");
 
 	/* disable unused modules */
-	PMD0 = 0x7a; /* keep clock and IOC */
+	PMD0 = 0x5a; /* keep clock, HLVD and IOC */
 #ifdef USE_TIMER2
 	PMD1 = 0xfa; /* keep timer0/timer2 */
 	PMD2 = 0x03; /* keep can module */
@@ -783,6 +1899,8 @@ main(void)
 	LATCbits.LATC5 = TRISCbits.TRISC5 = 0; /* IO1 */
 	LATBbits.LATB4 = TRISBbits.TRISB4 = 0; /* IO2 */
 	LATBbits.LATB5 = TRISBbits.TRISB5 = 0; /* IO3 */
+	/* PAC alert pins, open drain with pull-ups */
+	TRISBbits.TRISB0 = TRISBbits.TRISB1 = 1;
 
 	ANSELA = 0x13; /* RA0, RA1 and RA4 analog */
 	LATA = 0;
@@ -796,16 +1914,18 @@ main(void)
 	CPUDOZE = 0x80;
 
 	softintrs.byte = 0;
+	sched_tick = 0;
 	counter_10hz = 25;
-	counter_1hz = 10;
 	seconds = 0;
 
 	for (c = 0; c < 4; c++) {
 		voltages_acc_cur[c] = 0;
 		l600_current_acc[c] = 0;
 		l600_voltages_acc[c] = 0;
+		env_reset(c);
 	}
 	l600_current_count = 0;
+	l600_voltages_count = 0;
 
 	IPR1 = 0;
 	IPR2 = 0;
@@ -863,6 +1983,15 @@ main(void)
 
 	I2C_INIT;
 
+	/* power-fail warning: interrupt when VDD falls below HLVD_SEL */
+	HLVDCON1 = HLVD_SEL;
+	HLVDCON0 = 0;
+	HLVDCON0bits.INTL = 1;
+	HLVDCON0bits.EN = 1;
+	PIR2bits.HLVDIF = 0;
+	IPR2bits.HLVDIP = 1; /* high priority interrupt */
+	PIE2bits.HLVDIE = 1;
+
 	INTCON0bits.GIEH=1;  /* enable high-priority interrupts */   
 	INTCON0bits.GIEL=1; /* enable low-priority interrrupts */   
 
@@ -874,16 +2003,23 @@ main(void)
 	printf("n2k_init\n");
 	nmea2000_init();
 	poll_count = timer0_read();
+	/* receive from interrupt */
+	C1INTUbits.RXIE = 1;
+	IPR0bits.CANIP = 0;
+	PIE0bits.CANIE = 1;
 
 	/* enable watchdog */
 	WDTCON0bits.SEN = 1;
 
 	/* set up ADC */
 	PIR1bits.ADIF = 0;
+	PIR1bits.ADTIF = 0;
 	ADCON0 = 0x4; /* right-justified */
 	ADCON1 = 0; /* no cap */
-	ADCON2 = 0; /* basic mode */
-	ADCON3 = 0; /* basic mode */
+	/* burst average, ADFLTR = ADACC >> NTC_OVS_SHIFT */
+	ADCON2 = (NTC_OVS_SHIFT << 4) | 0x3;
+	ADCON3 = 0x7; /* ADTIF at end of each burst */
+	ADRPT = NTC_OVS;
 	ADCLK = 7; /* Fosc/16 */
 	ADREF = 0;  /* vref = VDD */
 	ADPCH = 0; /* channel 0 */
@@ -924,7 +2060,7 @@ main(void)
 				log_cblk = c2;
 				log_gen = battlog[c].b_flags & B_FILL_GEN;
 				if (log_cblk == 0)
-					log_gen += 0x4;
+					log_gen_next();
 				break;
 			}
 		}
@@ -935,25 +2071,58 @@ main(void)
 		printf("log empty\n");
 		log_cblk = 0;
 		log_gen = 0;
-	}
-	/* look for first free entry in block */
-	for (c = 0; c < LOG_ENTRIES; c++) {
-		if (battlog[log_cblk].b_entry[c].s.nvalid == 1) {
-			/* first free entry */
-			log_centry = c;
-			break;
+	} else if (log_gen == 0 && LOG_IS_DELTA(&battlog[log_cblk])) {
+		/* the old firmwares didn't erase in background */
+		for (c = log_cblk + 1; c < LOG_BLOCKS; c++) {
+			if (battlog[c].b_flags != 0xff)
+				break;
+		}
+		if (c < LOG_BLOCKS) {
+			printf("resuming log erase at %d\n", c);
+			log_erase_next = c;
 		}
 	}
-	if (c == LOG_ENTRIES) {
-		/* log corrupted, reset */
-		printf("non-full block with no free entry: reset log\n");
-		log_erase();
+	/* look for the end of the records in block, and the last values */
+	memset(log_last, 0, sizeof(log_last));
+	c = 0;
+	n = LOG_DATA;
+	if (LOG_IS_DELTA(&battlog[log_cblk])) {
+		while ((e = log_rec_decode(log_last,
+		    &battlog[log_cblk].b_data[c], LOG_RDATA - c, &le,
+		    NULL)) != 0)
+			c += e;
+		n = LOG_RDATA;
+	}
+	log_centry = c;
+	/*
+	 * The bytes after the last record should be blank. If not, a commit
+	 * was interrupted, or the block has entries in the old format:
+	 * we can't program it again without erasing it. Close it and
+	 * start a new one.
+	 */
+	for (e = c; e < n; e++) {
+		if (battlog[log_cblk].b_data[e] != 0xff)
+			break;
 	}
 	page_read(&battlog[log_cblk]);
+	if (e != n) {
+		printf("block %d partially committed (%d/%d): closing\n",
+		    log_cblk, c, e);
+		curlog.b_flags &= ~B_FILL_STAT;
+		page_write(&battlog[log_cblk]);
+		log_next_block();
+	}
 
-	memset(&curlog.b_entry[log_centry], 0, sizeof(union log_entry));
+	/* the firmware may have changed, with our instances */
+	log_need_bank = 1;
+	log_add(NULL, NULL);
+	log_need_time = 1;
+	log_commit();
 
-	next_log_entry();
+	alert_log_init();
+	alert_name_init();
+	for (c = 0; c < LOG_SESSIONS; c++)
+		log_sessions[c].addr = LOG_SESSION_FREE;
 
 	LEDBATT_R = LEDBATT_G = 0;
 
@@ -1016,6 +2185,8 @@ again:
 		c++;
 	}
 
+	c += pac_set_limits();
+
 	if (i2c_writecmd(PAC_I2C_ADDR, PAC_REFRESH) == 0) {
 		printf("cmd PAC_REFRESH fail\n");
 		c++;
@@ -1023,10 +2194,28 @@ again:
 	if (c != 0)
 		goto again;
 
+	/* alerts: falling edge of the pins; get the status a first time */
+	IOCBN = ALERT_PINS;
+	IOCBF = 0;
+	IPR0bits.IOCIP = 0;
+	PIE0bits.IOCIE = 1;
+	alert_pending = 1;
+
 	while (1) {
 		CLRWDT();
-		if (C1INTLbits.RXIF) {
-			nmea2000_receive();
+		if (softintrs.bits.int_pfail) {
+			softintrs.bits.int_pfail = 0;
+			printf("power fail\n");
+			log_commit();
+			alert_flush();
+		}
+		if (softintrs.bits.int_canrx) {
+			softintrs.bits.int_canrx = 0;
+			can_rx_process();
+		}
+		if (softintrs.bits.int_alert) {
+			softintrs.bits.int_alert = 0;
+			alert_pending = 1;
 		}
 		if (NCANOK) {
 			nmea2000_status = NMEA2000_S_ABORT;
@@ -1038,15 +2227,19 @@ again:
 			ticks = tmrv - poll_count;
 			if (ticks > TIMER0_5MS) {
 				poll_count = tmrv;
+				CAN_LOCK();
 				nmea2000_poll(ticks / TIMER0_1MS);
+				CAN_UNLOCK();
 			}
 			if (nmea2000_status == NMEA2000_S_OK) {
 				printf("new addr %d\n", nmea2000_addr);
 			}
 		}
-		if (PIR1bits.ADIF) {
+		if (PIR1bits.ADTIF) {
+			PROF_ENTER(adc);
+			PIR1bits.ADTIF = 0;
 			PIR1bits.ADIF = 0;
-			a2d_acc = ((unsigned int)ADRESH << 8) | ADRESL;
+			a2d_acc = ((unsigned int)ADFLTRH << 8) | ADFLTRL;
 			switch (ADPCH) {
 			case 0:
 				/* channel 0: NTC */
@@ -1072,96 +2265,46 @@ again:
 			default:
 				printf("unknown channel 0x%x\n", ADCON0);
 			}
+			PROF_EXIT(adc);
 		}
 
+		if (pac_xfer_last != NULL &&
+		    pac_xfer_last->status != I2C_XS_QUEUED) {
+			PROF_ENTER(pac_done);
+			pac_done();
+			PROF_EXIT(pac_done);
+		}
 		if (softintrs.bits.int_10hz) {
+			PROF_ENTER(tick_10hz);
 			softintrs.bits.int_10hz = 0;
-			/* read voltage values */
-			for (c = 0; c < 4; c++) {
-				pac_vbus_t pac_vbus;
-				if ((pac_ctrl.ctrl_chan_dis & (8 >> c)) != 0)
-					continue;
-				if (i2c_readreg_be(PAC_I2C_ADDR,
-				    PAC_VBUS1_AVG + c,
-				    &pac_vbus, sizeof(pac_vbus)) ==
-				    sizeof(pac_vbus))
-					voltages_acc_cur[c] += pac_vbus.vbus_s;
-				else
-					printf("read v[%d] fail\n", c);
-			}
-			counter_1hz--;
-			switch(counter_1hz) {
-			case 6:
-				/*
-				 * get new values in registers and reset
-				  * accumulator. Also freeze software voltage
-				  * accumulator.
-				  */
-				if (i2c_writecmd(PAC_I2C_ADDR,
-				    PAC_REFRESH) == 0)
-					printf("PAC_REFRESH fail\n");
-				for (c = 0; c < 4; c++) {
-					voltages_acc[c] = voltages_acc_cur[c];
-					l600_voltages_acc[c] +=
-					    voltages_acc_cur[c];
-					voltages_acc_cur[c] = 0;
-				}
-				SIDINC(sid);
-				break;
-			case 5:
-				read_pac_channel();
-				/* FALLTHROUGH */
-			case 4:
-			case 3:
-			case 2:
-				send_batt_status(counter_1hz - 2);
-				/* FALLTHROUGH */
-			default:
-				/* get new values for next voltage read */
-				if (i2c_writecmd(PAC_I2C_ADDR,
-				    PAC_REFRESH_V) == 0)
-					printf("PAC_REFRESH_V fail\n");
-			}
-
-			if (counter_1hz == 0) {
-				counter_1hz = 10;
-				LEDBATT_G = 1;
-				seconds++;
-				if (seconds == 600) {
-					update_log();
-					seconds = 0;
-				}
-				ADCON0bits.ADON = 1; /* start a new cycle */
-			} else {
-				LEDBATT_G = 0;
-			}
-			if (ADCON0bits.ADON)
-				ADCON0bits.GO = 1;
-			if (!NCANOK && nmea2000_status == NMEA2000_S_OK) {
-				uint16_t ticks, tmrv;
-
-				tmrv = timer0_read();
-				ticks = tmrv - poll_count;
-				if (ticks > TIMER0_5MS) {
-					poll_count = tmrv;
-					nmea2000_poll(ticks / TIMER0_1MS);
-				}
-				if (nmea2000_status != NMEA2000_S_OK) {
-					printf("lost CAN bus %d\n",
-					    ticks);
-				}
-			}
+			sched_run(sched_tick, 0);
+			if (++sched_tick == SCHED_TICKS)
+				sched_tick = 0;
+			PROF_EXIT(tick_10hz);
 		}
+		trace_flush();
 		if (PIR4bits.U1RXIF && (U1RXB == 'r'))
 			break;
-		if (softintrs.byte == 0)
+		if (sched_request) {
+			sched_request = 0;
+			send_sched();
+		}
+		if (log_erase_next != 0) {
+			PROF_ENTER(log_erase);
+			log_erase_step();
+			PROF_EXIT(log_erase);
+		}
+		if (log_tx_run() == 0 &&
+		    softintrs.byte == 0 && log_erase_next == 0) {
 			SLEEP();
+		}
 	}
 	while ((c = getchar()) != 'r') {
 		printf("resumed %u\n", timer0_read());
 		goto again;
 	}
 	WDTCON0bits.SEN = 0;
+	log_commit();
 	printf("returning\n");
 	LEDBATT_R = LEDBATT_G = 0;
 	while (!PIR4bits.U1TXIF) {
@@ -1178,12 +2321,43 @@ timer0_read(void)
 
 	/* timer0_value = TMR0L | (TMR0H << 8), reading TMR0L first */
 	di();
+#ifdef __XC8
 	asm("movff TMR0L, timer0_read@value");
 	asm("movff TMR0H, timer0_read@value+1");
+#else
+	value = TMR0L;
+	value |= (unsigned int)TMR0H << 8;
+#endif
 	ei();
 	return value;
 }
 
+void __interrupt(__irq(HLVD), __high_priority, base(IVECT_BASE))
+irqh_hlvd(void)
+{
+	PIR2bits.HLVDIF = 0;
+	softintrs.bits.int_pfail = 1;
+}
+
+void __interrupt(__irq(IOC), __low_priority, base(IVECT_BASE))
+irqh_ioc(void)
+{
+	IOCBF &= ~ALERT_PINS;
+	softintrs.bits.int_alert = 1;
+}
+
+void __interrupt(__irq(CAN), __low_priority, base(IVECT_BASE))
+irqh_can(void)
+{
+	if (C1INTHbits.RXOVIF) {
+		/* the stack receives in FIFO 1 */
+		can_fifo_ovf++;
+		C1FIFOSTA1Lbits.RXOVIF = 0;
+	}
+	while (C1INTLbits.RXIF)
+		nmea2000_receive();
+}
+
 #ifdef USE_TIMER2
 void __interrupt(__irq(TMR2), __high_priority, base(IVECT_BASE))
 irqh_timer2(void)
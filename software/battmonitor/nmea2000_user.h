@@ -40,6 +40,14 @@ extern unsigned long nmea2000_user_id;
 #define NMEA2000_USER_INDUSTRY_GROUP 4
 #define NMEA2000_USER_SYSTEM_INSTANCE 0
 
+/*
+ * battery instance of channel 0, the others follow. Has to be different
+ * for each unit on the bus, so that their batteries can be told apart.
+ */
+#ifndef BATT_INST_BASE
+#define BATT_INST_BASE 0
+#endif
+
 /* setup for 250Kbs, 1Tq = 1/10Mhz */
 #define NBTCFGU_uval 26 /* Tseg1 = 27 Tq */
 #define NBTCFGH_uval 11 /* Tseg2 = 12 Tq */
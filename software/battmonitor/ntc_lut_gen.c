@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * build-time generator for ntc_lut.h: the temps[] table of ntc_tab.c,
+ * resampled as a dense table indexed by the top bits of the
+ * oversampled ADC value, with the slope of each segment.
+ * adctotemp() then needs one lookup and one 8x8 multiply.
+ * Runs on the build host:
+ * cc -I host -I . -o ntc_lut_gen ntc_lut_gen.c ntc_tab.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdint.h>
+#include "ntc_tab.h"
+
+#define NTC_SCALE	(1 << (NTC_BITS - 12))
+#define NTC_SEG		(1 << NTC_LUT_SHIFT)
+
+/* temperature in 0.01K for an oversampled ADC value, from temps[] */
+static double
+ntc_temp(double v)
+{
+	int i;
+
+	v = v / NTC_SCALE;
+	for (i = 1; temps[i + 1].val != 0; i++) {
+		if (v > temps[i].val)
+			break;
+	}
+	/* extrapolates past the end segments */
+	return temps[i].temp + (v - temps[i].val) *
+	    ((double)temps[i - 1].temp - temps[i].temp) /
+	    ((double)temps[i - 1].val - temps[i].val);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned int min, max, s, v, t0, t1;
+	double err, maxerr = 0;
+	int i;
+
+	min = max = temps[0].val * NTC_SCALE;
+	for (i = 0; temps[i].val != 0; i++)
+		min = temps[i].val * NTC_SCALE;
+
+	printf("/* generated by ntc_lut_gen from ntc_tab.c, do not edit */\n\n");
+	printf("#define NTC_LUT_MIN\t%u\n", min);
+	printf("#define NTC_LUT_MAX\t%u\n\n", max);
+	printf("static const struct ntc_lut ntc_lut[%d] = {\n",
+	    1 << (NTC_BITS - NTC_LUT_SHIFT));
+	for (s = 0; s < (1 << NTC_BITS); s += NTC_SEG) {
+		if (s + NTC_SEG <= min || s > max) {
+			printf("\t{ 0, 0 },\n");
+			continue;
+		}
+		t0 = lround(ntc_temp(s));
+		t1 = lround(ntc_temp(s + NTC_SEG));
+		if (t1 < t0 || t1 - t0 > 255) {
+			fprintf(stderr, "ntc_lut_gen: slope %d at %u "
+			    "does not fit\n", t1 - t0, s);
+			return 1;
+		}
+		for (v = s; v < s + NTC_SEG; v++) {
+			if (v < min || v > max)
+				continue;
+			err = fabs(t0 + (((t1 - t0) * (v - s)) >> NTC_LUT_SHIFT)
+			    - ntc_temp(v));
+			if (err > maxerr)
+				maxerr = err;
+		}
+		printf("\t{ %u, %u },\t/* 0x%04x */\n", t0, t1 - t0, s);
+	}
+	printf("};\n");
+	fprintf(stderr, "ntc_lut_gen: max error %.2f (0.01K)\n", maxerr);
+	return 0;
+}
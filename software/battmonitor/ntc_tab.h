@@ -30,3 +30,23 @@ struct temp_val {
 	uint16_t val;
 };
 extern const struct temp_val temps[];
+
+/*
+ * NTC readings are the average of NTC_OVS conversions, computed by
+ * the ADC in burst average mode, and kept with NTC_BITS bits.
+ */
+#define NTC_OVS		16	/* conversions per reading */
+#define NTC_OVS_SHIFT	2	/* ADFLTR = ADACC >> NTC_OVS_SHIFT */
+#define NTC_BITS	14	/* 12 + log2(NTC_OVS) - NTC_OVS_SHIFT */
+
+/*
+ * dense table generated from temps[] by ntc_lut_gen (ntc_lut.h),
+ * indexed by the top bits of the reading: the temperature at the start
+ * of the segment, and the temperature increase over the segment.
+ */
+#define NTC_LUT_SHIFT	7	/* segments of 128 values */
+
+struct ntc_lut {
+	uint16_t temp; /* in 0.01K */
+	uint8_t slope; /* in 0.01K per segment */
+};
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2022 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <xc.h>
+#include <stdio.h>
+#include "battlog.h"
+#include "alert.h"
+#include "nvm.h"
+#include "trace.h"
+
+void
+page_erase(const struct log_block *b)
+{
+	__uint24 addr = (__uint24)b;
+	uint8_t err = 0;
+
+	TRACE(nvm_erase, TRACE_L(addr));
+
+	NVMADR = addr;
+	NVMCON1bits.CMD = 0x06;
+	INTCON0bits.GIE = 0;
+
+	NVMLOCK = 0x55;
+	NVMLOCK = 0xAA;
+	NVMCON0bits.GO = 1;
+
+	while (NVMCON0bits.GO)
+		; /* wait */
+
+	if (NVMCON1bits.WRERR) {
+		err++;
+	}
+	NVMCON1bits.CMD = 0;
+	INTCON0bits.GIE = 1;
+	if (err) {
+		printf("erase 0x%lx failed\n", (uint32_t)addr);
+	}
+}
+
+void
+page_read(const struct log_block *b)
+{
+	__uint24 addr = (__uint24)b;
+	uint8_t err = 0;
+
+	TRACE(nvm_read, TRACE_L(addr));
+
+	NVMADR = addr;
+	NVMCON1bits.CMD = 0x02;
+	NVMCON0bits.GO = 1;
+
+	while (NVMCON0bits.GO)
+		; /* wait */
+
+	NVMCON1bits.CMD = 0;
+}
+
+void
+page_write(const struct log_block *b)
+{
+	__uint24 addr = (__uint24)b;
+	uint8_t err = 0;
+
+	TRACE(nvm_write, TRACE_L(addr));
+
+	NVMADR = addr;
+	NVMCON1bits.CMD = 0x05;
+	INTCON0bits.GIE = 0;
+
+	NVMLOCK = 0x55;
+	NVMLOCK = 0xAA;
+	NVMCON0bits.GO = 1;
+
+	while (NVMCON0bits.GO)
+		; /* wait */
+
+	if (NVMCON1bits.WRERR) {
+		err++;
+	}
+	NVMCON1bits.CMD = 0;
+	INTCON0bits.GIE = 1;
+	if (err) {
+		printf("write 0x%lx failed\n", (uint32_t)addr);
+	}
+}
+
+void
+alert_page_erase(const struct alert_block *b)
+{
+	__uint24 addr = (__uint24)b;
+	uint8_t err = 0;
+
+	TRACE(nvm_erase, TRACE_L(addr));
+
+	NVMADR = addr;
+	NVMCON1bits.CMD = 0x06;
+	INTCON0bits.GIE = 0;
+
+	NVMLOCK = 0x55;
+	NVMLOCK = 0xAA;
+	NVMCON0bits.GO = 1;
+
+	while (NVMCON0bits.GO)
+		; /* wait */
+
+	if (NVMCON1bits.WRERR) {
+		err++;
+	}
+	NVMCON1bits.CMD = 0;
+	INTCON0bits.GIE = 1;
+	if (err) {
+		printf("erase 0x%lx failed\n", (uint32_t)addr);
+	}
+}
+
+/* program the blank slot a with e, one word at a time */
+void
+alert_write(const struct alert_entry *a, const struct alert_entry *e)
+{
+	__uint24 addr = (__uint24)a;
+	const uint16_t *w = (const uint16_t *)e;
+	uint8_t i, err = 0;
+
+	TRACE(nvm_write, TRACE_L(addr));
+
+	NVMCON1bits.CMD = 0x03;
+	for (i = 0; i < sizeof(*e) / 2; i++) {
+		NVMADR = addr;
+		NVMLAT = w[i];
+		INTCON0bits.GIE = 0;
+
+		NVMLOCK = 0x55;
+		NVMLOCK = 0xAA;
+		NVMCON0bits.GO = 1;
+
+		while (NVMCON0bits.GO)
+			; /* wait */
+
+		if (NVMCON1bits.WRERR) {
+			err++;
+		}
+		INTCON0bits.GIE = 1;
+		addr += 2;
+	}
+	NVMCON1bits.CMD = 0;
+	if (err) {
+		printf("write 0x%lx failed\n", (uint32_t)(__uint24)a);
+	}
+}
@@ -230,6 +230,11 @@ typedef struct {
 	uint8_t	alert_ch2op	:1;
 	uint8_t	alert_ch1op	:1;
 } pac_alert_t;
+/* per-channel bits of pac_alertst_t/pac_alert_t, c = 0 for channel 1 */
+#define PAC_AL0_UC(c)	(0x08 >> (c))	/* in byte 0 */
+#define PAC_AL0_OC(c)	(0x80 >> (c))
+#define PAC_AL1_UV(c)	(0x08 >> (c))	/* in byte 1 */
+#define PAC_AL1_OV(c)	(0x80 >> (c))
 
 #define PAC_ACC_LIMIT	0x29
 typedef struct {
@@ -66,6 +66,22 @@ again:
 #endif
 }
 
+/* room left in uart_txbuf */
+unsigned char
+usart_txroom(void)
+{
+	return (uart_txbuf_cons - uart_txbuf_prod - 1) & UART_BUFSIZE_MASK;
+}
+
+/* queue a byte as is; the caller checked usart_txroom() */
+void
+usart_putraw(char c)
+{
+	uart_txbuf[uart_txbuf_prod] = c;
+	uart_txbuf_prod = (uart_txbuf_prod + 1) & UART_BUFSIZE_MASK;
+	PIE4bits.U1TXIE = 1;
+}
+
 void __interrupt(__irq(U1TX), __low_priority, base(IVECT_BASE))
 irql_uart1(void)
 {
@@ -37,6 +37,8 @@ extern char uart_txbuf[UART_BUFSIZE];
 extern unsigned char uart_txbuf_prod;
 extern volatile unsigned char uart_txbuf_cons;
 void usart_putchar (char c);
+unsigned char usart_txroom(void);
+void usart_putraw(char c);
 
 #define USART_INIT(p) { \
 		IPR4bits.U1TXIP=p; \
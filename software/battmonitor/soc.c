@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <xc.h>
+#include <stdio.h>
+#include "soc.h"
+#include "trace.h"
+
+/*
+ * Coulomb counting, integer only. For each battery we keep the charge
+ * taken out of the full battery (soc_used), in A.s plus a mA.s remainder.
+ * - discharge is corrected for the Peukert effect: above the 20h rate
+ *   current I20, the battery gives less than its rated capacity. The
+ *   charge counted is I * (I/I20)^(k-1), from soc_peukert[].
+ * - charge is counted with SOC_CHARGE_EFF efficiency.
+ * - the capacity is corrected for temperature (SOC_TEMP_COEF per degree
+ *   from 25C), so the same used charge is a lower SoC when cold.
+ * - after SOC_REST_TIME at rest (less than C/200), the rest voltage
+ *   gives the SoC (soc_ocv[]), which corrects the drift of the counting.
+ *   This is also how we start after reset.
+ */
+
+static const struct soc_param {
+	uint16_t capacity;	/* Ah, at the 20h rate; 0: not a battery */
+} soc_param[4] = {
+	{ 200 },	/* house bank */
+	{ 100 },	/* engine battery */
+	{ 0 },		/* solar panel */
+	{ 0 },
+};
+
+#define SOC_CHARGE_EFF	973	/* 0.95, Q10 */
+#define SOC_TEMP_COEF	6	/* capacity per C, 1/1000 */
+#define SOC_REST_TIME	3600	/* s */
+#define SOC_REST_I	5	/* mA per Ah of capacity: C/200 */
+#define SOC_IDLE_I	100	/* mA; below no time remaining */
+
+/*
+ * (I/I20)^(k-1) in Q10 for a Peukert exponent k of 1.25 (flooded
+ * lead-acid), for I/I20 from 1/8 to 32 by powers of 2.
+ */
+static const uint16_t soc_peukert[9] = {
+	609, 724, 861, 1024, 1218, 1448, 1722, 2048, 2435
+};
+
+/* rest voltage (0.01V) of a 12V lead-acid battery, from 0 to 100% by 10 */
+static const int16_t soc_ocv[11] = {
+	1150, 1162, 1174, 1186, 1198, 1210, 1222, 1234, 1246, 1258, 1270
+};
+
+static int32_t soc_used[4];	/* A.s */
+static int16_t soc_used_mas[4];	/* and mA.s */
+static int32_t soc_cap[4];	/* capacity at the current temperature, A.s */
+static int32_t soc_iavg[4];	/* counted current, averaged, mA */
+static uint16_t soc_rest[4];	/* s at rest */
+static uint8_t soc_valid[4];
+
+/* (I/I20)^(k-1) in Q10, q is I/I20 in Q6 */
+static uint16_t
+soc_pk(uint32_t q)
+{
+	uint8_t j;
+	uint32_t p;
+
+	if (q < 8)
+		return soc_peukert[0];
+	if (q >= 2048)
+		return soc_peukert[8];
+	/* find p = 2^j <= q < 2^(j+1), and interpolate */
+	for (j = 3, p = 8; q >= p * 2; j++)
+		p *= 2;
+	return soc_peukert[j - 3] + (uint16_t)(((uint32_t)
+	    (soc_peukert[j - 2] - soc_peukert[j - 3]) * (q - p)) >> j);
+}
+
+/* state of charge from the rest voltage, in 1/1000 */
+static int16_t
+soc_from_ocv(int16_t v)
+{
+	uint8_t i;
+
+	if (v <= soc_ocv[0])
+		return 0;
+	for (i = 0; i < 10; i++) {
+		if (v < soc_ocv[i + 1]) {
+			return i * 100 + (int16_t)(v - soc_ocv[i]) * 100 /
+			    (soc_ocv[i + 1] - soc_ocv[i]);
+		}
+	}
+	return 1000;
+}
+
+static void
+soc_set_ocv(uint8_t c, int16_t v)
+{
+	int16_t pm = soc_from_ocv(v);
+
+	soc_used[c] = soc_cap[c] / 1000 * (1000 - pm);
+	soc_used_mas[c] = 0;
+	soc_valid[c] = 1;
+	TRACE(soc_rest, c, v, pm / 10);
+}
+
+void
+soc_count(uint8_t c, int32_t mas, int16_t voltage, uint16_t temp)
+{
+	uint16_t cap = soc_param[c].capacity;
+	int16_t t = 25;
+	int32_t m;
+
+	if (cap == 0)
+		return;
+	if (temp != 0xffff) {
+		t = ((int32_t)temp - 27315) / 100;
+		if (t < -30)
+			t = -30;
+		else if (t > 45)
+			t = 45;
+	}
+	soc_cap[c] = (int32_t)cap * 36 * (1000 + SOC_TEMP_COEF * (t - 25)) /
+	    10;
+
+	if (!soc_valid[c])
+		soc_set_ocv(c, voltage);
+
+	if (mas < (int32_t)cap * SOC_REST_I &&
+	    mas > -(int32_t)cap * SOC_REST_I) {
+		if (++soc_rest[c] >= SOC_REST_TIME) {
+			soc_set_ocv(c, voltage);
+			soc_rest[c] = 0;
+		}
+	} else {
+		soc_rest[c] = 0;
+	}
+
+	if (mas < 0) {
+		/* I/I20 in Q6; I20 is cap * 50 mA */
+		m = (uint32_t)(-mas) * 64 / ((uint32_t)cap * 50);
+		mas = ((int64_t)mas * soc_pk(m)) >> 10;
+	} else {
+		mas = ((int64_t)mas * SOC_CHARGE_EFF) >> 10;
+	}
+	soc_iavg[c] += (mas - soc_iavg[c]) / 64;
+
+	m = soc_used_mas[c] - mas;
+	soc_used[c] += m / 1000;
+	soc_used_mas[c] = m % 1000;
+	if (soc_used[c] < 0) {
+		/* can't be more than full */
+		soc_used[c] = 0;
+		soc_used_mas[c] = 0;
+	}
+}
+
+uint8_t
+soc_enabled(uint8_t c)
+{
+	return soc_param[c].capacity != 0;
+}
+
+uint8_t
+soc_get(uint8_t c)
+{
+	int32_t s;
+
+	if (!soc_valid[c])
+		return SOC_UNKNOWN;
+	s = (soc_cap[c] - soc_used[c]) / (soc_cap[c] / 100);
+	if (s < 0)
+		return 0;
+	if (s > 100)
+		return 100;
+	return s;
+}
+
+uint16_t
+soc_time_remain(uint8_t c)
+{
+	int32_t m;
+
+	if (!soc_valid[c] || soc_iavg[c] > -SOC_IDLE_I)
+		return SOC_NO_TIME;
+	if (soc_used[c] >= soc_cap[c])
+		return 0;
+	m = (soc_cap[c] - soc_used[c]) / 60 * 1000 / -soc_iavg[c];
+	if (m >= SOC_NO_TIME)
+		return SOC_NO_TIME - 1;
+	return m;
+}
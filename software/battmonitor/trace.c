@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <xc.h>
+#include <stdio.h>
+#include "serial.h"
+#include "trace.h"
+
+static uint8_t trace_ring[TRACE_RINGSIZE];
+static uint8_t trace_prod;
+static uint8_t trace_cons;
+static uint16_t trace_lost;
+
+void
+trace_put(uint8_t id, uint8_t n, const uint16_t *args)
+{
+	uint8_t i;
+
+	if ((uint8_t)(trace_cons - trace_prod - 1) < 2 + n * 2) {
+		trace_lost++;
+		return;
+	}
+	trace_ring[trace_prod++] = TRACE_MARK | n;
+	trace_ring[trace_prod++] = id;
+	for (i = 0; i < n; i++) {
+		trace_ring[trace_prod++] = args[i] & 0xff;
+		trace_ring[trace_prod++] = args[i] >> 8;
+	}
+}
+
+/* move whole records to the UART, as long as they fit */
+void
+trace_flush(void)
+{
+	uint8_t len;
+
+	if (!PORTBbits.RB7) {
+		/* no console */
+		trace_cons = trace_prod;
+		return;
+	}
+	if (trace_lost != 0 && usart_txroom() >= 4) {
+		usart_putraw(TRACE_MARK | 1);
+		usart_putraw(TR_trace_lost);
+		usart_putraw(trace_lost & 0xff);
+		usart_putraw(trace_lost >> 8);
+		trace_lost = 0;
+	}
+	while (trace_cons != trace_prod) {
+		len = 2 + (trace_ring[trace_cons] & ~TRACE_MARK_MASK) * 2;
+		if (usart_txroom() < len)
+			return;
+		while (len-- > 0)
+			usart_putraw(trace_ring[trace_cons++]);
+	}
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * trace points. A trace point is a compact binary record in a RAM ring:
+ * a marker byte with the number of 16-bit arguments, the point id, and
+ * the arguments (little endian). The main loop moves whole records
+ * to the UART when there is room (trace_flush()); when the ring is
+ * full, records are dropped and counted. Tracing never waits.
+ * The marker bytes are control characters, not found in printf()
+ * output, so text and records can share the UART; host/trdecode turns
+ * the records back into text using the formats below.
+ *
+ * Each point has a level; points above TRACE_LEVEL are compiled out.
+ * Formats take %d, %u and %x for 16-bit arguments, and %ld, %lu and %lx
+ * for 32-bit arguments, passed with TRACE_L().
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#define TRACE_ERR	1
+#define TRACE_INFO	2
+#define TRACE_DEBUG	3
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL	TRACE_INFO
+#endif
+
+#define TRACE_POINTS \
+	TRACE_POINT(trace_lost, TRACE_ERR, "trace: %u records lost") \
+	TRACE_POINT(nvm_erase, TRACE_INFO, "erase 0x%lx") \
+	TRACE_POINT(nvm_read, TRACE_DEBUG, "read 0x%lx") \
+	TRACE_POINT(nvm_write, TRACE_INFO, "write 0x%lx") \
+	TRACE_POINT(log_commit, TRACE_INFO, "commit log block %u/%u") \
+	TRACE_POINT(log_new, TRACE_DEBUG, "new log entry %u/%u len %u") \
+	TRACE_POINT(log_time, TRACE_INFO, "new log time %u/%u %lu") \
+	TRACE_POINT(log_entry, TRACE_DEBUG, "log entry %u/%u %u %ldmA %u0mV") \
+	TRACE_POINT(log_env, TRACE_DEBUG, "log env %u %ld/%ldmA %u0mV") \
+	TRACE_POINT(log_cancel, TRACE_INFO, "cancel page %u sid %u") \
+	TRACE_POINT(log_page, TRACE_INFO, "send page %u") \
+	TRACE_POINT(log_burst, TRACE_INFO, "send burst %u samples") \
+	TRACE_POINT(log_fast, TRACE_DEBUG, "send fast len %u/%u, offset %u") \
+	TRACE_POINT(log_request, TRACE_INFO, "log request sid %u gen %u page %u") \
+	TRACE_POINT(time_step, TRACE_INFO, "time %lu from %u, step %ld") \
+	TRACE_POINT(pac_count, TRACE_DEBUG, "%u count %lu") \
+	TRACE_POINT(pac_chan, TRACE_DEBUG, "  %u %d0mA %d0mV") \
+	TRACE_POINT(soc_rest, TRACE_INFO, "soc %u: %d0mV rest, %u%%") \
+	TRACE_POINT(alert_start, TRACE_INFO, "alert %u: 0x%x %d0mA %d0mV") \
+	TRACE_POINT(alert_end, TRACE_INFO, \
+	    "alert %u end: 0x%x peak %d0mA %d0mV, %u00ms")
+
+enum trace_id {
+#define TRACE_POINT(p, l, f)	TR_##p,
+TRACE_POINTS
+#undef TRACE_POINT
+	TR_COUNT
+};
+
+enum trace_level {
+#define TRACE_POINT(p, l, f)	TRACE_L_##p = l,
+TRACE_POINTS
+#undef TRACE_POINT
+};
+
+#define TRACE_MARK	0x10	/* | number of arguments */
+#define TRACE_MARK_MASK	0xf8
+#define TRACE_MAXARGS	7
+
+#define TRACE_RINGSIZE	256	/* uint8_t indexes */
+
+/* a 32-bit argument, as 2 16-bit ones */
+#define TRACE_L(x)	(uint16_t)(x), (uint16_t)((uint32_t)(x) >> 16)
+
+#define TRACE0(p) do { \
+	if (TRACE_L_##p <= TRACE_LEVEL) \
+		trace_put(TR_##p, 0, NULL); \
+} while (0)
+
+#define TRACE(p, ...) do { \
+	if (TRACE_L_##p <= TRACE_LEVEL) { \
+		uint16_t _trace_args[] = { __VA_ARGS__ }; \
+		trace_put(TR_##p, \
+		    sizeof(_trace_args) / sizeof(_trace_args[0]), \
+		    _trace_args); \
+	} \
+} while (0)
+
+/* main loop context only */
+void trace_put(uint8_t, uint8_t, const uint16_t *);
+void trace_flush(void);
+
+#endif /* _TRACE_H_ */
@@ -0,0 +1,796 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * bmemu: emulates the battmonitor board on a (v)can interface:
+ * address claim, battery status once per second, and the PRIVATE_LOG
+ * journal with the same block layout and request semantics as the
+ * firmware. Frame loss and reply latency can be injected, to test
+ * and benchmark log sync without the hardware.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <net/if.h>
+#ifdef __NetBSD__
+#include <netcan/can.h>
+#else
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <err.h>
+#include <errno.h>
+#include "battlog.h"
+
+#define ISO_ADDRESS_CLAIM	60928U
+#define ISO_REQUEST		59904U
+#define NMEA2000_BATTERY_STATUS	127508U
+#define PRIVATE_LOG		39936U
+#define PRIVATE_LOG_REQUEST_FIRST 0
+#define PRIVATE_LOG_REQUEST_NEXT 1
+#define PRIVATE_LOG_REQUEST	2
+#define PRIVATE_LOG_RESET	9
+#define PRIVATE_LOG_REPLY	10
+#define PRIVATE_LOG_ERROR	11
+#define 	PRIVATE_LOG_ERROR_NOTFOUND 0
+#define 	PRIVATE_LOG_ERROR_LAST 1
+#define PRIVATE_LOG_RESET_MAGIC 0x18e1
+
+#define NMEA2000_ADDR_GLOBAL	255
+#define NMEA2000_ADDR_MAX	252
+#define NMEA2000_PRIORITY_INFO	6
+#define NMEA2000_PRIORITY_ACK	6
+#define NMEA2000_PRIORITY_REQUEST 6
+#define NMEA2000_DATA_FASTLENGTH 223
+
+#define FASTPACKET_IDX_MASK	0x1f
+#define FASTPACKET_ID_MASK	0xe0
+
+/* same as the firmware's nmea2000_user.h */
+#define USER_MANUF		0x7feUL
+#define USER_DEVICE_FUNCTION	141
+#define USER_DEVICE_CLASS	30
+#define USER_INDUSTRY_GROUP	4
+
+#define MAXPENDING		16	/* delayed log requests */
+#define LOG_REPLY_HDRLEN	4	/* cmd, sid, idx */
+
+static int sock;
+static uint8_t myaddr = 128;
+static uint8_t name[8];
+static int claimed;
+
+/* options */
+static int nblocks = LOG_BLOCKS;
+static long prefill = -1;
+static int chanmask = 0x7;
+static double loss;
+static int latency;
+static int interval = 600;
+static int verbose;
+
+/* the journal, as it would be in flash */
+static struct log_block *battlog;
+static int log_cblk;
+static uint8_t log_centry;
+static uint8_t log_gen;
+static u_long flash_writes;
+
+static uint8_t sid;
+static uint8_t fastid;
+
+/* fast packet reassembly of requests */
+static uint8_t logreq_buf[NMEA2000_DATA_FASTLENGTH];
+static int logreq_len;
+static int logreq_id = -1;
+
+static struct pending {
+	uint64_t due;
+	uint8_t saddr;
+	uint8_t cmd;
+	uint8_t sid;
+	uint16_t idx;
+} pending[MAXPENDING];
+static int npending;
+
+static struct stats {
+	u_long frames_tx;
+	u_long frames_lost;
+	u_long frames_rx;
+	u_long requests[3];
+	u_long blocks;
+	u_long entries;
+	u_long errors;
+	/* current sync */
+	uint64_t sync_start;
+	u_long sync_blocks;
+	u_long sync_entries;
+} stats;
+
+static volatile sig_atomic_t quit;
+
+static uint64_t
+now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t
+mkid(int pri, uint32_t pgn, uint8_t dst)
+{
+	uint32_t id;
+
+	id = ((uint32_t)(pri & 0x7) << 26) | (pgn << 8) | myaddr;
+	if (((pgn >> 8) & 0xff) < 240)
+		id = (id & ~0xff00U) | ((uint32_t)dst << 8);
+	return id | CAN_EFF_FLAG;
+}
+
+/* send a frame, or pretend to and lose it */
+static void
+send_frame(struct can_frame *f)
+{
+	if (loss > 0 && drand48() * 100.0 < loss) {
+		stats.frames_lost++;
+		return;
+	}
+	while (write(sock, f, sizeof(*f)) < 0) {
+		if (errno == ENOBUFS || errno == EAGAIN) {
+			usleep(1000);
+			continue;
+		}
+		warn("write");
+		return;
+	}
+	stats.frames_tx++;
+}
+
+static void
+send_single_frame(uint32_t id, const uint8_t *data, int len)
+{
+	struct can_frame f;
+
+	memset(&f, 0, sizeof(f));
+	f.can_id = id;
+	f.can_dlc = len;
+	memcpy(f.data, data, len);
+	send_frame(&f);
+}
+
+static void
+send_fast_frame(uint32_t id, const uint8_t *data, int len)
+{
+	struct can_frame f;
+	int i, n, l;
+
+	fastid = (fastid + 1) & 0x7;
+	for (i = 0, n = 0; i < len; n++) {
+		memset(&f, 0, sizeof(f));
+		f.can_id = id;
+		f.can_dlc = 8;
+		memset(f.data, 0xff, sizeof(f.data));
+		f.data[0] = (fastid << 5) | n;
+		if (n == 0) {
+			f.data[1] = len;
+			l = (len - i > 6) ? 6 : len - i;
+			memcpy(&f.data[2], &data[i], l);
+		} else {
+			l = (len - i > 7) ? 7 : len - i;
+			memcpy(&f.data[1], &data[i], l);
+		}
+		i += l;
+		send_frame(&f);
+	}
+}
+
+static void
+send_address_claim(void)
+{
+	send_single_frame(mkid(NMEA2000_PRIORITY_REQUEST, ISO_ADDRESS_CLAIM,
+	    NMEA2000_ADDR_GLOBAL), name, sizeof(name));
+}
+
+/* synthetic values for channel c at time t (seconds) */
+static void
+battvalues(int c, double t, int *mv10, int *ma, int *tempk100)
+{
+	double day = sin(t * 2 * M_PI / 86400);
+
+	*mv10 = 1260 + (int)(40 * day) - c * 5 + (int)(drand48() * 4);
+	*ma = (int)(8000 * day) + (c + 1) * 150 + (int)(drand48() * 200);
+	*tempk100 = 29315 + (int)(500 * day) + c * 100;
+}
+
+static void
+send_batt_status(int c)
+{
+	int mv10, ma, tk;
+	uint8_t data[8];
+
+	battvalues(c, time(NULL), &mv10, &ma, &tk);
+	data[0] = c;
+	data[1] = mv10 & 0xff;
+	data[2] = (mv10 >> 8) & 0xff;
+	data[3] = (ma / 10) & 0xff;
+	data[4] = ((ma / 10) >> 8) & 0xff;
+	data[5] = tk & 0xff;
+	data[6] = (tk >> 8) & 0xff;
+	data[7] = sid;
+	send_single_frame(mkid(NMEA2000_PRIORITY_INFO, NMEA2000_BATTERY_STATUS,
+	    NMEA2000_ADDR_GLOBAL), data, sizeof(data));
+}
+
+static void
+page_erase(int blk)
+{
+	memset(&battlog[blk], 0xff, sizeof(battlog[blk]));
+	flash_writes++;
+}
+
+static void
+next_log_entry(void)
+{
+	struct log_block *b = &battlog[log_cblk];
+
+	b->b_entry[log_centry].s.nvalid = 0;
+	b->b_flags = log_gen | B_FILL_PART;
+	log_centry++;
+	flash_writes++;
+	if (log_centry == LOG_ENTRIES) {
+		b->b_flags = log_gen | B_FILL_FULL;
+		log_cblk = (log_cblk + 1) % nblocks;
+		log_centry = 0;
+		if (log_cblk == 0) /* rollover; update gen number */
+			log_gen += B_GEN_INC;
+		page_erase(log_cblk);
+	}
+}
+
+static void
+add_log_entry(int c, double t)
+{
+	union log_entry *e = &battlog[log_cblk].b_entry[log_centry];
+	int mv10, ma, tk;
+
+	battvalues(c, t, &mv10, &ma, &tk);
+	itolog(ma, e);
+	utolog(mv10, e);
+	e->s.instance = c;
+	e->s.temp = (tk - 23300) / 100;
+	next_log_entry();
+}
+
+static void
+update_log(double t)
+{
+	for (int c = 0; c < 4; c++) {
+		if (chanmask & (1 << c))
+			add_log_entry(c, t);
+	}
+}
+
+static void
+log_erase(void)
+{
+	for (int c = 0; c < nblocks; c++)
+		page_erase(c);
+	log_cblk = log_centry = log_gen = 0;
+}
+
+/* what the firmware does on boot: a 0 entry marks the boundary */
+static void
+log_boot(void)
+{
+	memset(&battlog[log_cblk].b_entry[log_centry], 0,
+	    sizeof(union log_entry));
+	next_log_entry();
+}
+
+static void
+send_log_block(uint8_t daddr, uint8_t sid, int page)
+{
+	uint8_t buf[NMEA2000_DATA_FASTLENGTH];
+	uint16_t idx;
+	int c, i, len, r = 0;
+
+	c = 0;
+	while (c < LOG_ENTRIES && r == 0) {
+		len = LOG_REPLY_HDRLEN;
+		idx = ((uint16_t)(battlog[page].b_flags & B_FILL_GEN) << 8) |
+		    page;
+		for (i = 0; c < LOG_ENTRIES; c++) {
+			if (battlog[page].b_entry[c].s.nvalid == 1) {
+				idx |= 0x100;
+				r++;
+				break;
+			}
+			memcpy(&buf[len], battlog[page].b_entry[c].data,
+			    sizeof(union log_entry));
+			len += sizeof(union log_entry);
+			i++;
+			if (len >= (NMEA2000_DATA_FASTLENGTH -
+			    sizeof(union log_entry))) {
+				c++;
+				break;
+			}
+		}
+		if (c == LOG_ENTRIES)
+			idx |= 0x100;
+		buf[0] = PRIVATE_LOG_REPLY;
+		buf[1] = sid;
+		buf[2] = idx & 0xff;
+		buf[3] = idx >> 8;
+		send_fast_frame(mkid(NMEA2000_PRIORITY_ACK, PRIVATE_LOG, daddr),
+		    buf, len);
+		stats.entries += i;
+		stats.sync_entries += i;
+	}
+	stats.blocks++;
+	stats.sync_blocks++;
+}
+
+static void
+send_log_error(uint8_t daddr, uint8_t sid, uint8_t code)
+{
+	uint8_t buf[3];
+
+	buf[0] = PRIVATE_LOG_ERROR;
+	buf[1] = sid;
+	buf[2] = code;
+	send_fast_frame(mkid(NMEA2000_PRIORITY_ACK, PRIVATE_LOG, daddr),
+	    buf, sizeof(buf));
+	stats.errors++;
+	if (code == PRIVATE_LOG_ERROR_LAST && stats.sync_start != 0) {
+		double s = (now_ms() - stats.sync_start) / 1000.0;
+		printf("sync: %lu blocks %lu entries in %.3fs (%.0f entries/s)\n",
+		    stats.sync_blocks, stats.sync_entries, s,
+		    s > 0 ? stats.sync_entries / s : 0);
+		stats.sync_start = 0;
+	}
+}
+
+/* same logic as handle_log_request() in battmonitor/main.c */
+static void
+handle_log_request(uint8_t daddr, uint8_t cmd, uint8_t sid, uint16_t idx)
+{
+	uint8_t gen = (idx & 0xff00) >> 8;
+	int page = idx & 0xff;
+	int i;
+
+	if (verbose)
+		printf("log request %d sid %d gen %d page %d\n",
+		    cmd, sid, gen, page);
+	stats.requests[cmd]++;
+
+	if (cmd == PRIVATE_LOG_REQUEST_FIRST) {
+		stats.sync_start = now_ms();
+		stats.sync_blocks = stats.sync_entries = 0;
+		/* look for first log entry - usually next page */
+		for (i = 0, page = (log_cblk + 1) % nblocks;
+		    i < nblocks; page = (page + 1) % nblocks, i++) {
+			if ((battlog[page].b_flags & B_FILL_STAT) !=
+			    B_FILL_FREE)
+				break;
+		}
+		if (i == nblocks) {
+			send_log_error(daddr, sid, PRIVATE_LOG_ERROR_NOTFOUND);
+			return;
+		}
+		send_log_block(daddr, sid, page);
+		return;
+	}
+	if (page >= nblocks ||
+	    (battlog[page].b_flags & B_FILL_GEN) != gen ||
+	    (battlog[page].b_flags & B_FILL_STAT) == B_FILL_FREE) {
+		send_log_error(daddr, sid, PRIVATE_LOG_ERROR_NOTFOUND);
+		return;
+	}
+	if (cmd == PRIVATE_LOG_REQUEST) {
+		send_log_block(daddr, sid, page);
+		return;
+	}
+	if (page == log_cblk) {
+		send_log_error(daddr, sid, PRIVATE_LOG_ERROR_LAST);
+		return;
+	}
+	page = (page + 1) % nblocks;
+	if ((battlog[page].b_flags & B_FILL_STAT) == B_FILL_FREE) {
+		send_log_error(daddr, sid, PRIVATE_LOG_ERROR_LAST);
+		return;
+	}
+	send_log_block(daddr, sid, page);
+}
+
+static void
+queue_log_request(uint8_t saddr)
+{
+	struct pending *p;
+
+	if (npending == MAXPENDING) {
+		printf("too many pending requests, dropped\n");
+		return;
+	}
+	p = &pending[npending++];
+	p->due = now_ms() + latency;
+	p->saddr = saddr;
+	p->cmd = logreq_buf[0];
+	p->sid = logreq_buf[1];
+	p->idx = logreq_buf[2] | ((uint16_t)logreq_buf[3] << 8);
+}
+
+static void
+run_pending(void)
+{
+	uint64_t now = now_ms();
+	int i;
+
+	for (i = 0; i < npending; ) {
+		if (pending[i].due > now) {
+			i++;
+			continue;
+		}
+		handle_log_request(pending[i].saddr, pending[i].cmd,
+		    pending[i].sid, pending[i].idx);
+		memmove(&pending[i], &pending[i + 1],
+		    (npending - i - 1) * sizeof(pending[0]));
+		npending--;
+	}
+}
+
+static void
+private_log_receive(const struct can_frame *f, uint8_t saddr, uint8_t daddr)
+{
+	uint8_t idx = f->data[0] & FASTPACKET_IDX_MASK;
+	uint8_t id = f->data[0] & FASTPACKET_ID_MASK;
+	int i, j;
+
+	if (idx == 0) {
+		logreq_id = id;
+		logreq_len = f->data[1];
+		for (i = 0; i < 6 && i < logreq_len; i++)
+			logreq_buf[i] = f->data[i + 2];
+		if (logreq_len > 6)
+			return;
+	} else if (id == logreq_id) {
+		for (i = idx * 7 - 1, j = 1;
+		    i < logreq_len && i < (int)sizeof(logreq_buf) && j < 8;
+		    i++, j++)
+			logreq_buf[i] = f->data[j];
+		if (i < logreq_len)
+			return;
+	} else {
+		return;
+	}
+	logreq_id = -1;
+
+	switch(logreq_buf[0]) {
+	case PRIVATE_LOG_REQUEST:
+	case PRIVATE_LOG_REQUEST_FIRST:
+	case PRIVATE_LOG_REQUEST_NEXT:
+		queue_log_request(saddr);
+		break;
+	case PRIVATE_LOG_RESET:
+		printf("log reset from %d ", saddr);
+		if (daddr != myaddr) {
+			printf("ignored, wrong daddr %d\n", daddr);
+		} else if ((logreq_buf[2] | (logreq_buf[3] << 8)) !=
+		    PRIVATE_LOG_RESET_MAGIC) {
+			printf("ignored, wrong magic\n");
+		} else {
+			log_erase();
+			log_boot();
+			printf("done\n");
+		}
+		break;
+	default:
+		printf("wrong log cmd %d from %d\n", logreq_buf[0], saddr);
+	}
+}
+
+static void
+handle_address_claim(const struct can_frame *f)
+{
+	for (int i = 7; i >= 0; i--) {
+		if (f->data[i] < name[i]) {
+			/* we loose */
+			myaddr++;
+			if (myaddr >= NMEA2000_ADDR_MAX)
+				myaddr = 0;
+			printf("address conflict, trying %d\n", myaddr);
+			send_address_claim();
+			return;
+		}
+		if (f->data[i] > name[i])
+			break;
+	}
+	/* defend our address */
+	send_address_claim();
+}
+
+static void
+receive(void)
+{
+	struct can_frame f;
+	uint32_t pgn;
+	uint8_t saddr, daddr, pf;
+
+	if (read(sock, &f, sizeof(f)) != sizeof(f))
+		return;
+	if ((f.can_id & CAN_EFF_FLAG) == 0)
+		return;
+	stats.frames_rx++;
+	if (loss > 0 && drand48() * 100.0 < loss)
+		return;
+	saddr = f.can_id & 0xff;
+	pf = (f.can_id >> 16) & 0xff;
+	if (pf < 240) {
+		pgn = (f.can_id >> 8) & 0x3ff00;
+		daddr = (f.can_id >> 8) & 0xff;
+		if (daddr != myaddr && daddr != NMEA2000_ADDR_GLOBAL)
+			return;
+	} else {
+		pgn = (f.can_id >> 8) & 0x3ffff;
+		daddr = NMEA2000_ADDR_GLOBAL;
+	}
+
+	switch(pgn) {
+	case ISO_ADDRESS_CLAIM:
+		if (saddr == myaddr)
+			handle_address_claim(&f);
+		break;
+	case ISO_REQUEST:
+	    {
+		uint32_t rpgn;
+
+		if (f.can_dlc < 3)
+			break;
+		rpgn = f.data[0] | (f.data[1] << 8) |
+		    ((uint32_t)f.data[2] << 16);
+		if (rpgn == ISO_ADDRESS_CLAIM) {
+			send_address_claim();
+		} else if (rpgn == NMEA2000_BATTERY_STATUS && claimed) {
+			for (int c = 0; c < 4; c++) {
+				if (chanmask & (1 << c))
+					send_batt_status(c);
+			}
+		}
+		break;
+	    }
+	case PRIVATE_LOG:
+		if (claimed)
+			private_log_receive(&f, saddr, daddr);
+		break;
+	}
+}
+
+static void
+prefill_log(void)
+{
+	int nchan = 0;
+	double t;
+
+	for (int c = 0; c < 4; c++) {
+		if (chanmask & (1 << c))
+			nchan++;
+	}
+	if (prefill < 0) {
+		/* enough to wrap the ring once */
+		prefill = (long)nblocks * LOG_ENTRIES / nchan;
+	}
+	t = time(NULL) - (double)prefill * interval;
+	for (long i = 0; i < prefill; i++, t += interval)
+		update_log(t);
+	printf("log: %ld records, current block %d entry %d gen 0x%x\n",
+	    prefill, log_cblk, log_centry, log_gen);
+}
+
+static void
+onsig(int s)
+{
+	quit = 1;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: bmemu [-v] [-i ifname] [-b blocks] "
+	    "[-n records] [-c chanmask]\n"
+	    "\t[-l loss%%] [-d latency_ms] [-t log_interval_s] "
+	    "[-a address] [-u uniquenumber] [-s seed]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *ifname = "vcan0";
+	struct ifreq ifr;
+	struct sockaddr_can addr;
+	u_long uniquenumber = getpid();
+	long seed = time(NULL);
+	uint64_t now, next_sec, claim_time, next_log;
+	struct timeval tv;
+	fd_set rset;
+	int ch, ms;
+
+	while ((ch = getopt(argc, argv, "a:b:c:d:i:l:n:s:t:u:v")) != -1) {
+		switch(ch) {
+		case 'a':
+			myaddr = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			nblocks = strtol(optarg, NULL, 0);
+			/* the request index has 8 bits for the page */
+			if (nblocks < 2 || nblocks > 256)
+				errx(1, "blocks must be between 2 and 256");
+			break;
+		case 'c':
+			chanmask = strtol(optarg, NULL, 0) & 0xf;
+			if (chanmask == 0)
+				errx(1, "no channel enabled");
+			break;
+		case 'd':
+			latency = strtol(optarg, NULL, 0);
+			break;
+		case 'i':
+			ifname = optarg;
+			break;
+		case 'l':
+			loss = strtod(optarg, NULL);
+			break;
+		case 'n':
+			prefill = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			interval = strtol(optarg, NULL, 0);
+			if (interval < 1)
+				errx(1, "bad log interval");
+			break;
+		case 'u':
+			uniquenumber = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose++;
+			break;
+		default:
+			usage();
+		}
+	}
+	srand48(seed);
+
+	name[0] = uniquenumber & 0xff;
+	name[1] = (uniquenumber >> 8) & 0xff;
+	name[2] = ((uniquenumber >> 16) & 0x1f) | ((USER_MANUF << 5) & 0xe0);
+	name[3] = USER_MANUF >> 3;
+	name[4] = 0; /* device instance */
+	name[5] = USER_DEVICE_FUNCTION;
+	name[6] = USER_DEVICE_CLASS << 1;
+	name[7] = 0x80 | (USER_INDUSTRY_GROUP << 4);
+
+	if ((battlog = calloc(nblocks, sizeof(struct log_block))) == NULL)
+		err(1, "calloc");
+	log_erase();
+	prefill_log();
+	log_boot();
+	flash_writes = 0;
+
+	if ((sock = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0)
+		err(1, "socket");
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
+	if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0)
+		err(1, "%s", ifname);
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifr.ifr_ifindex;
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		err(1, "bind %s", ifname);
+
+	signal(SIGINT, onsig);
+	signal(SIGTERM, onsig);
+
+	send_address_claim();
+	now = now_ms();
+	claim_time = now + 250;
+	next_sec = now + 1000;
+	next_log = now + (uint64_t)interval * 1000;
+
+	while (!quit) {
+		now = now_ms();
+		if (!claimed && now >= claim_time) {
+			claimed = 1;
+			printf("address %d\n", myaddr);
+		}
+		if (now >= next_sec) {
+			next_sec += 1000;
+			sid = (sid + 1) % 253;
+			for (int c = 0; claimed && c < 4; c++) {
+				if (chanmask & (1 << c))
+					send_batt_status(c);
+			}
+		}
+		if (now >= next_log) {
+			next_log += (uint64_t)interval * 1000;
+			update_log(time(NULL));
+			if (verbose)
+				printf("log entry %d/%d\n",
+				    log_cblk, log_centry);
+		}
+		run_pending();
+
+		now = now_ms();
+		ms = next_sec - now;
+		if (!claimed && claim_time - now < (uint64_t)ms)
+			ms = claim_time - now;
+		for (int i = 0; i < npending; i++) {
+			if (pending[i].due < now)
+				ms = 0;
+			else if (pending[i].due - now < (uint64_t)ms)
+				ms = pending[i].due - now;
+		}
+		if (ms < 0)
+			ms = 0;
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = (ms % 1000) * 1000;
+		FD_ZERO(&rset);
+		FD_SET(sock, &rset);
+		if (select(sock + 1, &rset, NULL, NULL, &tv) < 0) {
+			if (errno == EINTR)
+				continue;
+			err(1, "select");
+		}
+		if (FD_ISSET(sock, &rset))
+			receive();
+	}
+	printf("frames: rx %lu tx %lu lost %lu\n",
+	    stats.frames_rx, stats.frames_tx, stats.frames_lost);
+	printf("requests: first %lu next %lu block %lu, "
+	    "%lu blocks %lu entries sent, %lu errors\n",
+	    stats.requests[PRIVATE_LOG_REQUEST_FIRST],
+	    stats.requests[PRIVATE_LOG_REQUEST_NEXT],
+	    stats.requests[PRIVATE_LOG_REQUEST],
+	    stats.blocks, stats.entries, stats.errors);
+	printf("flash page writes: %lu\n", flash_writes);
+	return 0;
+}
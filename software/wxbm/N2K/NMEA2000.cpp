@@ -31,6 +31,12 @@
 #include <sys/select.h>
 #include <sys/time.h>
 #include <net/if.h>
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#endif
+#include <unistd.h>
+#include <inttypes.h>
+#include <algorithm>
 
 #include <wx/wx.h>
 
@@ -39,41 +45,116 @@
 #include "nmea2000_defs_tx.h"
 #include "nmea2000_defs_rx.h"
 #include "NMEA2000Properties.h"
+#include "nmea2000_capture.h"
 
 nmea2000 *nmea2000P;
 
-nmea2000::nmea2000(void) {
+nmea2000::nmea2000(void) :
+    claim_timer(std::bind(&nmea2000::claim_timeout, this)),
+    txq(std::bind(&nmea2000::wakeup, this))
+{
     myaddress = 0x80;
     srandom(time(NULL));
     // the following may be overriden by the config file
     uniquenumber = random() & 0x1fffff;
     deviceinstance = 0;
     manufcode = 0x7ff;
+    lat_count = 0;
+    lat_sum = 0;
+    lat_max = 0;
+    lat_hw = 0;
+    memset(names, 0, sizeof(names));
+    memset(name_req, 0, sizeof(name_req));
+    capture = NULL;
+    replay = NULL;
+    replay_fast = false;
 
     nmea2000_rxP = new nmea2000_rx;
     nmea2000_txP = new nmea2000_tx;
+
+    /* used to get the N2K thread out of select() */
+    if (pipe(wakefd) < 0) {
+	wxLogSysError(wxbm::ErrMsgPrefix() + _T("create wakeup pipe"));
+	wakefd[0] = wakefd[1] = -1;
+    } else {
+	fcntl(wakefd[0], F_SETFL, O_NONBLOCK);
+	fcntl(wakefd[1], F_SETFL, O_NONBLOCK);
+    }
 }
 
 nmea2000::~nmea2000(void)
 {
     if (GetThread() &&
 	GetThread()->IsRunning()) {
+	wakeup();
 	GetThread()->Delete();
 	GetThread()->Wait();
     }
-    close(sock);
+    report();
+    if (replay == NULL)
+	close(sock);
+    delete capture;
+    delete replay;
+    close(wakefd[0]);
+    close(wakefd[1]);
     delete nmea2000_rxP;
     delete nmea2000_txP;
 }
 
+void nmea2000::wakeup()
+{
+    char c = 0;
+
+    if (wakefd[1] >= 0)
+	(void)write(wakefd[1], &c, 1);
+}
+
+bool nmea2000::setrecord(const wxString &path)
+{
+    capture = new nmea2000_capture;
+    if (!capture->open(path.c_str())) {
+	delete capture;
+	capture = NULL;
+	return false;
+    }
+    return true;
+}
+
+bool nmea2000::setreplay(const wxString &path, bool fast)
+{
+    replay = new nmea2000_replay;
+    if (!replay->open(path.c_str())) {
+	delete replay;
+	replay = NULL;
+	return false;
+    }
+    replay_fast = fast;
+    return true;
+}
+
 void nmea2000::Init() {
 
     state = UNCONF;
 
+    if (replay != NULL) {
+	/* no bus: frames come from the capture file */
+	sock = -1;
+	nmea2000_txP->setsrc(myaddress);
+	state = CLAIMED;
+	if (CreateThread(wxTHREAD_JOINABLE) != wxTHREAD_NO_ERROR ||
+	    GetThread()->Run() != wxTHREAD_NO_ERROR) {
+	    wxLogError(wxbm::ErrMsgPrefix() + _T("Could not run the management thread"));
+	}
+	return;
+    }
+
     if ((sock = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
 	wxLogSysError(wxbm::ErrMsgPrefix() + _T("create CAN socket"));
 	return;
     }
+    /* frames are sent from the txq, which handles EAGAIN */
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    enable_timestamps();
     nmea2000_txP->setsrc(myaddress);
     nmea2000_txP->iso_address_claim.setdst(NMEA2000_ADDR_GLOBAL);
     nmea2000_txP->iso_address_claim.setdata(uniquenumber, manufcode, 130, 120, deviceinstance, 0);
@@ -89,8 +170,71 @@ void nmea2000::Init() {
     }
 }
 
+/*
+ * ask the kernel to timestamp received frames, so that data time
+ * doesn't depend on how fast we're scheduled. Hardware timestamps
+ * are returned when the driver has them enabled (SIOCSHWTSTAMP needs
+ * privileges, so it's left to the system configuration).
+ */
+void nmea2000::enable_timestamps()
+{
+    int on = 1;
+#ifdef SO_TIMESTAMPING
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+	SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING,
+	&flags, sizeof(flags)) == 0)
+	return;
+#endif
+#ifdef SO_TIMESTAMPNS
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0)
+	return;
+#endif
+#ifdef SO_TIMESTAMP
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) == 0)
+	return;
+#endif
+    (void)on;
+    wxLogSysError(wxbm::ErrMsgPrefix() + _T("can't enable CAN timestamps"));
+}
+
+void nmea2000::getlatency(u_long *n, long *avg, long *max)
+{
+	*n = lat_count;
+	*avg = lat_count ? (long)(lat_sum / lat_count) : 0;
+	*max = lat_max;
+}
+
+/* on exit: the latency and transmit queue counters */
+void nmea2000::report(void)
+{
+	u_long n;
+	long avg, max;
+	const nmea2000_desc *d;
+	nmea2000_txstats_t st;
+
+	getlatency(&n, &avg, &max);
+	if (n > 0) {
+		printf("rx: %lu frames (%lu with hardware time), "
+		    "latency %ldus avg %ldus max\n", n, lat_hw, avg, max);
+	}
+	/* the PGNs we queued frames for */
+	for (int i = 0; (d = get_tx_byindex(i)) != NULL; i++) {
+		if (!gettxstats(d->pgn, &st))
+			continue;
+		printf("tx %6d %-24s: %lu frames sent, %lu frames dropped, "
+		    "max depth %u\n", d->pgn, d->descr, st.sent, st.dropped,
+		    st.maxdepth);
+	}
+}
+
 wxThread::ExitCode nmea2000::Entry()
 {
+    if (replay != NULL) {
+	replay_run();
+	return (wxThread::ExitCode)0;
+    }
 
     while (!GetThread()->TestDestroy()) {
 	switch(state) {
@@ -104,67 +248,179 @@ wxThread::ExitCode nmea2000::Entry()
 	        }
 	        break;
 	case DOCLAIM:
-		if (nmea2000_txP->iso_address_claim.send(sock)) {
+		if (nmea2000_txP->iso_address_claim.send()) {
 			state = CLAIMING;
-			gettimeofday(&claim_date, NULL);
+			claim_timer.schedule(1000);
 		} else {
 			std::cerr << "failed to send claim " << std::endl;
 			sleep(1);
 		}
 		break;
 	case CLAIMING:
-		struct timeval tv;
-		struct timeval tv2;
-		// poll checking for addr claim, and timeout
-		gettimeofday(&tv, NULL);
-		timersub(&tv, &claim_date, &tv2);
-		if (tv2.tv_sec >= 1) {
-			std::cout << "NMEA200 address " << myaddress << std::endl;
-			state = CLAIMED;
-		}
-		/* FALLTHROUGH */
 	case CLAIMED:
 		// normal operation
-		struct timeval timeout;
-		fd_set read_set;
-		int sret;
+		poll();
+		break;
+	default:
+		sleep(1);
+	}
 
-		timeout.tv_sec=1;
-		timeout.tv_usec = 0;
+    }
+    return (wxThread::ExitCode)0;
+}
 
-		FD_ZERO(&read_set);
-		FD_SET(sock, &read_set);
-		sret = select(sock + 1, &read_set, NULL, NULL, &timeout);
-		switch(sret) {
-		case -1:
+void nmea2000::poll()
+{
+	fd_set read_set, write_set;
+	int maxfd;
+	int sret;
+
+	FD_ZERO(&read_set);
+	FD_ZERO(&write_set);
+	FD_SET(sock, &read_set);
+	if (txq.wantwrite())
+		FD_SET(sock, &write_set);
+	FD_SET(timers.getfd(), &read_set);
+	maxfd = std::max(sock, timers.getfd());
+	if (wakefd[0] >= 0) {
+		FD_SET(wakefd[0], &read_set);
+		maxfd = std::max(maxfd, wakefd[0]);
+	}
+	/* no timeout: the timerfd wakes us up when something is due */
+	sret = select(maxfd + 1, &read_set, &write_set, NULL, NULL);
+	if (sret < 0) {
+		if (errno != EINTR)
 			wxLogSysError(wxbm::ErrMsgPrefix() + _T("select"));
+		return;
+	}
+	if (FD_ISSET(sock, &read_set)) {
+		nmea2000_frame n2kframe;
+		int rret = n2kframe.readframe(sock);
+		switch(rret) {
+		case -1:
+			if (errno == EAGAIN || errno == EINTR)
+				break;
+			wxLogSysError(wxbm::ErrMsgPrefix() + _T("read CAN socket"));
 			break;
 		case 0:
-			nmea2000_rxP->tick();
+			/* EOF ? */
 			break;
 		default:
-			nmea2000_frame n2kframe;
-			int rret = n2kframe.readframe(sock);
-			switch(rret) {
-			case -1:
-				wxLogSysError(wxbm::ErrMsgPrefix() + _T("read CAN socket"));
-				break;
-			case 0:
-				/* EOF ? */
-				break;
-			default:
-				parse_frame(n2kframe);
-				break;
-			}
-			nmea2000_rxP->tick();
+		    {
+			if (capture != NULL)
+				capture->record(n2kframe);
+			parse_frame(n2kframe);
+			long d = n2kframe.rxdelay();
+			lat_count++;
+			lat_sum += d;
+			if (d > lat_max)
+				lat_max = d;
+			if (n2kframe.gethwts().tv_sec != 0)
+				lat_hw++;
+			break;
+		    }
 		}
-		break;
-	default:
-		sleep(1);
 	}
+	if (wakefd[0] >= 0 && FD_ISSET(wakefd[0], &read_set)) {
+		char buf[16];
+		while (read(wakefd[0], buf, sizeof(buf)) > 0)
+			; /* drain */
+	}
+	if (FD_ISSET(sock, &write_set))
+		txq.writable();
+	/* handlers may have scheduled timers for "now" */
+	timers.run();
+	/* and queued frames */
+	txq.flush(sock);
+}
 
-    }
-    return (wxThread::ExitCode)0;
+/*
+ * wait for the deadline (or a wakeup if NULL), running timers. Frames
+ * queued for transmission are dropped, there's no bus to send them to.
+ */
+void nmea2000::replay_idle(const struct timespec *deadline)
+{
+	struct timespec now;
+	struct timeval tv, *tvp;
+	fd_set read_set;
+	int maxfd;
+	long us;
+
+	for (;;) {
+		tvp = NULL;
+		if (deadline != NULL) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			us = (deadline->tv_sec - now.tv_sec) * 1000000L +
+			    (deadline->tv_nsec - now.tv_nsec) / 1000;
+			if (us <= 0)
+				return;
+			tv.tv_sec = us / 1000000;
+			tv.tv_usec = us % 1000000;
+			tvp = &tv;
+		}
+		FD_ZERO(&read_set);
+		FD_SET(timers.getfd(), &read_set);
+		maxfd = timers.getfd();
+		if (wakefd[0] >= 0) {
+			FD_SET(wakefd[0], &read_set);
+			maxfd = std::max(maxfd, wakefd[0]);
+		}
+		if (select(maxfd + 1, &read_set, NULL, NULL, tvp) > 0 &&
+		    wakefd[0] >= 0 && FD_ISSET(wakefd[0], &read_set)) {
+			char buf[16];
+			while (read(wakefd[0], buf, sizeof(buf)) > 0)
+				; /* drain */
+		}
+		timers.run();
+		txq.purge();
+		if (deadline == NULL || GetThread()->TestDestroy())
+			return;
+	}
+}
+
+void nmea2000::replay_run()
+{
+	struct can_frame cf;
+	struct timespec ts, first, start, end, due;
+	long long ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (!GetThread()->TestDestroy() && replay->next(&cf, &ts)) {
+		if (replay->getcount() == 1)
+			first = ts;
+		if (!replay_fast) {
+			/* same spacing as on the bus */
+			ns = (ts.tv_sec - first.tv_sec) * 1000000000LL +
+			    (ts.tv_nsec - first.tv_nsec);
+			ns += start.tv_nsec;
+			due.tv_sec = start.tv_sec + ns / 1000000000LL;
+			due.tv_nsec = ns % 1000000000LL;
+			replay_idle(&due);
+		}
+		nmea2000_frame n2kframe(&cf);
+		n2kframe.setts(ts);
+		parse_frame(n2kframe);
+		timers.run();
+		txq.purge();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("replay: %lu frames in %.3fs\n", replay->getcount(),
+	    (end.tv_sec - start.tv_sec) +
+	    (end.tv_nsec - start.tv_nsec) / 1e9);
+	/* keep timers running for the GUI side */
+	while (!GetThread()->TestDestroy())
+		replay_idle(NULL);
+}
+
+void nmea2000::claim_timeout()
+{
+	if (state != CLAIMING)
+		return;
+	std::cout << "NMEA200 address " << myaddress << std::endl;
+	state = CLAIMED;
+	/* learn who is on the bus */
+	nmea2000_txP->iso_request.sendreq(NMEA2000_ADDR_GLOBAL,
+	    ISO_ADDRESS_CLAIM);
 }
 
 bool nmea2000::configure()
@@ -196,14 +452,17 @@ bool nmea2000::configure()
 
 void nmea2000::parse_frame(const nmea2000_frame &n2kf)
 {
-	if (n2kf.is_pdu1() &&
+	/* on replay, we're not who the frames were sent to */
+	if (n2kf.is_pdu1() && replay == NULL &&
 	    n2kf.getdst() != myaddress &&
 	    n2kf.getdst() != NMEA2000_ADDR_GLOBAL) {
 		return;
 	}
 	switch(n2kf.getpgn()) {
 	case ISO_ADDRESS_CLAIM:
-		handle_address_claim(n2kf);
+		handle_name(n2kf);
+		if (replay == NULL)
+			handle_address_claim(n2kf);
 		break;
 	case ISO_REQUEST:
 		handle_iso_request(n2kf);
@@ -233,10 +492,46 @@ void nmea2000::handle_address_claim(const nmea2000_frame &n2kf)
 		break;
 	}
 	// defend our address. if we can't right now restart the whole process
-	if (!nmea2000_txP->iso_address_claim.send(sock))
+	if (!nmea2000_txP->iso_address_claim.send())
 		state = DOCLAIM;
 }
 
+/* record the NAME of the device at this address */
+void nmea2000::handle_name(const nmea2000_frame &n2kf)
+{
+	int src = n2kf.getsrc();
+	uint64_t name;
+
+	if (src >= NMEA2000_ADDR_NULL || n2kf.getlen() < 8)
+		return;
+	if (src == myaddress && replay == NULL)
+		return; /* a conflict, see handle_address_claim() */
+	name = n2kf.frame2uint32(0) | ((uint64_t)n2kf.frame2uint32(4) << 32);
+	if (names[src] == name)
+		return;
+	/* a device which changed address doesn't hold the old one */
+	for (int i = 0; i < NMEA2000_ADDR_NULL; i++) {
+		if (names[i] == name)
+			names[i] = 0;
+	}
+	names[src] = name;
+	printf("address %d: NAME 0x%016" PRIx64 "\n", src, name);
+}
+
+bool nmea2000::request_name(int addr)
+{
+	time_t now = time(NULL);
+
+	if (replay != NULL || state != CLAIMED)
+		return false;
+	if (addr < 0 || addr >= NMEA2000_ADDR_NULL)
+		return false;
+	if (now - name_req[addr] < NAME_REQ_INTERVAL)
+		return true; /* already asked */
+	name_req[addr] = now;
+	return nmea2000_txP->iso_request.sendreq(addr, ISO_ADDRESS_CLAIM);
+}
+
 void nmea2000::handle_iso_request(const nmea2000_frame &n2kf)
 {
 	int pgn;
@@ -247,7 +542,7 @@ void nmea2000::handle_iso_request(const nmea2000_frame &n2kf)
 	if (nmea2000_txP->get_bypgn(pgn) < 0) {
 		return;
 	}
-	nmea2000_txP->send_frame(sock, pgn);
+	nmea2000_txP->send_frame(pgn);
 }
 
 void nmea2000::OnThreadUpdate(wxThreadEvent& evt) {
@@ -269,7 +564,7 @@ bool nmea2000::send_bypgn(int pgn, bool force) {
 	if (state != CLAIMED)
 		return false;
 
-	return nmea2000_txP->send_frame(sock, pgn, force);
+	return nmea2000_txP->send_frame(pgn, force);
 }
 
 void nmea2000::tx_enable(int i, bool en) {
@@ -35,11 +35,15 @@
 #include "wx/wx.h"
 #endif  // precompiled headers
 #include "nmea2000_defs.h"
+#include "nmea2000_timer.h"
+#include "nmea2000_txqueue.h"
 
 class nmea2000_frame;
 class nmea2000_rx;
 class nmea2000_tx;
 class nmea2000_frame_tx;
+class nmea2000_capture;
+class nmea2000_replay;
 
 class nmea2000 : public wxThreadHelper {
    public:
@@ -50,6 +54,9 @@ class nmea2000 : public wxThreadHelper {
 
     inline void setcanif(wxString ifn) {canif = ifn;}
     inline wxString getcanif() {return canif;}
+    /* must be called before Init() */
+    bool setrecord(const wxString &path);
+    bool setreplay(const wxString &path, bool fast);
     int getaddress(void) { return (state == CLAIMED) ? myaddress : -1; }
     inline void getconfig(int *un, int * di, int *mf)
 	{ *un = uniquenumber; *di = deviceinstance; *mf = manufcode; }
@@ -63,6 +70,18 @@ class nmea2000 : public wxThreadHelper {
     const nmea2000_desc *get_rx_byindex(int);
     int get_rx_bypgn(int);
     void rx_enable(int, bool);
+    inline nmea2000_timerwheel *gettimers(void) { return &timers; }
+    inline nmea2000_txqueue *gettxq(void) { return &txq; }
+    /* per-PGN transmit queue depth/sent/drop counters */
+    inline bool gettxstats(int pgn, nmea2000_txstats_t *st)
+	{ return txq.getstats(pgn, st); }
+    /* frames handled, mean and max kernel-to-handled delay (us) */
+    void getlatency(u_long *n, long *avg, long *max);
+    /* ISO NAME claimed by addr, 0 if unknown */
+    inline uint64_t getname(int addr) const
+	{ return (addr >= 0 && addr < NMEA2000_ADDR_NULL) ? names[addr] : 0; }
+    /* from the N2K thread: ask addr for its NAME. false if we can't */
+    bool request_name(int addr);
 
   protected:
     virtual wxThread::ExitCode Entry();
@@ -70,6 +89,7 @@ class nmea2000 : public wxThreadHelper {
 
   private:
     int sock;
+    int wakefd[2];
     int myaddress;
     wxString canif;
     int deviceinstance;
@@ -80,10 +100,31 @@ class nmea2000 : public wxThreadHelper {
     enum {
 	UNCONF, DOINGCONF, DOCLAIM, CLAIMING, CLAIMED
     } state;
-    struct timeval claim_date;
+    nmea2000_timerwheel timers;
+    nmea2000_timer claim_timer;
+    nmea2000_txqueue txq;
+    void wakeup(void);
+    void claim_timeout(void);
+    void poll(void);
+    nmea2000_capture *capture;
+    nmea2000_replay *replay;
+    bool replay_fast;
+    void replay_run(void);
+    void replay_idle(const struct timespec *);
+    void enable_timestamps(void);
+    u_long lat_count;
+    long long lat_sum;
+    long lat_max;
+    u_long lat_hw; /* frames with a hardware timestamp */
+    void report(void);
+    /* address claims from the other devices */
+    uint64_t names[NMEA2000_ADDR_NULL];
+    time_t name_req[NMEA2000_ADDR_NULL]; /* last request_name() */
+#define NAME_REQ_INTERVAL 5 /* s */
     bool configure();
     void parse_frame(const nmea2000_frame &);
     void handle_address_claim(const nmea2000_frame &);
+    void handle_name(const nmea2000_frame &);
     void handle_iso_request(const nmea2000_frame &);
     bool send_address_claim();
 };
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <wx/wx.h>
+
+#include <wxbm.h>
+#include "NMEA2000.h"
+#include "nmea2000_capture.h"
+
+static inline void
+put_le(uint8_t *p, uint64_t v, int n)
+{
+	for (int i = 0; i < n; i++) {
+		p[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+static inline uint64_t
+get_le(const uint8_t *p, int n)
+{
+	uint64_t v = 0;
+
+	for (int i = n - 1; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+nmea2000_capture::nmea2000_capture() :
+    flush_timer(std::bind(&nmea2000_capture::flush, this))
+{
+	fd = -1;
+	len = 0;
+	nrecords = 0;
+}
+
+nmea2000_capture::~nmea2000_capture()
+{
+	close();
+}
+
+bool
+nmea2000_capture::open(const char *path)
+{
+	uint8_t *p;
+
+	fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		wxLogSysError(wxbm::ErrMsgPrefix() +
+		    _T("can't create capture file %s"), path);
+		return false;
+	}
+	p = reserve(N2KCAP_HDRLEN);
+	memcpy(p, N2KCAP_MAGIC, N2KCAP_MAGIC_LEN);
+	put_le(&p[N2KCAP_MAGIC_LEN], N2KCAP_VERSION, 2);
+	return true;
+}
+
+void
+nmea2000_capture::close(void)
+{
+	if (fd < 0)
+		return;
+	flush();
+	::close(fd);
+	fd = -1;
+	printf("capture: %lu frames\n", nrecords);
+}
+
+/* room for len bytes at the end of the buffer */
+uint8_t *
+nmea2000_capture::reserve(size_t l)
+{
+	uint8_t *p;
+
+	if (len + l > sizeof(buf))
+		flush();
+	p = &buf[len];
+	len += l;
+	return p;
+}
+
+void
+nmea2000_capture::flush(void)
+{
+	size_t off = 0;
+	ssize_t r;
+
+	flush_timer.cancel();
+	while (off < len && fd >= 0) {
+		r = write(fd, &buf[off], len - off);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			wxLogSysError(wxbm::ErrMsgPrefix() +
+			    _T("write capture file"));
+			::close(fd);
+			fd = -1;
+			break;
+		}
+		off += r;
+	}
+	len = 0;
+}
+
+void
+nmea2000_capture::record(const nmea2000_frame &f)
+{
+	const struct timespec &ts = f.getts();
+	int dlc = f.getlen();
+	uint8_t *p;
+
+	if (fd < 0)
+		return;
+	if (dlc > 8)
+		dlc = 8;
+	if (len == 0)
+		flush_timer.schedule(N2KCAP_FLUSH_MS);
+	p = reserve(N2KCAP_RECHDRLEN + dlc);
+	put_le(&p[0], (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec, 8);
+	put_le(&p[8], f.getid(), 4);
+	p[12] = dlc;
+	memcpy(&p[N2KCAP_RECHDRLEN], f.getdata(), dlc);
+	nrecords++;
+}
+
+nmea2000_replay::nmea2000_replay()
+{
+	base = NULL;
+	size = off = 0;
+	nrecords = 0;
+}
+
+nmea2000_replay::~nmea2000_replay()
+{
+	if (base != NULL)
+		munmap((void *)base, size);
+}
+
+bool
+nmea2000_replay::open(const char *path)
+{
+	struct stat st;
+	void *m;
+	int fd;
+
+	if ((fd = ::open(path, O_RDONLY)) < 0) {
+		wxLogSysError(wxbm::ErrMsgPrefix() +
+		    _T("can't open capture file %s"), path);
+		return false;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < N2KCAP_HDRLEN) {
+		wxLogError(wxbm::ErrMsgPrefix() +
+		    _T("%s: not a capture file"), path);
+		::close(fd);
+		return false;
+	}
+	m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (m == MAP_FAILED) {
+		wxLogSysError(wxbm::ErrMsgPrefix() + _T("mmap %s"), path);
+		return false;
+	}
+	base = (const uint8_t *)m;
+	size = st.st_size;
+	if (memcmp(base, N2KCAP_MAGIC, N2KCAP_MAGIC_LEN) != 0 ||
+	    get_le(&base[N2KCAP_MAGIC_LEN], 2) != N2KCAP_VERSION) {
+		wxLogError(wxbm::ErrMsgPrefix() +
+		    _T("%s: not a capture file or wrong version"), path);
+		munmap(m, size);
+		base = NULL;
+		return false;
+	}
+	(void)madvise(m, size, MADV_SEQUENTIAL);
+	off = N2KCAP_HDRLEN;
+	return true;
+}
+
+bool
+nmea2000_replay::next(struct can_frame *cf, struct timespec *ts)
+{
+	uint64_t ns;
+	int dlc;
+
+	if (base == NULL || off + N2KCAP_RECHDRLEN > size)
+		return false;
+	dlc = base[off + 12];
+	if (dlc > 8 || off + N2KCAP_RECHDRLEN + dlc > size) {
+		printf("replay: truncated record at %zu\n", off);
+		return false;
+	}
+	ns = get_le(&base[off], 8);
+	ts->tv_sec = ns / 1000000000ULL;
+	ts->tv_nsec = ns % 1000000000ULL;
+	memset(cf, 0, sizeof(*cf));
+	cf->can_id = get_le(&base[off + 8], 4);
+	cf->can_dlc = dlc;
+	memcpy(cf->data, &base[off + N2KCAP_RECHDRLEN], dlc);
+	off += N2KCAP_RECHDRLEN + dlc;
+	nrecords++;
+	return true;
+}
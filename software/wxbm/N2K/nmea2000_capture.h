@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef NMEA2000_CAPTURE_H_
+#define NMEA2000_CAPTURE_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <time.h>
+#include "nmea2000_frame.h"
+#include "nmea2000_timer.h"
+
+/*
+ * capture file: an 8 bytes header (magic, version) followed by
+ * one record per received frame, all little-endian:
+ *	uint64_t ts;		kernel receive time, ns since the epoch
+ *	uint32_t can_id;
+ *	uint8_t dlc;
+ *	uint8_t data[dlc];
+ */
+#define N2KCAP_MAGIC		"N2KCAP"
+#define N2KCAP_MAGIC_LEN	6
+#define N2KCAP_VERSION		1
+#define N2KCAP_HDRLEN		8
+#define N2KCAP_RECHDRLEN	13
+#define N2KCAP_MAXREC		(N2KCAP_RECHDRLEN + 8)
+
+#define N2KCAP_BUFSIZE		65536
+#define N2KCAP_FLUSH_MS		1000
+
+/*
+ * Records are built directly in the write buffer, which is written
+ * out when full, at close and at last N2KCAP_FLUSH_MS after the
+ * first record that went in. Used from the N2K thread only.
+ */
+class nmea2000_capture {
+    public:
+	nmea2000_capture();
+	~nmea2000_capture();
+
+	bool open(const char *path);
+	void close(void);
+	void record(const nmea2000_frame &);
+	inline u_long getcount(void) const { return nrecords; };
+
+    private:
+	int fd;
+	size_t len;
+	u_long nrecords;
+	nmea2000_timer flush_timer;
+	uint8_t buf[N2KCAP_BUFSIZE];
+
+	uint8_t *reserve(size_t);
+	void flush(void);
+};
+
+/* read back a capture file, mapped in memory */
+class nmea2000_replay {
+    public:
+	nmea2000_replay();
+	~nmea2000_replay();
+
+	bool open(const char *path);
+	/* next frame and its receive time; false at end of file */
+	bool next(struct can_frame *, struct timespec *);
+	inline u_long getcount(void) const { return nrecords; };
+
+    private:
+	const uint8_t *base;
+	size_t size;
+	size_t off;
+	u_long nrecords;
+};
+
+#endif // NMEA2000_CAPTURE_H_
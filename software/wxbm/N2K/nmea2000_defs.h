@@ -76,9 +76,13 @@ class nmea2000_desc {
 #define PRIVATE_LOG_REQUEST_FIRST 0
 #define PRIVATE_LOG_REQUEST_NEXT 1
 #define PRIVATE_LOG_REQUEST 2
+#define PRIVATE_LOG_INTERVAL 3
+#define PRIVATE_LOG_BURST   4
 #define PRIVATE_LOG_RESET   9
 #define PRIVATE_LOG_REPLY   10
 #define PRIVATE_LOG_ERROR   11
+#define PRIVATE_LOG_INTERVAL_REPLY 12
+#define PRIVATE_LOG_BURST_REPLY 13
 #define 	PRIVATE_LOG_ERROR_NOTFOUND 0
 #define 	PRIVATE_LOG_ERROR_LAST 1
 
@@ -29,7 +29,10 @@
 #define NMEA2000_FRAME_RX_H_
 #include "nmea2000_frame.h"
 #include "nmea2000_defs.h"
+#include "nmea2000_timer.h"
+#include "battlog.h"
 #include <array>
+#include <map>
 
 class nmea2000_frame_rx : public nmea2000_desc {
     public:
@@ -41,7 +44,6 @@ class nmea2000_frame_rx : public nmea2000_desc {
 	virtual ~nmea2000_frame_rx() {};
 
 	virtual bool handle(const nmea2000_frame &) { return false;}
-	virtual void tick() { return;}
 };
 
 class nmea2000_fastframe_rx : public nmea2000_frame_rx, public nmea2000_frame {
@@ -50,35 +52,42 @@ class nmea2000_fastframe_rx : public nmea2000_frame_rx, public nmea2000_frame {
 	inline nmea2000_fastframe_rx(const char *desc, bool isuser, int pgn) : nmea2000_frame_rx(desc, isuser, pgn) { init() ; }
 	virtual ~nmea2000_fastframe_rx() {};
 	bool handle(const nmea2000_frame &);
+	/* called with the whole packet, its source and time from 1st frame */
 	virtual bool fast_handle(const nmea2000_frame &) { return false;}
 	inline int getlen() const { return (framelen); };
     private:
 	uint8_t _userdata[223];
-	int cur_id;
-	int cur_idx;
-	int len;
 	int framelen;
+	/* reassembly, per source: several devices may send at once */
+	typedef struct fast_rx {
+		uint8_t data[223];
+		int cur_id;
+		int cur_idx;
+		int len;
+		int framelen;
+		struct timespec ts;
+		inline fast_rx() : cur_id(-1), cur_idx(-1), len(0) {};
+	} fast_rx_t;
+	std::map<int, fast_rx_t> rx_src;
 	inline void init()
 	    {
 	      data = &_userdata[0];
-	      cur_id = -1;
-	      cur_idx = -1;
-	      len = 0;
+	      framelen = 0;
 	    }
 };
 
 class nmea2000_battery_status_rx : public nmea2000_frame_rx {
     public:
 	inline nmea2000_battery_status_rx() :
-	    nmea2000_frame_rx("NMEA2000 battery status", true, NMEA2000_BATTERY_STATUS) {
-		gettimeofday(&last_rx, NULL);
-	};
-	virtual ~nmea2000_battery_status_rx() {};
+	    nmea2000_frame_rx("NMEA2000 battery status", true, NMEA2000_BATTERY_STATUS)
+	    {};
+	virtual ~nmea2000_battery_status_rx();
 	bool handle(const nmea2000_frame &f);
-	void tick(void);
     private:
-	struct timeval last_rx;
-	int addr;
+	/* values are invalid if nothing received for that long */
+#define BATT_STATUS_STALE_MS 5000
+	std::map<int, nmea2000_timer *> stale_timers; /* per source */
+	void stale(int);
 };
 
 class nmea2000_private_log_rx : public nmea2000_fastframe_rx {
@@ -87,7 +96,15 @@ class nmea2000_private_log_rx : public nmea2000_fastframe_rx {
 	    nmea2000_fastframe_rx("NMEA2000 private log", true, PRIVATE_LOG) {};
 	virtual ~nmea2000_private_log_rx() {};
 	bool fast_handle(const nmea2000_frame &f);
-	void tick(void);
+    private:
+	/* delta records decoding state, for the current page of a source */
+	typedef struct log_dec {
+		struct log_last log_last[4];
+		int log_bank; /* instance of the records with instance 0 */
+		uint16_t log_idx;
+		int log_off; /* offset of the next record */
+	} log_dec_t;
+	std::map<int, log_dec_t> log_src;
 };
 
 class nmea2000_rx {
@@ -95,7 +112,6 @@ class nmea2000_rx {
 	inline nmea2000_rx() {};
 
 	bool handle(const nmea2000_frame &);
-	void tick(void);
 	const nmea2000_desc *get_byindex(u_int);
 	int get_bypgn(int);
 	void enable(u_int, bool);
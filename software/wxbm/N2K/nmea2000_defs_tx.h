@@ -32,6 +32,7 @@
 #include <wxbm.h>
 #include <array>
 #include <time.h>
+#include <pthread.h>
 
 class nmea2000_frame_tx : public nmea2000_frame, public nmea2000_desc {
     public:
@@ -64,7 +65,8 @@ class nmea2000_frame_tx : public nmea2000_frame, public nmea2000_desc {
 		   (frame->can_id & ~0xff00) | ((dst & 0xff) << 8);
 	}
 
-	virtual bool send(int);
+	/* queue for transmission by the N2K thread */
+	virtual bool send(void);
 };
 
 class nmea2000_fastframe_tx : public nmea2000_frame_tx {
@@ -72,7 +74,7 @@ public:
 	inline nmea2000_fastframe_tx() : nmea2000_frame_tx(), fastlen(223) { init(); }
 	inline nmea2000_fastframe_tx(const char *desc, bool isuser, u_int pgn, u_int pri, u_int len) : nmea2000_frame_tx(desc, isuser, pgn, pri, 8), fastlen(len) { init(); }
 	virtual ~nmea2000_fastframe_tx();
-	virtual bool send(int);
+	virtual bool send(void);
 protected:
 	const int fastlen;
 private:
@@ -103,12 +105,26 @@ class iso_address_claim_tx : public nmea2000_frame_tx {
 	};
 };
 
+class iso_request_tx : public nmea2000_frame_tx {
+    public:
+	inline iso_request_tx() : nmea2000_frame_tx("ISO request", false, ISO_REQUEST, NMEA2000_PRIORITY_REQUEST, 3) {} ;
+
+	bool sendreq(int dst, u_int pgn);
+};
+
+/*
+ * requests go to several battery monitors, from the N2K and GUI
+ * threads: the frame is set up and queued under tx_mtx.
+ */
 class private_log_tx : public nmea2000_fastframe_tx {
     public:
-	    inline private_log_tx() : nmea2000_fastframe_tx("private log", true, PRIVATE_LOG, NMEA2000_PRIORITY_INFO, 4) { };
+	    inline private_log_tx() : nmea2000_fastframe_tx("private log", true, PRIVATE_LOG, NMEA2000_PRIORITY_INFO, 4)
+		{ pthread_mutex_init(&tx_mtx, NULL); };
 
-	    bool sendreq(uint8_t cmd, uint8_t sid, uint16_t idx);
-	    bool sendreset(uint8_t sid);
+	    bool sendreq(int dst, uint8_t cmd, uint8_t sid, uint16_t idx);
+	    bool sendreset(int dst, uint8_t sid);
+    private:
+	    pthread_mutex_t tx_mtx;
 };
 
 
@@ -122,16 +138,18 @@ class nmea2000_tx {
 	int get_bypgn(int);
 	void enable(u_int, bool);
 
-	bool send_frame(int sock, int pgn, bool force = false);
+	bool send_frame(int pgn, bool force = false);
 	void setsrc(int);
 
 	iso_address_claim_tx iso_address_claim;
+	iso_request_tx iso_request;
 	private_log_tx private_log;
 
     private:
 
-	std::array<nmea2000_frame_tx *,2> frames_tx = { {
+	std::array<nmea2000_frame_tx *,3> frames_tx = { {
 		&iso_address_claim,
+		&iso_request,
 		&private_log,
 	} };
 	uint8_t sid;
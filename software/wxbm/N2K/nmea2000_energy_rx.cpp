@@ -30,38 +30,34 @@
 #include "nmea2000_defs_tx.h"
 #include <wxbm.h>
 
+nmea2000_battery_status_rx::~nmea2000_battery_status_rx()
+{
+	for (auto &t : stale_timers)
+		delete t.second;
+}
+
 bool nmea2000_battery_status_rx::handle(const nmea2000_frame &f)
 {
+	int src = f.getsrc();
 	int instance = f.frame2uint8(0);
 	int volt = f.frame2int16(1);
 	int current = f.frame2int16(3);
 	int temp = f.frame2int16(5);
-	gettimeofday(&last_rx, NULL);
+	nmea2000_timer *t = stale_timers[src];
 
-	if (addr != f.getsrc() && nmea2000P->getaddress() != -1) {
-		static const unsigned int dst_pgns[] = {PRIVATE_LOG} ;
-		addr = f.getsrc();
-		printf("new bm address %d\n", addr);
-		for (int i = 0;
-		    i < sizeof(dst_pgns) / sizeof(dst_pgns[0]); i++) {
-			nmea2000P->get_frametx(
-			    nmea2000P->get_tx_bypgn(dst_pgns[i]))->setdst(addr);
-		}
-		wxp->setBmAddress(addr);
+	if (t == NULL) {
+		t = new nmea2000_timer(
+		    std::bind(&nmea2000_battery_status_rx::stale, this, src));
+		stale_timers[src] = t;
 	}
+	t->schedule(BATT_STATUS_STALE_MS);
 
-
-	wxp->setBatt(instance, volt / 100.0, current / 100.0,
-	    temp / 100.0 - 273.15, true);
+	wxp->setBatt(src, instance, volt / 100.0, current / 100.0,
+	    temp / 100.0 - 273.15, true, &f.getts());
 	return true;
 }
 
-void nmea2000_battery_status_rx::tick()
+void nmea2000_battery_status_rx::stale(int src)
 {
-	struct timeval now, diff;
-
-	gettimeofday(&now, NULL);
-	timersub(&now, &last_rx, &diff);
-	if (diff.tv_sec >= 5)
-		wxp->setBatt(-1, -1, -1, -1, false);
+	wxp->setBatt(src, -1, -1, -1, -1, false);
 }
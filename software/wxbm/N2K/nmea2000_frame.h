@@ -35,6 +35,7 @@
 #endif  // precompiled headers
 
 #include <sys/socket.h>
+#include <time.h>
 #ifdef __NetBSD__
 #include <netcan/can.h>
 #else
@@ -47,7 +48,7 @@ class nmea2000_frame {
     public:
 	inline nmea2000_frame() {init();}
 	inline nmea2000_frame(struct can_frame *f)
-	    { frame  = f; data = f->data;}
+	    { frame  = f; data = f->data; clearts(); }
 	virtual ~nmea2000_frame() {};
 	inline bool is_pdu1() const
 	    { return (((frame->can_id >> 16) & 0xff) < 240); };
@@ -60,10 +61,21 @@ class nmea2000_frame {
 
 	inline int getpri() const { return ((frame->can_id >> 26) & 0x7); };
 	inline int getlen() const { return (frame->can_dlc); };
+	inline uint32_t getid() const { return (frame->can_id); };
 	inline const unsigned char *getdata() const {return (data); };
-	inline ssize_t readframe(int s) {
-	    return read(s, frame, sizeof(struct can_frame));
-	}
+	ssize_t readframe(int s);
+	/*
+	 * kernel receive time (CLOCK_REALTIME), and raw hardware
+	 * time if the driver provides it (0 otherwise)
+	 */
+	inline const struct timespec &getts() const { return rx_ts; };
+	inline const struct timespec &gethwts() const { return rx_hwts; };
+	inline void setts(const nmea2000_frame &f)
+	    { rx_ts = f.rx_ts; rx_hwts = f.rx_hwts; }
+	inline void setts(const struct timespec &ts)
+	    { rx_ts = ts; rx_hwts.tv_sec = rx_hwts.tv_nsec = 0; }
+	/* time from kernel receive to now, in microseconds */
+	long rxdelay(void) const;
 
 	inline int8_t frame2int8(int i) const
 	    {return (data[i]);}
@@ -128,12 +140,19 @@ class nmea2000_frame {
     protected:
 	struct can_frame *frame;
 	uint8_t *data;
+	struct timespec rx_ts;
+	struct timespec rx_hwts;
+	inline void clearts()
+	    { rx_ts.tv_sec = rx_hwts.tv_sec = 0;
+	      rx_ts.tv_nsec = rx_hwts.tv_nsec = 0;
+	    }
     private:
 	struct can_frame _frame;
 	inline void init()
 	    { frame = &_frame;
 	      memset(frame, 0, sizeof(struct can_frame));
 	      data = frame->data;
+	      clearts();
 	    }
 };
 
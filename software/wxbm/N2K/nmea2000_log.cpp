@@ -31,30 +31,36 @@
 #include "../wxbm.h"
 
 bool
-private_log_tx::sendreq(uint8_t cmd, uint8_t sid, uint16_t idx)
+private_log_tx::sendreq(int dst, uint8_t cmd, uint8_t sid, uint16_t idx)
 {
 	bool ret;
+	pthread_mutex_lock(&tx_mtx);
+	setdst(dst);
 	uint82frame(cmd, 0);
 	uint82frame(sid, 1);
 	uint162frame(idx, 2);
 	valid = true;
 	ret = nmea2000P->send_bypgn(PRIVATE_LOG, true);
 	valid = false;
+	pthread_mutex_unlock(&tx_mtx);
 	return ret;
 }
 
 #define PRIVATE_LOG_RESET_MAGIC 0x18e1
 
 bool
-private_log_tx::sendreset(uint8_t sid)
+private_log_tx::sendreset(int dst, uint8_t sid)
 {
 	bool ret;
+	pthread_mutex_lock(&tx_mtx);
+	setdst(dst);
 	uint82frame(PRIVATE_LOG_RESET, 0);
 	uint82frame(sid, 1);
 	uint162frame(0x18e1, 2);
 	valid = true;
 	ret = nmea2000P->send_bypgn(PRIVATE_LOG, true);
 	valid = false;
+	pthread_mutex_unlock(&tx_mtx);
 	return ret;
 }
 
@@ -63,6 +69,7 @@ bool
 nmea2000_private_log_rx::fast_handle(const nmea2000_frame &f)
 {
 	int len = getlen();
+	int src = f.getsrc();
 	uint8_t cmd = f.frame2uint8(0);
 	uint8_t sid = f.frame2uint8(1);
 
@@ -70,40 +77,123 @@ nmea2000_private_log_rx::fast_handle(const nmea2000_frame &f)
 	case PRIVATE_LOG_REPLY:
 		{
 		uint16_t idx = f.frame2uint16(2);
-		if (len <= 4) {
-			printf("empty page log sid 0x%x idx 0x%x\n",
-			    sid, idx);
-			wxp->logComplete(sid);
+		uint8_t data[223]; /* max fast packet payload */
+		union log_entry e;
+		struct log_aux aux;
+		int i = 4, n;
+		bool delta = (idx & LOG_IDX_DELTA) != 0;
+		log_dec_t &d = log_src[src];
+
+		if (delta && len > i) {
+			/* deltas are from the previous records in the page */
+			int off = f.frame2uint8(i);
+			if (off == 0) {
+				memset(d.log_last, 0, sizeof(d.log_last));
+				d.log_bank = 0;
+			} else if ((idx & ~0x100) != d.log_idx ||
+			    off != d.log_off) {
+				printf("log %d sid 0x%x idx 0x%x offset %d, "
+				    "expected 0x%x/%d\n",
+				    src, sid, idx, off, d.log_idx, d.log_off);
+				return true; /* will ask again on timeout */
+			}
+			d.log_idx = idx & ~0x100;
+			d.log_off = off;
+			i++;
+		}
+		if (len <= i) {
+			printf("empty page log %d sid 0x%x idx 0x%x\n",
+			    src, sid, idx);
+			wxp->logComplete(src, sid, getts());
 			return true;
 		}
-		for (int i = 4; i < len; ) {
-			u_int temp = f.frame2uint8(i);
-			u_int volts = f.frame2uint8(i+1);
-			int32_t amps = f.frame2uint16(i+2);
-			u_int data = f.frame2uint8(i+4);
-			bool nvalid = (data & 0x8);
-			u_int instance = ((data >> 6) & 0x3);
-			volts = volts | (data & 0x7) << 8;
-			amps = amps | (((data >> 4) & 0x3) << 16);
-			/* expand sign */
-			if (amps & 0x20000) {
-				amps |= 0xfffc0000;
+		for (n = 0; n < len - i; n++)
+			data[n] = f.frame2uint8(i + n);
+		len -= i;
+		for (i = 0; i < len; i += n) {
+			int bank = 0;
+			if (delta) {
+				n = log_rec_decode(d.log_last, &data[i],
+				    len - i, &e, &aux);
+				if (n == 0) {
+					printf("bad log record %d sid 0x%x "
+					    "idx 0x%x offset %d\n",
+					    src, sid, idx, d.log_off);
+					return true;
+				}
+				d.log_off += n;
+				/* not for the boot marks */
+				if ((data[i] & LR_TYPE) != LR_MARK)
+					bank = d.log_bank;
+			} else {
+				n = sizeof(e);
+				if (len - i < n)
+					break;
+				memcpy(e.data, &data[i], n);
+			}
+			u_int temp = e.s.temp;
+			if (delta && e.s.nvalid && aux.type == LR_M_TIME) {
+				wxp->addLogTime(src, sid, aux.time.time,
+				    aux.time.interval);
+			} else if (delta && e.s.nvalid &&
+			    aux.type == LR_M_BANK) {
+				d.log_bank = aux.bank;
+			} else if (delta && e.s.nvalid) {
+				wxp->addLogEnvelope(src, sid,
+				    d.log_bank + aux.env.instance,
+				    (double)aux.env.u_min / 100.0,
+				    (double)aux.env.i_min / 1000.0,
+				    (double)aux.env.i_max / 1000.0);
+			} else {
+				wxp->addLogEntry(src, sid,
+				    (double)logtou(&e) / 100.0,
+				    (double)logtoi(&e) / 1000.0,
+				    (temp == 0xff) ? -1 : (temp + 233),
+				    bank + e.s.instance, (idx & ~0x100));
 			}
-			i += 5;
-			wxp->addLogEntry(sid, (double)volts / 100.0,
-			    (double)amps / 1000.0,
-			    (temp == 0xff) ? -1 : (temp + 233),
-			    instance, (idx & ~0x100));
-			if ((idx & 0x100) != 0 && i >= len)
-				wxp->logComplete(sid);
+			if ((idx & 0x100) != 0 && i + n >= len)
+				wxp->logComplete(src, sid, getts());
 		}
 		return true;
 		}
 	case PRIVATE_LOG_ERROR:
 		{
 		uint8_t err = f.frame2uint8(2);
-		printf("log_rx error %d sid %d\n", err, sid);
-		wxp->logError(sid, err);
+		printf("log_rx %d error %d sid %d\n", src, err, sid);
+		wxp->logError(src, sid, err);
+		return true;
+		}
+	case PRIVATE_LOG_INTERVAL_REPLY:
+		/* older firmwares don't send the instance of channel 0 */
+		wxp->logInterval(src, sid, f.frame2uint16(2),
+		    (len > 4) ? f.frame2uint8(4) : 0);
+		return true;
+	case PRIVATE_LOG_BURST_REPLY:
+		{
+		uint16_t seq = f.frame2uint16(2);
+		uint8_t chans = f.frame2uint8(4);
+		int i = 5;
+
+		if ((chans & BURST_CHANS) == 0) {
+			printf("burst reply %d sid 0x%x without channels\n",
+			    src, sid);
+			return true;
+		}
+		while (i + (int)sizeof(struct burst_sample) <= len) {
+			for (int c = 0; c < 4; c++) {
+				if ((chans & (1 << c)) == 0)
+					continue;
+				if (i + (int)sizeof(struct burst_sample) > len)
+					break;
+				wxp->addBurstSample(src, sid, seq, c,
+				    (double)(int16_t)f.frame2uint16(i + 2) / 100.0,
+				    (double)(int16_t)f.frame2uint16(i) / 100.0);
+				i += sizeof(struct burst_sample);
+			}
+			seq++;
+		}
+		if (chans & BURST_LAST)
+			wxp->burstComplete(src, sid, getts());
 		return true;
 		}
 	default:
@@ -112,8 +202,3 @@ nmea2000_private_log_rx::fast_handle(const nmea2000_frame &f)
 	return false;
 }
 
-void
-nmea2000_private_log_rx::tick()
-{
-	wxp->logTick();
-}
@@ -25,6 +25,8 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <wx/wx.h>
 
 #include <wxbm.h>
@@ -46,48 +48,125 @@ bool nmea2000_rx::handle(const nmea2000_frame &n2kf)
 	return false;
 }
 
+ssize_t nmea2000_frame::readframe(int s)
+{
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(3 * sizeof(struct timespec))];
+		struct cmsghdr align;
+	} cbuf;
+	ssize_t ret;
+
+	iov.iov_base = frame;
+	iov.iov_len = sizeof(struct can_frame);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf.buf;
+	msg.msg_controllen = sizeof(cbuf.buf);
+
+	clearts();
+	ret = recvmsg(s, &msg, 0);
+	if (ret <= 0)
+		return ret;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+	    cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET)
+			continue;
+		switch(cmsg->cmsg_type) {
+#ifdef SCM_TIMESTAMPING
+		case SCM_TIMESTAMPING:
+		    {
+			/* [0] software, [1] deprecated, [2] raw hardware */
+			struct timespec ts[3];
+			memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+			rx_ts = ts[0];
+			rx_hwts = ts[2];
+			break;
+		    }
+#endif
+#ifdef SCM_TIMESTAMPNS
+		case SCM_TIMESTAMPNS:
+			memcpy(&rx_ts, CMSG_DATA(cmsg), sizeof(rx_ts));
+			break;
+#endif
+#ifdef SCM_TIMESTAMP
+		case SCM_TIMESTAMP:
+		    {
+			struct timeval tv;
+			memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+			TIMEVAL_TO_TIMESPEC(&tv, &rx_ts);
+			break;
+		    }
+#endif
+		}
+	}
+	if (rx_ts.tv_sec == 0) {
+		/* no kernel timestamp, best we can do */
+		clock_gettime(CLOCK_REALTIME, &rx_ts);
+	}
+	return ret;
+}
+
+long nmea2000_frame::rxdelay(void) const
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (now.tv_sec - rx_ts.tv_sec) * 1000000L +
+	    (now.tv_nsec - rx_ts.tv_nsec) / 1000;
+}
+
 bool nmea2000_fastframe_rx::handle(const nmea2000_frame &f)
 {
 #define FASTPACKET_IDX_MASK 0x1f
 #define FASTPACKET_ID_MASK  0xe0
 	unsigned char _idx = (f.frame2uint8(0) & FASTPACKET_IDX_MASK);
 	unsigned char _id = (f.frame2uint8(0) & FASTPACKET_ID_MASK);
+	fast_rx_t &r = rx_src[f.getsrc()];
 
-	if (_idx == 0 && cur_idx == -1) {
-		/* new packet */
-		cur_id = _id;
-		framelen = len = f.frame2uint8(1);
-		for (int i = 0; i < 6 && len > 0; i++) {
-			data[i] = f.frame2uint8(i+2);
-			len--;
+	if (_idx == 0) {
+		/* new packet, its time is the time of the first frame */
+		r.ts = f.getts();
+		r.cur_id = _id;
+		r.framelen = r.len = f.frame2uint8(1);
+		if (r.framelen > sizeof(r.data))
+			r.framelen = r.len = sizeof(r.data);
+		for (int i = 0; i < 6 && r.len > 0; i++) {
+			r.data[i] = f.frame2uint8(i+2);
+			r.len--;
 		}
-		cur_idx = 0;
-	} else if (cur_id == _id && _idx == cur_idx + 1) {
+		r.cur_idx = 0;
+	} else if (r.cur_idx != -1 && r.cur_id == _id &&
+	    _idx == r.cur_idx + 1) {
 		int i, j;
 		/* i = 6 + (_idx - 1) * 7 : i = _idx * 7 - 1 */
 		for (i = _idx * 7 - 1, j = 1;
-		    i < sizeof(_userdata) && j < 8 && len > 0; i++, j++) {
-			data[i] = f.frame2uint8(j);
-			len--;
+		    i < sizeof(r.data) && j < 8 && r.len > 0; i++, j++) {
+			r.data[i] = f.frame2uint8(j);
+			r.len--;
 		}
-		cur_idx = _idx;
+		r.cur_idx = _idx;
+	} else {
+		/* lost a frame: drop this packet */
+		r.cur_idx = -1;
+		return true;
 	}
 
-	if (len == 0) {
-		cur_idx = -1;
+	if (r.len == 0) {
+		r.cur_idx = -1;
+		memcpy(_userdata, r.data, r.framelen);
+		framelen = r.framelen;
+		frame->can_id = f.getid();
+		setts(r.ts);
 		return fast_handle(*this);
 	}
 	return true;
 }
 
-void nmea2000_rx::tick()
-{
-	for (u_int i = 0; i < frames_rx.size(); i++) {
-		if (frames_rx[i]->enabled)
-			frames_rx[i]->tick();
-	}
-}
-
 const nmea2000_desc * nmea2000_rx::get_byindex(u_int i) {
 	if (i >= frames_rx.size()) {
 		return NULL;
@@ -150,11 +229,11 @@ void nmea2000_tx::enable(u_int i, bool en)
 	}
 }
 
-bool nmea2000_tx::send_frame(int sock, int pgn, bool force) {
+bool nmea2000_tx::send_frame(int pgn, bool force) {
 	for (u_int i = 0; i < frames_tx.size(); i++) {
 		if (frames_tx[i]->pgn == pgn) {
 			if (frames_tx[i]->enabled || force) {
-				return frames_tx[i]->send(sock);
+				return frames_tx[i]->send();
 			} else {
 				return false;
 			}
@@ -169,50 +248,66 @@ void nmea2000_tx::setsrc(int src) {
 	}
 }
 
-bool nmea2000_frame_tx::send(int sock) {
+bool nmea2000_frame_tx::send(void) {
 	if (!valid)
 		return false;
 
-	if (write(sock, frame, sizeof(struct can_frame)) < 0) {
-		wxLogSysError(wxbm::ErrMsgPrefix() + _T("send %s"), descr);
+	if (!nmea2000P->gettxq()->enqueue(frame, 1, pgn)) {
+		wxLogError(wxbm::ErrMsgPrefix() + _T("send %s: queue full"), descr);
 		return false;
 	}
 	return true;
 }
 
+bool iso_request_tx::sendreq(int dst, u_int pgn)
+{
+	bool ret;
+
+	setdst(dst);
+	uint242frame(pgn, 0);
+	valid = true;
+	ret = nmea2000P->send_bypgn(ISO_REQUEST, true);
+	valid = false;
+	return ret;
+}
+
 nmea2000_fastframe_tx::~nmea2000_fastframe_tx()
 {
 	free(userdata);
 }
 
-bool nmea2000_fastframe_tx::send(int sock)
+bool nmea2000_fastframe_tx::send(void)
 {
+	/* 223 bytes max: 6 in the first frame, then 7 per frame */
+	struct can_frame frames[32];
 	int i;
 	int n;
 	if (!valid)
 		return false;
 
+	memset(frames, 0, sizeof(frames));
 	for (i = 0, n = 0; i < fastlen; n++) {
-		frame->data[0] = (ident << 5) | n ;
+		frames[n].can_id = frame->can_id;
+		frames[n].data[0] = (ident << 5) | n ;
 		int remain = fastlen - i;
 		if (n == 0) {
 			if (remain > 6)
 				remain = 6;
-			frame->data[1] = fastlen;
-			memcpy(&frame->data[2], &data[i], remain);
+			frames[n].data[1] = fastlen;
+			memcpy(&frames[n].data[2], &data[i], remain);
 			i += remain;
-			frame->can_dlc = remain + 2;
+			frames[n].can_dlc = remain + 2;
 		} else {
 			if (remain > 7)
 				remain = 7;
-			memcpy(&frame->data[1], &data[i], remain);
-			frame->can_dlc = remain + 1;
+			memcpy(&frames[n].data[1], &data[i], remain);
+			frames[n].can_dlc = remain + 1;
 			i += remain;
 		}
-		if (write(sock, frame, sizeof(struct can_frame)) < 0) {
-			wxLogSysError(wxbm::ErrMsgPrefix() + _T("send %s (%d)"), descr, n);
-			return false;
-		}
+	}
+	if (!nmea2000P->gettxq()->enqueue(frames, n, pgn)) {
+		wxLogError(wxbm::ErrMsgPrefix() + _T("send %s: queue full"), descr);
+		return false;
 	}
 	ident = (ident + 1) & 0x7;
 	return true;
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <err.h>
+
+#include "NMEA2000.h"
+#include "nmea2000_timer.h"
+
+void
+nmea2000_timer::schedule(u_int ms)
+{
+	nmea2000P->gettimers()->add(this, ms);
+}
+
+void
+nmea2000_timer::cancel(void)
+{
+	if (armed)
+		wheel->remove(this);
+}
+
+nmea2000_timerwheel::nmea2000_timerwheel()
+{
+	if ((tfd = timerfd_create(CLOCK_MONOTONIC,
+	    TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+		err(1, "timerfd_create");
+	for (int i = 0; i < N2K_TIMER_SLOTS; i++)
+		LIST_INIT(&slots[i]);
+	LIST_INIT(&due);
+	cur_tick = now_ms() / N2K_TIMER_TICK_MS;
+	next_tick = 0;
+}
+
+nmea2000_timerwheel::~nmea2000_timerwheel()
+{
+	close(tfd);
+}
+
+uint64_t
+nmea2000_timerwheel::now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void
+nmea2000_timerwheel::add(nmea2000_timer *t, u_int ms)
+{
+	if (t->armed)
+		remove(t);
+	/* round up, so we never fire early */
+	t->expire = (now_ms() + ms + N2K_TIMER_TICK_MS - 1) / N2K_TIMER_TICK_MS;
+	t->wheel = this;
+	t->armed = true;
+	if (ms == 0 || t->expire <= cur_tick) {
+		/* slot already processed, fire on next run() */
+		LIST_INSERT_HEAD(&due, t, t_list);
+		settimer(cur_tick);
+		return;
+	}
+	LIST_INSERT_HEAD(&slots[t->expire & N2K_TIMER_SLOTS_MASK], t, t_list);
+	if (next_tick == 0 || t->expire < next_tick)
+		settimer(t->expire);
+}
+
+void
+nmea2000_timerwheel::remove(nmea2000_timer *t)
+{
+	LIST_REMOVE(t, t_list);
+	t->armed = false;
+	/* the timerfd may fire for nothing, run() will rearm it */
+}
+
+void
+nmea2000_timerwheel::run(void)
+{
+	LIST_HEAD(, nmea2000_timer) expired;
+	nmea2000_timer *t, *nt;
+	uint64_t exp;
+	uint64_t now = now_ms() / N2K_TIMER_TICK_MS;
+	uint64_t tick;
+	int n;
+
+	/* clear the timerfd, we don't care about the count */
+	(void)read(tfd, &exp, sizeof(exp));
+
+	LIST_INIT(&expired);
+	while ((t = LIST_FIRST(&due)) != NULL) {
+		LIST_REMOVE(t, t_list);
+		LIST_INSERT_HEAD(&expired, t, t_list);
+	}
+	for (tick = cur_tick + 1, n = 0;
+	    tick <= now && n < N2K_TIMER_SLOTS; tick++, n++) {
+		for (t = LIST_FIRST(&slots[tick & N2K_TIMER_SLOTS_MASK]);
+		    t != NULL; t = nt) {
+			nt = LIST_NEXT(t, t_list);
+			if (t->expire > now)
+				continue; /* later round */
+			LIST_REMOVE(t, t_list);
+			LIST_INSERT_HEAD(&expired, t, t_list);
+		}
+	}
+	cur_tick = now;
+	next_tick = 0;
+
+	/*
+	 * callbacks may schedule or cancel any timer, including
+	 * one still on the expired list.
+	 */
+	while ((t = LIST_FIRST(&expired)) != NULL) {
+		LIST_REMOVE(t, t_list);
+		t->armed = false;
+		t->callback();
+	}
+	rearm();
+}
+
+void
+nmea2000_timerwheel::settimer(uint64_t tick)
+{
+	struct itimerspec its;
+	uint64_t ms = tick * N2K_TIMER_TICK_MS;
+
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	if (tick == 0) {
+		/* disarm */
+		its.it_value.tv_sec = 0;
+		its.it_value.tv_nsec = 0;
+	} else {
+		its.it_value.tv_sec = ms / 1000;
+		its.it_value.tv_nsec = (ms % 1000) * 1000000;
+		/* a 0 it_value would disarm */
+		if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+			its.it_value.tv_nsec = 1;
+	}
+	if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		warn("timerfd_settime");
+	next_tick = tick;
+}
+
+void
+nmea2000_timerwheel::rearm(void)
+{
+	uint64_t next = 0;
+	nmea2000_timer *t;
+
+	if (LIST_FIRST(&due) != NULL) {
+		settimer(cur_tick);
+		return;
+	}
+	for (int i = 0; i < N2K_TIMER_SLOTS; i++) {
+		LIST_FOREACH(t, &slots[i], t_list) {
+			if (next == 0 || t->expire < next)
+				next = t->expire;
+		}
+	}
+	settimer(next);
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef NMEA2000_TIMER_H_
+#define NMEA2000_TIMER_H_
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+
+/*
+ * timers for the N2K thread. Deadlines are kept in a hashed timer wheel
+ * on CLOCK_MONOTONIC, and the wheel's timerfd is armed for the earliest
+ * one, so the event loop sleeps until a frame arrives or something is due.
+ * Timers must only be scheduled or cancelled from the N2K thread.
+ */
+
+#define N2K_TIMER_TICK_MS	10
+#define N2K_TIMER_SLOTS		256
+#define N2K_TIMER_SLOTS_MASK	(N2K_TIMER_SLOTS - 1)
+
+class nmea2000_timerwheel;
+
+class nmea2000_timer {
+    public:
+	typedef std::function<void(void)> callback_t;
+
+	inline nmea2000_timer(callback_t cb) :
+	    callback(cb), wheel(NULL), armed(false) {};
+	inline ~nmea2000_timer() { cancel(); };
+
+	/* (re)arm the timer to fire in ms milliseconds; 0 is "asap" */
+	void schedule(u_int ms);
+	void cancel(void);
+	inline bool pending(void) const { return armed; };
+
+    private:
+	friend class nmea2000_timerwheel;
+	callback_t callback;
+	nmea2000_timerwheel *wheel;
+	uint64_t expire; /* in ticks */
+	bool armed;
+	LIST_ENTRY(nmea2000_timer) t_list;
+};
+
+class nmea2000_timerwheel {
+    public:
+	nmea2000_timerwheel();
+	~nmea2000_timerwheel();
+
+	inline int getfd(void) const { return tfd; };
+	void add(nmea2000_timer *, u_int ms);
+	void remove(nmea2000_timer *);
+	/* fire expired timers and rearm the timerfd */
+	void run(void);
+
+    private:
+	int tfd;
+	uint64_t cur_tick;  /* last tick processed */
+	uint64_t next_tick; /* tick the timerfd is armed for, 0 if idle */
+	LIST_HEAD(, nmea2000_timer) slots[N2K_TIMER_SLOTS];
+	LIST_HEAD(, nmea2000_timer) due;
+	static uint64_t now_ms(void);
+	void settimer(uint64_t);
+	void rearm(void);
+};
+
+#endif // NMEA2000_TIMER_H_
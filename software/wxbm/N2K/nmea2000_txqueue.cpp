@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <sys/uio.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+#include <wx/wx.h>
+
+#include <wxbm.h>
+#include "NMEA2000.h"
+#include "nmea2000_txqueue.h"
+
+nmea2000_txqueue::nmea2000_txqueue(wakeup_t w) :
+    wakeup(w),
+    retry_timer(std::bind(&nmea2000_txqueue::retry, this))
+{
+	if ((errno = pthread_mutex_init(&txq_mtx, NULL)) != 0)
+		err(1, "init txq_mtx");
+	blocked = backoff = false;
+}
+
+nmea2000_txqueue::~nmea2000_txqueue()
+{
+	pthread_mutex_destroy(&txq_mtx);
+}
+
+void
+nmea2000_txqueue::lock(void)
+{
+	if ((errno = pthread_mutex_lock(&txq_mtx)) != 0)
+		err(1, "lock txq_mtx");
+}
+
+void
+nmea2000_txqueue::unlock(void)
+{
+	if ((errno = pthread_mutex_unlock(&txq_mtx)) != 0)
+		err(1, "unlock txq_mtx");
+}
+
+bool
+nmea2000_txqueue::enqueue(const struct can_frame *f, int n, int pgn)
+{
+	int prio = (f[0].can_id >> 26) & 0x7;
+	txq_entry_t e;
+
+	lock();
+	nmea2000_txstats_t &st = stats[pgn];
+	if (txq[prio].size() + n > N2K_TXQ_MAXDEPTH) {
+		st.dropped += n;
+		unlock();
+		return false;
+	}
+	e.pgn = pgn;
+	for (int i = 0; i < n; i++) {
+		e.frame = f[i];
+		e.left = n - i - 1;
+		txq[prio].push_back(e);
+	}
+	st.depth += n;
+	if (st.depth > st.maxdepth)
+		st.maxdepth = st.depth;
+	unlock();
+	wakeup();
+	return true;
+}
+
+/* remove n sent frames from the head of txq[prio]. Called locked */
+void
+nmea2000_txqueue::sent(int prio, int n)
+{
+	for (int i = 0; i < n; i++) {
+		nmea2000_txstats_t &st = stats[txq[prio].front().pgn];
+		st.depth--;
+		st.sent++;
+		txq[prio].pop_front();
+	}
+}
+
+/*
+ * drop the frame at the head of txq[prio], and the rest of its fast
+ * packet: the receiver can't use a truncated one. Called locked
+ */
+void
+nmea2000_txqueue::drop(int prio)
+{
+	int n = txq[prio].front().left + 1;
+
+	for (int i = 0; i < n; i++) {
+		nmea2000_txstats_t &st = stats[txq[prio].front().pgn];
+		st.depth--;
+		st.dropped++;
+		txq[prio].pop_front();
+	}
+}
+
+void
+nmea2000_txqueue::flush(int sock)
+{
+	struct mmsghdr msgs[N2K_TXQ_BATCH];
+	struct iovec iovs[N2K_TXQ_BATCH];
+	struct can_frame frames[N2K_TXQ_BATCH];
+	int count[N2K_TXQ_PRIOS];
+	int n, r;
+
+	while (!blocked && !backoff) {
+		/*
+		 * only the N2K thread removes frames, so what we copy here
+		 * is still at the head of the FIFOs when we come back.
+		 */
+		lock();
+		n = 0;
+		for (int p = 0; p < N2K_TXQ_PRIOS; p++) {
+			count[p] = 0;
+			for (u_int i = 0;
+			    i < txq[p].size() && n < N2K_TXQ_BATCH; i++) {
+				frames[n++] = txq[p][i].frame;
+				count[p]++;
+			}
+		}
+		unlock();
+		if (n == 0)
+			return;
+
+		memset(msgs, 0, sizeof(msgs[0]) * n);
+		for (int i = 0; i < n; i++) {
+			iovs[i].iov_base = &frames[i];
+			iovs[i].iov_len = sizeof(struct can_frame);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		r = sendmmsg(sock, msgs, n, MSG_DONTWAIT);
+		if (r < 0) {
+			switch(errno) {
+			case EINTR:
+				continue;
+			case EAGAIN:
+				blocked = true;
+				return;
+			case ENOBUFS:
+				/* interface queue full, and no way to poll it */
+				backoff = true;
+				retry_timer.schedule(N2K_TXQ_RETRY_MS);
+				return;
+			default:
+				wxLogSysError(wxbm::ErrMsgPrefix() +
+				    _T("send CAN frame"));
+				/* drop the offending packet, don't loop on it */
+				r = 0;
+				lock();
+				for (int p = 0; p < N2K_TXQ_PRIOS; p++) {
+					if (count[p] == 0)
+						continue;
+					drop(p);
+					break;
+				}
+				unlock();
+				continue;
+			}
+		}
+		lock();
+		for (int p = 0; p < N2K_TXQ_PRIOS && r > 0; p++) {
+			int s = std::min(r, count[p]);
+			sent(p, s);
+			r -= s;
+		}
+		unlock();
+	}
+}
+
+void
+nmea2000_txqueue::purge(void)
+{
+	lock();
+	for (int p = 0; p < N2K_TXQ_PRIOS; p++) {
+		while (!txq[p].empty()) {
+			nmea2000_txstats_t &st = stats[txq[p].front().pgn];
+			st.depth--;
+			st.dropped++;
+			txq[p].pop_front();
+		}
+	}
+	unlock();
+}
+
+void
+nmea2000_txqueue::retry(void)
+{
+	backoff = false;
+	/* the N2K loop flushes after running timers */
+}
+
+bool
+nmea2000_txqueue::getstats(int pgn, nmea2000_txstats_t *st)
+{
+	bool ret = false;
+
+	lock();
+	std::map<int, nmea2000_txstats_t>::iterator it = stats.find(pgn);
+	if (it != stats.end()) {
+		*st = it->second;
+		ret = true;
+	}
+	unlock();
+	return ret;
+}
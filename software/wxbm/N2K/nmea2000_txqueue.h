@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef NMEA2000_TXQUEUE_H_
+#define NMEA2000_TXQUEUE_H_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <functional>
+#ifdef __NetBSD__
+#include <netcan/can.h>
+#else
+#include <linux/can.h>
+#endif
+#include "nmea2000_timer.h"
+
+/*
+ * frames waiting to be sent, one FIFO per N2K priority. Frames can be
+ * queued from any thread; the N2K thread sends them in batches
+ * (highest priority first) when the socket can take them. The frames
+ * of a fast packet are queued at once, so they stay in order.
+ */
+
+#define N2K_TXQ_PRIOS		8
+#define N2K_TXQ_MAXDEPTH	256	/* frames, per priority */
+#define N2K_TXQ_BATCH		32	/* frames per sendmmsg() */
+#define N2K_TXQ_RETRY_MS	10	/* retry delay on ENOBUFS */
+
+typedef struct nmea2000_txstats {
+	u_int depth;	/* frames currently queued */
+	u_int maxdepth;
+	u_long sent;	/* frames */
+	u_long dropped;	/* frames */
+} nmea2000_txstats_t;
+
+class nmea2000_txqueue {
+    public:
+	typedef std::function<void(void)> wakeup_t;
+
+	nmea2000_txqueue(wakeup_t);
+	~nmea2000_txqueue();
+
+	/* queue n frames of the given PGN; false if queue full */
+	bool enqueue(const struct can_frame *, int n, int pgn);
+	/* from the N2K thread: send what we can */
+	void flush(int sock);
+	/* the N2K thread should wait for the socket to be writable */
+	inline bool wantwrite(void) const { return blocked; };
+	inline void writable(void) { blocked = false; };
+	bool getstats(int pgn, nmea2000_txstats_t *);
+	/* drop everything queued (replay, nowhere to send) */
+	void purge(void);
+
+    private:
+	typedef struct txq_entry {
+		struct can_frame frame;
+		int pgn;
+		int left;	/* frames of the same packet after this one */
+	} txq_entry_t;
+
+	wakeup_t wakeup;
+	pthread_mutex_t txq_mtx;
+	std::deque<txq_entry_t> txq[N2K_TXQ_PRIOS];
+	std::map<int, nmea2000_txstats_t> stats;
+	nmea2000_timer retry_timer;
+	bool blocked;	/* EAGAIN, wait for writable */
+	bool backoff;	/* ENOBUFS, wait for retry_timer */
+
+	void lock(void);
+	void unlock(void);
+	void retry(void);
+	void sent(int prio, int n);
+	void drop(int prio);
+};
+
+#endif // NMEA2000_TXQUEUE_H_
@@ -44,8 +44,13 @@ static const int fitID = wxID_HIGHEST + 6;
 static const int scaleID = wxID_HIGHEST + 7;
 static const int nextID = wxID_HIGHEST + 8;
 static const int prevID = wxID_HIGHEST + 9;
+static const int deviceID = wxID_HIGHEST + 10;
+static const int logChangedID = wxID_HIGHEST + 11;
 
-static const wxColour *instcolor[NINST] = {wxRED, wxGREEN, wxBLUE, wxBLACK};
+/* the colors of the instances, in turn */
+static const wxColour *instcolor[] = {wxRED, wxGREEN, wxBLUE, wxBLACK,
+    wxCYAN, wxLIGHT_GREY};
+#define NCOLORS (sizeof(instcolor) / sizeof(instcolor[0]))
 
 static const wchar_t degChar = 0x00B0;
 static const wxString _degFmt = wxT("%.1f");
@@ -86,21 +91,12 @@ bmLog::bmLog(wxWindow* parent)
 	: wxFrame(parent, wxID_ANY, _T("bmLog"))
 {
 	wxConfig *config = wxp->getConfig();
-	wxString logPath;
 	int x, y, w, h;
 
-	if (!config || !config->Read("/Log/path", &logPath)) {
-		const char *home = getenv("HOME");
-		if (home != NULL) {
-			logPath = wxString::Format(wxT("%s/.wxbm_log"), home);
-			if (config) {
-				config->Write("/Log/path", logPath);
-			}
-		} else {
-			err(1, "can't get log file name ($HOME not set)");
-		}
-	}
-	bmlog_s = new bmLogStorage(logPath);
+	bmlog_s = NULL;
+	curdev = -1;
+	log_cookie = -1;
+	log_live = false;
 
 	if (config) {
 		x = config->ReadLong("/Log/x", -1);
@@ -115,9 +111,15 @@ bmLog::bmLog(wxWindow* parent)
 	Connect(wxEVT_SHOW, wxShowEventHandler(bmLog::OnShow));
 	Connect(wxEVT_CHAR_HOOK, wxKeyEventHandler(bmLog::OnKeyPress));
 	Connect(SCALEX_EVENT, wxCommandEventHandler(bmLog::OnScale));
+	Connect(logChangedID, wxEVT_COMMAND_TEXT_UPDATED,
+	    wxCommandEventHandler(bmLog::OnLogChanged));
 
 	wxBoxSizer *mainsizer = new wxBoxSizer(wxVERTICAL);
 	wxBoxSizer *topsizer = new wxBoxSizer(wxHORIZONTAL);
+	devchoice = new wxChoice(this, deviceID);
+	devchoice->Connect(wxEVT_CHOICE,
+	    wxCommandEventHandler(bmLog::OnDevice), NULL, this);
+	topsizer->Add(devchoice, 0, wxEXPAND | wxALL, 2 );
 	wxButton *prev = new wxButton(this, prevID, _T("<-"));
 	prev->Connect(wxEVT_BUTTON,
 	    wxCommandEventHandler(bmLog::OnPrevious), NULL, this);
@@ -147,31 +149,13 @@ bmLog::bmLog(wxWindow* parent)
 	infoTextD = new wxStaticText(this, -1, wxT("XXXX-XX-XX XX:XX  "),
 		    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
 	infosizer->Add(infoTextD, wxALIGN_RIGHT);
-	for (int i = 0; i < NINST; i++) {
-		InstLabel[i] = wxp->getTlabel(i, this);
-		if (InstLabel[i] == NULL)
-			continue;
-		infoTextA[i] = new wxStaticText(this, -1, wxT("  XXXX.XXA"),
-		    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
-		infoTextA[i]->SetForegroundColour(*instcolor[i]);
-		infosizer->Add(infoTextA[i], wxALIGN_RIGHT);
-	}
-	for (int i = 0; i < NINST; i++) {
-		if (InstLabel[i] == NULL)
-			continue;
-		infoTextV[i] = new wxStaticText(this, -1, wxT("  XXX.XXV"),
-		    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
-		infoTextV[i]->SetForegroundColour(*instcolor[i]);
-		infosizer->Add(infoTextV[i], wxALIGN_RIGHT);
-	}
-	for (int i = 0; i < NINST; i++) {
-		if (InstLabel[i] == NULL)
-			continue;
-		infoTextT[i] = new wxStaticText(this, -1, wxT("  XXC"),
-		    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
-		infoTextT[i]->SetForegroundColour(*instcolor[i]);
-		infosizer->Add(infoTextT[i], wxALIGN_RIGHT);
-	}
+	/* the instances are added to these when first seen, see addInst() */
+	infosizerA = new wxBoxSizer(wxHORIZONTAL);
+	infosizerV = new wxBoxSizer(wxHORIZONTAL);
+	infosizerT = new wxBoxSizer(wxHORIZONTAL);
+	infosizer->Add(infosizerA);
+	infosizer->Add(infosizerV);
+	infosizer->Add(infosizerT);
 	mainsizer->Add(infosizer, 0, wxEXPAND | wxALL | wxALIGN_RIGHT, 1 );
 
 	plotA = MakePlot(wxT("%.2fA"), plotID_A);
@@ -187,71 +171,10 @@ bmLog::bmLog(wxWindow* parent)
 	plotT->AddLayer(infoT);
 	infoT->SetVisible(true);
 
-	for (int i = 0; i < NINST; i++) {
-		if (InstLabel[i] == NULL)
-			continue;
-		wxPen vectorpen(*instcolor[i], 2, wxSOLID);
-
-		Alayer[i] = new bmFXYVector(plotA, _("Amps"));
-		Alayer[i]->Clear();
-		Alayer[i]->SetContinuity(true);
-		Alayer[i]->SetPen(vectorpen);
-		Alayer[i]->SetDrawOutsideMargins(false);
-		plotA->AddLayer(Alayer[i]);
-
-		Vlayer[i] = new bmFXYVector(plotV, _("Volts"));
-		Vlayer[i]->Clear();
-		Vlayer[i]->SetContinuity(true);
-		Vlayer[i]->SetPen(vectorpen);
-		Vlayer[i]->SetDrawOutsideMargins(false);
-		plotV->AddLayer(Vlayer[i]);
-
-		Tlayer[i] = new bmFXYVector(plotT, _("Temp"));
-		Tlayer[i]->Clear();
-		Tlayer[i]->SetContinuity(true);
-		Tlayer[i]->SetPen(vectorpen);
-		Tlayer[i]->SetDrawOutsideMargins(false);
-		plotT->AddLayer(Tlayer[i]);
-	}
 	wxFlexGridSizer *graphsizer = new wxFlexGridSizer(2, 3, 5);
-	wxFlexGridSizer *lsizerA = new wxFlexGridSizer(3, NINST, 5);
-	wxFlexGridSizer *lsizerV = new wxFlexGridSizer(2, NINST, 5);
-	wxFlexGridSizer *lsizerT = new wxFlexGridSizer(2, NINST, 5);
-	wxSizerFlags datafl(0);
-	datafl.Expand().Right();
-	wxSizerFlags labelfl(0);
-	labelfl.Centre();
-	for (int i = 0; i < NINST; i++) {
-		if (InstLabel[i] == NULL)
-			continue;
-
-		InstLabel[i]->Connect(wxEVT_LEFT_DOWN,
-		    wxMouseEventHandler(bmLog::OnGraphToggle), Alayer[i], this);
-		lsizerA->Add(InstLabel[i], labelfl);
-		InstAh[i] = new wxStaticText(this, -1, wxT("XXXX.XXAh"),
-		    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
-		InstAh[i]->SetForegroundColour(*instcolor[i]);
-		lsizerA->Add(InstAh[i], datafl);
-		InstA[i] = new wxStaticText(this, -1, wxT("XX.XXA"),
-		    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
-		InstA[i]->SetForegroundColour(*instcolor[i]);
-		lsizerA->Add(InstA[i], datafl);
-		/* each time we add a wxWindow we need to allocate a new one */
-		InstLabel[i] = wxp->getTlabel(i, this);
-		InstLabel[i]->Connect(wxEVT_LEFT_DOWN,
-		    wxMouseEventHandler(bmLog::OnGraphToggle), Vlayer[i], this);
-		lsizerV->Add(InstLabel[i], labelfl);
-		InstV[i] = new wxStaticText(this, -1, wxT("XX.XXV XX.XXV"));
-		InstV[i]->SetForegroundColour(*instcolor[i]);
-		lsizerV->Add(InstV[i], datafl);
-		InstLabel[i] = wxp->getTlabel(i, this);
-		InstLabel[i]->Connect(wxEVT_LEFT_DOWN,
-		    wxMouseEventHandler(bmLog::OnGraphToggle), Tlayer[i], this);
-		lsizerT->Add(InstLabel[i], labelfl);
-		InstT[i] = new wxStaticText(this, -1, wxT("XX.XXC XX.XXC"));
-		InstT[i]->SetForegroundColour(*instcolor[i]);
-		lsizerT->Add(InstT[i], datafl);
-	}
+	lsizerA = new wxFlexGridSizer(3, 4, 5);
+	lsizerV = new wxFlexGridSizer(2, 4, 5);
+	lsizerT = new wxFlexGridSizer(2, 4, 5);
 	graphsizer->Add(lsizerA, 0,  wxALIGN_CENTER_VERTICAL | wxALL, 5);
 	graphsizer->Add(plotA, 1, wxEXPAND | wxALL, 5);
 	graphsizer->Add(lsizerV, 0,  wxALIGN_CENTER_VERTICAL | wxALL, 5);
@@ -270,12 +193,131 @@ bmLog::bmLog(wxWindow* parent)
 	this->SetSize(x, y, w, h);
 }
 
+/*
+ * add the widgets and graphs of instance i, between the ones of the
+ * other instances. Nothing is shown for it if it has no label.
+ */
+void
+bmLog::addInst(int i)
+{
+	wxSizerFlags datafl(0);
+	datafl.Expand().Right();
+	wxSizerFlags labelfl(0);
+	labelfl.Centre();
+	int pos = 0;
+
+	if (i >= InstKnown.size()) {
+		InstKnown.resize(i + 1, false);
+		InstLabel.resize(i + 1, NULL);
+		std::vector<wxStaticText *> *texts[] = { &infoTextA,
+		    &infoTextV, &infoTextT, &InstAh, &InstA, &InstV, &InstT };
+		for (auto t : texts)
+			t->resize(i + 1, NULL);
+		std::vector<bmFXYVector *> *layers[] = { &Alayer, &Vlayer,
+		    &Tlayer, &AminLayer, &AmaxLayer, &VminLayer };
+		for (auto l : layers)
+			l->resize(i + 1, NULL);
+		InstTemp.resize(i + 1, false);
+		InstStats.resize(i + 1);
+	}
+	InstKnown[i] = true;
+	InstLabel[i] = wxp->getTlabel(i, this);
+	if (InstLabel[i] == NULL)
+		return;
+	for (int j = 0; j < i; j++) {
+		if (InstLabel[j] != NULL)
+			pos++;
+	}
+	const wxColour *color = instcolor[i % NCOLORS];
+
+	infoTextA[i] = new wxStaticText(this, -1, wxT("  XXXX.XXA"),
+	    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
+	infoTextA[i]->SetForegroundColour(*color);
+	infosizerA->Insert(pos, infoTextA[i], wxALIGN_RIGHT);
+	infoTextV[i] = new wxStaticText(this, -1, wxT("  XXX.XXV"),
+	    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
+	infoTextV[i]->SetForegroundColour(*color);
+	infosizerV->Insert(pos, infoTextV[i], wxALIGN_RIGHT);
+	infoTextT[i] = new wxStaticText(this, -1, wxT("  XXC"),
+	    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
+	infoTextT[i]->SetForegroundColour(*color);
+	infosizerT->Insert(pos, infoTextT[i], wxALIGN_RIGHT);
+
+	wxPen vectorpen(*color, 2, wxSOLID);
+
+	Alayer[i] = new bmFXYVector(plotA, _("Amps"));
+	Alayer[i]->Clear();
+	Alayer[i]->SetContinuity(true);
+	Alayer[i]->SetPen(vectorpen);
+	Alayer[i]->SetDrawOutsideMargins(false);
+	plotA->AddLayer(Alayer[i]);
+
+	Vlayer[i] = new bmFXYVector(plotV, _("Volts"));
+	Vlayer[i]->Clear();
+	Vlayer[i]->SetContinuity(true);
+	Vlayer[i]->SetPen(vectorpen);
+	Vlayer[i]->SetDrawOutsideMargins(false);
+	plotV->AddLayer(Vlayer[i]);
+
+	Tlayer[i] = new bmFXYVector(plotT, _("Temp"));
+	Tlayer[i]->Clear();
+	Tlayer[i]->SetContinuity(true);
+	Tlayer[i]->SetPen(vectorpen);
+	Tlayer[i]->SetDrawOutsideMargins(false);
+	plotT->AddLayer(Tlayer[i]);
+
+	wxPen envpen(*color, 1, wxDOT);
+
+	AminLayer[i] = new bmFXYVector(plotA, _("Amps min"));
+	AmaxLayer[i] = new bmFXYVector(plotA, _("Amps max"));
+	VminLayer[i] = new bmFXYVector(plotV, _("Volts min"));
+	bmFXYVector *envlayers[] =
+	    { AminLayer[i], AmaxLayer[i], VminLayer[i] };
+	for (auto l : envlayers) {
+		l->Clear();
+		l->SetContinuity(true);
+		l->SetPen(envpen);
+		l->SetDrawOutsideMargins(false);
+		l->GetWindow()->AddLayer(l);
+	}
+
+	InstLabel[i]->Connect(wxEVT_LEFT_DOWN,
+	    wxMouseEventHandler(bmLog::OnGraphToggle), Alayer[i], this);
+	lsizerA->Insert(pos * 3, InstLabel[i], labelfl);
+	InstAh[i] = new wxStaticText(this, -1, wxT("XXXX.XXAh"),
+	    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
+	InstAh[i]->SetForegroundColour(*color);
+	lsizerA->Insert(pos * 3 + 1, InstAh[i], datafl);
+	InstA[i] = new wxStaticText(this, -1, wxT("XX.XXA"),
+	    wxDefaultPosition, wxDefaultSize, wxALIGN_RIGHT | wxST_NO_AUTORESIZE);
+	InstA[i]->SetForegroundColour(*color);
+	lsizerA->Insert(pos * 3 + 2, InstA[i], datafl);
+	/* each time we add a wxWindow we need to allocate a new one */
+	InstLabel[i] = wxp->getTlabel(i, this);
+	InstLabel[i]->Connect(wxEVT_LEFT_DOWN,
+	    wxMouseEventHandler(bmLog::OnGraphToggle), Vlayer[i], this);
+	lsizerV->Insert(pos * 2, InstLabel[i], labelfl);
+	InstV[i] = new wxStaticText(this, -1, wxT("XX.XXV XX.XXV"));
+	InstV[i]->SetForegroundColour(*color);
+	lsizerV->Insert(pos * 2 + 1, InstV[i], datafl);
+	InstLabel[i] = wxp->getTlabel(i, this);
+	InstLabel[i]->Connect(wxEVT_LEFT_DOWN,
+	    wxMouseEventHandler(bmLog::OnGraphToggle), Tlayer[i], this);
+	lsizerT->Insert(pos * 2, InstLabel[i], labelfl);
+	InstT[i] = new wxStaticText(this, -1, wxT("XX.XXC XX.XXC"));
+	InstT[i]->SetForegroundColour(*color);
+	lsizerT->Insert(pos * 2 + 1, InstT[i], datafl);
+	Layout();
+}
+
 void
 bmLog::logV2XY(std::vector<double> &D, std::vector<double> &V,
-    std::vector<double> &A, std::vector<double> &T, int instance)
+    std::vector<double> &A, std::vector<double> &T,
+    std::vector<double> &Vmin, std::vector<double> &Amin,
+    std::vector<double> &Amax, int instance, int from)
 {
 	DBG(std::cout << "logV2XY size " <<  log_entries.size() << std::endl);
-	for (int i = 0; i < log_entries.size(); i++) {
+	for (int i = from; i < log_entries.size(); i++) {
 		if (log_entries[i].instance != instance)
 			continue;
 		/*
@@ -289,6 +331,10 @@ bmLog::logV2XY(std::vector<double> &D, std::vector<double> &V,
 		}
 		V.push_back(log_entries[i].volts);
 		A.push_back(-log_entries[i].amps);
+		/* amps are drawn negated: the max is the lowest */
+		Vmin.push_back(log_entries[i].volts_min);
+		Amin.push_back(-log_entries[i].amps_max);
+		Amax.push_back(-log_entries[i].amps_min);
 		if (log_entries[i].temp != TEMP_INVAL)
 			T.push_back(log_entries[i].temp - 273);
 	}
@@ -297,23 +343,40 @@ bmLog::logV2XY(std::vector<double> &D, std::vector<double> &V,
 void
 bmLog::showGraphs(void)
 {
-	for (int i = 0; i < NINST; i++) {
+	for (auto &e : log_entries) {
+		if (e.instance >= InstKnown.size() || !InstKnown[e.instance])
+			addInst(e.instance);
+	}
+	for (int i = 0; i < InstLabel.size(); i++) {
 		if (InstLabel[i] == NULL)
 			continue;
 		std::vector<double> D;
 		std::vector<double> V;
 		std::vector<double> A;
 		std::vector<double> T;
-		logV2XY(D, V, A, T, i);
-		if (D.size() == 0)
+		std::vector<double> Vmin;
+		std::vector<double> Amin;
+		std::vector<double> Amax;
+		logV2XY(D, V, A, T, Vmin, Amin, Amax, i, 0);
+		if (D.size() == 0) {
+			/* don't leave another block's or device's data */
+			clearGraph(i);
 			continue;
+		}
 		DBG(std::cout << "log entries " << D.size() << " " << A.size() << " " << V.size() << " " << T.size() << " " << i << std::endl);
 		Alayer[i]->Clear();
 		Vlayer[i]->Clear();
 		Tlayer[i]->Clear();
 		Alayer[i]->SetData(D, A);
 		Vlayer[i]->SetData(D, V);
-		if (T.size() == D.size()) {
+		AminLayer[i]->Clear();
+		AmaxLayer[i]->Clear();
+		VminLayer[i]->Clear();
+		AminLayer[i]->SetData(D, Amin);
+		AmaxLayer[i]->SetData(D, Amax);
+		VminLayer[i]->SetData(D, Vmin);
+		InstTemp[i] = (T.size() == D.size());
+		if (InstTemp[i]) {
 			Tlayer[i]->SetData(D, T);
 			Tlayer[i]->SetVisible(true);
 		} else {
@@ -336,6 +399,112 @@ bmLog::showGraphs(void)
 	updateStats();
 }
 
+/*
+ * add the entries of log_entries from index "from" to the graphs,
+ * without rebuilding them. If the end of the log was in view it stays
+ * so, and only the new entries are added to the stats.
+ */
+void
+bmLog::appendGraphs(int from)
+{
+	const std::vector<double> *D;
+	const std::vector<double> *A;
+	std::vector<int> old;
+	double firstX = -1, lastX = -1, newX = -1;
+	bool edge, fitted;
+
+	for (int e = from; e < log_entries.size(); e++) {
+		int inst = log_entries[e].instance;
+		if (inst >= InstKnown.size() || !InstKnown[inst])
+			addInst(inst);
+	}
+	old.resize(InstLabel.size(), 0);
+	for (int i = 0; i < InstLabel.size(); i++) {
+		if (InstLabel[i] == NULL)
+			continue;
+		Alayer[i]->GetData(D, A);
+		old[i] = D->size();
+		if (D->empty())
+			continue;
+		if (firstX < 0 || firstX > D->front())
+			firstX = D->front();
+		if (lastX < D->back())
+			lastX = D->back();
+	}
+	edge = (lastX < 0 || mp_endX >= lastX);
+	fitted = (lastX < 0 || mp_startX <= firstX);
+
+	for (int i = 0; i < InstLabel.size(); i++) {
+		if (InstLabel[i] == NULL)
+			continue;
+		std::vector<double> D;
+		std::vector<double> V;
+		std::vector<double> A;
+		std::vector<double> T;
+		std::vector<double> Vmin;
+		std::vector<double> Amin;
+		std::vector<double> Amax;
+		logV2XY(D, V, A, T, Vmin, Amin, Amax, i, from);
+		if (D.size() == 0)
+			continue;
+		if (old[i] == 0) {
+			InstTemp[i] = (T.size() == D.size());
+			Tlayer[i]->SetVisible(InstTemp[i]);
+		} else if (InstTemp[i] != (T.size() == D.size())) {
+			/* the temperature comes or goes: start again */
+			showGraphs();
+			return;
+		}
+		if (!InstTemp[i]) {
+			T.clear();
+			for (int e = 0; e < D.size(); e++)
+				T.push_back(20);
+		}
+		Alayer[i]->AddData(D, A);
+		Vlayer[i]->AddData(D, V);
+		Tlayer[i]->AddData(D, T);
+		AminLayer[i]->AddData(D, Amin);
+		AmaxLayer[i]->AddData(D, Amax);
+		VminLayer[i]->AddData(D, Vmin);
+		if (newX < D.back())
+			newX = D.back();
+	}
+	if (newX < 0 || !edge)
+		return;
+	if (!fitted) {
+		/* keep the duration shown, at the new end */
+		plotA->Fit(mp_startX + newX - lastX, mp_endX + newX - lastX,
+		    plotA->GetDesiredYmin(), plotA->GetDesiredYmax(), NULL);
+		/* setting plotA will trigger a OnScale event */
+		return;
+	}
+	plotA->Fit();
+	plotV->Fit();
+	plotT->Fit();
+	mp_scaleX = plotA->GetScaleX();
+	mp_posX = plotA->GetXpos();
+	mp_startX = plotA->GetDesiredXmin();
+	mp_endX = plotA->GetDesiredXmax();
+
+	showRange();
+	for (int i = 0; i < InstLabel.size(); i++) {
+		if (InstLabel[i] == NULL)
+			continue;
+		statsAdd(i, old[i]);
+		showStats(i);
+	}
+}
+
+void
+bmLog::clearGraph(int i)
+{
+	bmFXYVector *layers[] = { Alayer[i], Vlayer[i], Tlayer[i],
+	    AminLayer[i], AmaxLayer[i], VminLayer[i] };
+
+	for (auto l : layers)
+		l->Clear();
+}
+
 void
 bmLog::OnClose(wxCloseEvent & WXUNUSED(event))
 {
@@ -345,12 +514,63 @@ bmLog::OnClose(wxCloseEvent & WXUNUSED(event))
 void
 bmLog::OnShow(wxShowEvent &event)
 {
+	showLast();
+	event.Skip();
+}
+
+/* the last block of the device's log */
+void
+bmLog::showLast(void)
+{
+	if (bmlog_s == NULL)
+		return;
+	log_live = true;
 	log_cookie = bmlog_s->getLogBlock(-1, log_entries);
 	DBG(std::cout << "log_cookie " << log_cookie << std::endl);
 	if (log_cookie >= 0) {
 		showGraphs();
+		return;
 	}
-	event.Skip();
+	/* nothing logged yet */
+	log_entries.clear();
+	for (int i = 0; i < InstLabel.size(); i++) {
+		if (InstLabel[i] != NULL)
+			clearGraph(i);
+	}
+	plotA->Refresh(false);
+	plotV->Refresh(false);
+	plotT->Refresh(false);
+}
+
+void
+bmLog::devicesChanged(void)
+{
+	int n = wxp->getNDevices();
+
+	devchoice->Clear();
+	for (int i = 0; i < n; i++)
+		devchoice->Append(wxp->deviceLabel(wxp->getDevice(i)));
+	if (curdev < 0 && n > 0) {
+		curdev = 0;
+		bmlog_s = wxp->getDevice(curdev)->log_s;
+		if (IsShown())
+			showLast();
+	}
+	devchoice->SetSelection(curdev);
+	Layout();
+}
+
+void
+bmLog::OnDevice(wxCommandEvent & WXUNUSED(event))
+{
+	int sel = devchoice->GetSelection();
+
+	if (sel < 0 || sel == curdev)
+		return;
+	curdev = sel;
+	bmlog_s = wxp->getDevice(curdev)->log_s;
+	log_entries.clear();
+	showLast();
 }
 
 void
@@ -446,6 +666,8 @@ error:
 void
 bmLog::OnPrevious(wxCommandEvent &event)
 {
+	if (bmlog_s == NULL || log_entries.empty())
+		return;
 	time_t duration = mp_endX - mp_startX;
 	time_t log_start = log_entries[0].time;
 	double startY, endY, centerX;
@@ -463,6 +685,7 @@ bmLog::OnPrevious(wxCommandEvent &event)
 			centerX = (mp_startX + mp_endX) / 2.0;
 		} else {
 			log_cookie = new_coockie;
+			log_live = false;
 			showGraphs();
 			return;
 		}
@@ -477,6 +700,8 @@ bmLog::OnPrevious(wxCommandEvent &event)
 void
 bmLog::OnNext(wxCommandEvent &event)
 {
+	if (bmlog_s == NULL || log_entries.empty())
+		return;
 	time_t duration = mp_endX - mp_startX;
 	time_t log_end = log_entries[log_entries.size() - 1].time;
 	double startY, endY, centerX;
@@ -493,6 +718,7 @@ bmLog::OnNext(wxCommandEvent &event)
 			centerX = (mp_startX + mp_endX) / 2.0;
 		} else {
 			log_cookie = new_coockie;
+			log_live = bmlog_s->isLastBlock(log_cookie);
 			showGraphs();
 			return;
 		}
@@ -516,6 +742,17 @@ bmLog::OnGraphToggle(wxMouseEvent &event)
 {
 	bmFXYVector *layer = wxDynamicCast(event.GetEventUserData(), bmFXYVector);
 	layer->SetVisible(!layer->IsVisible());
+	/* the envelopes follow their graph */
+	for (int i = 0; i < InstLabel.size(); i++) {
+		if (InstLabel[i] == NULL)
+			continue;
+		if (layer == Alayer[i]) {
+			AminLayer[i]->SetVisible(layer->IsVisible());
+			AmaxLayer[i]->SetVisible(layer->IsVisible());
+		} else if (layer == Vlayer[i]) {
+			VminLayer[i]->SetVisible(layer->IsVisible());
+		}
+	}
 	layer->GetWindow()->Refresh(false);
 	event.Skip();
 }
@@ -535,116 +772,136 @@ bmLog::OnKeyPress(wxKeyEvent & event)
 }
 
 void
-bmLog::updateStats(void)
+bmLog::logChanged(bmLogStorage *s)
 {
-	DBG(std::cout << " start " << mp_startX << " end " << mp_endX << std::endl);
-	timerange->SetLabel(date2string(mp_startX) + _T(" ") + date2string(mp_endX));
-	timescale->ChangeValue(time2string(mp_endX - mp_startX));
-
-	for (int i = 0; i < NINST; i++) {
-		if (InstLabel[i] == NULL)
-			continue;
-
-		const std::vector<double> *D;
-		const std::vector<double> *A;
-		const std::vector<double> *V;
-		const std::vector<double> *T;
-		double duration = 0;
-		int nentries = 0;
-		time_t prev_time = -1;
-		time_t time;
-		double Ah = 0;
-		double Aav;
-		double Vmin = 10000;
-		double Vmax = -10000;
-		double Tmin = 10000;
-		double Tmax = -100000;
-
-		Alayer[i]->GetData(D, A);
-		Vlayer[i]->GetData(D, V);
-		if (Tlayer[i]->IsVisible()) {
-			Tlayer[i]->GetData(D, T);
-		} else {
-			T = NULL;
-		}
-
-		for (int e = 0; e < D->size(); e++) {
-			time_t time;
-			time = (*D)[e];
-			if (time < mp_startX || time > mp_endX)
-				continue;
-			if (prev_time >= 0) {
-				duration += time - prev_time;
-			}
-			prev_time = time;
-			nentries++;
-
-			Ah += (*A)[e];
-			if (Vmin > (*V)[e])
-				Vmin = (*V)[e];
-			if (Vmax < (*V)[e])
-				Vmax = (*V)[e];
-			if (T != NULL) {
-				if (Tmin > (*T)[e])
-					Tmin = (*T)[e];
-				if (Tmax < (*T)[e])
-					Tmax = (*T)[e];
-			}
-		}
-		DBG(std::cout << "duration " << duration << std::endl);
-		Aav =  Ah / nentries;
-		Ah = Ah / 3600.0 * 600.0;
-		wxString Aformat;
-		if (Ah >= 100 || Ah <= -100)
-			Aformat = _T("%.1fAh");
-		else
-			Aformat = _T("%.2fAh");
-		InstAh[i]->SetLabel(wxString::Format(Aformat, Ah));
-		if (Aav >= 10 || Aav <= -10)
-			Aformat = _T("%.1fA");
-		else
-			Aformat = _T("%.2fA");
-		InstA[i]->SetLabel(wxString::Format(Aformat, Aav));
-		InstV[i]->SetLabel(wxString::Format(_T("%.2fV %.2fV"), Vmin, Vmax));
-		if (T != NULL) {
-			InstT[i]->SetLabel(wxString::Format(
-			    degFmt + _T(" ") + degFmt,
-			    Tmin, Tmax));
-		} else {
-			InstT[i]->SetLabel(_T(""));
-		}
-	}
+	wxCommandEvent event(wxEVT_COMMAND_TEXT_UPDATED, logChangedID);
+	event.SetClientData(s);
+	GetEventHandler()->AddPendingEvent( event );
 }
 
 void
-bmLog::address(int a)
+bmLog::OnLogChanged(wxCommandEvent &event)
 {
-	bmlog_s->address(a);
+	int n = log_entries.size();
+	int added;
+
+	if (event.GetClientData() != bmlog_s || !log_live || !IsShown())
+		return;
+	if (log_cookie < 0) {
+		/* nothing was logged yet */
+		showLast();
+		return;
+	}
+	added = bmlog_s->getLogUpdate(log_cookie, n, log_entries);
+	DBG(std::cout << "log update " << n << " " << added << std::endl);
+	if (added < 0) {
+		/* entries were changed, or a new block was started */
+		showLast();
+	} else if (added > 0) {
+		appendGraphs(n);
+	}
 }
 
 void
-bmLog::addLogEntry(int sid, double volts, double amps,
-                 int temp, int instance, int idx)
+bmLog::updateStats(void)
 {
-	bmlog_s->addLogEntry(sid, volts, amps, temp, instance, idx);
+	showRange();
+	for (int i = 0; i < InstLabel.size(); i++) {
+		if (InstLabel[i] == NULL)
+			continue;
+		bm_inst_stats_t &st = InstStats[i];
+		st.n = 0;
+		st.Asum = 0;
+		st.As = 0;
+		st.Vmin = 10000;
+		st.Vmax = -10000;
+		st.Tmin = 10000;
+		st.Tmax = -100000;
+		statsAdd(i, 0);
+		showStats(i);
+	}
 }
 
 void
-bmLog::logComplete(int sid)
+bmLog::showRange(void)
 {
-	bmlog_s->logComplete(sid);
+	DBG(std::cout << " start " << mp_startX << " end " << mp_endX << std::endl);
+	timerange->SetLabel(date2string(mp_startX) + _T(" ") + date2string(mp_endX));
+	timescale->ChangeValue(time2string(mp_endX - mp_startX));
 }
 
+/* add the points of instance i from index "from", in the range shown */
 void
-bmLog::logError(int sid, int err)
+bmLog::statsAdd(int i, int from)
 {
-	bmlog_s->logError(sid, err);
+	const std::vector<double> *D;
+	const std::vector<double> *A;
+	const std::vector<double> *V;
+	const std::vector<double> *T;
+	bm_inst_stats_t &st = InstStats[i];
+	int interval = (bmlog_s != NULL) ?
+	    bmlog_s->getLogInterval() : LOG_INTERVAL_DEFAULT;
+
+	Alayer[i]->GetData(D, A);
+	Vlayer[i]->GetData(D, V);
+	Tlayer[i]->GetData(D, T);
+
+	for (int e = from; e < D->size(); e++) {
+		time_t time;
+		time = (*D)[e];
+		if (time < mp_startX || time > mp_endX)
+			continue;
+		st.n++;
+		st.Asum += (*A)[e];
+		/*
+		 * an entry is the average over the interval before it; the
+		 * intervals are the time between entries, unless this is
+		 * the first one or there's a gap
+		 */
+		double dt = (e > 0) ? (*D)[e] - (*D)[e - 1] : 0;
+		if (dt <= 0 || dt > LOG_INTERVAL_MAX)
+			dt = interval;
+		st.As += (*A)[e] * dt;
+		if (st.Vmin > (*V)[e])
+			st.Vmin = (*V)[e];
+		if (st.Vmax < (*V)[e])
+			st.Vmax = (*V)[e];
+		if (st.Tmin > (*T)[e])
+			st.Tmin = (*T)[e];
+		if (st.Tmax < (*T)[e])
+			st.Tmax = (*T)[e];
+	}
 }
 
 void
-bmLog::tick(void)
+bmLog::showStats(int i)
 {
-	bmlog_s->tick();
+	bm_inst_stats_t &st = InstStats[i];
+	double Ah;
+	double Aav;
+
+	Aav = st.Asum / st.n;
+	Ah = st.As / 3600.0;
+	wxString Aformat;
+	if (Ah >= 100 || Ah <= -100)
+		Aformat = _T("%.1fAh");
+	else
+		Aformat = _T("%.2fAh");
+	InstAh[i]->SetLabel(wxString::Format(Aformat, Ah));
+	if (Aav >= 10 || Aav <= -10)
+		Aformat = _T("%.1fA");
+	else
+		Aformat = _T("%.2fA");
+	InstA[i]->SetLabel(wxString::Format(Aformat, Aav));
+	InstV[i]->SetLabel(wxString::Format(_T("%.2fV %.2fV"),
+	    st.Vmin, st.Vmax));
+	if (Tlayer[i]->IsVisible()) {
+		InstT[i]->SetLabel(wxString::Format(
+		    degFmt + _T(" ") + degFmt,
+		    st.Tmin, st.Tmax));
+	} else {
+		InstT[i]->SetLabel(_T(""));
+	}
 }
 
 mpWindow *
@@ -685,7 +942,7 @@ bmLog::setTimeMark(time_t time)
 	/* find a valid date vertor */
 
 	D = NULL;
-	for (int i = 0; i < NINST && D == NULL; i++) {
+	for (int i = 0; i < InstLabel.size() && D == NULL; i++) {
 		if (InstLabel[i] == NULL)
 			continue;
 		Alayer[i]->GetData(D, A);
@@ -713,7 +970,7 @@ bmLog::setTimeMark(time_t time)
 	time = (*D)[rec];
 	infoTextD->SetLabel(date2string(time));
 
-	for (int i = 0; i < NINST; i++) {
+	for (int i = 0; i < InstLabel.size(); i++) {
 		if (InstLabel[i] == NULL)
 			continue;
 		Alayer[i]->GetData(D, A);
@@ -723,6 +980,13 @@ bmLog::setTimeMark(time_t time)
 		} else {
 			T = NULL;
 		}
+		if (rec >= A->size()) {
+			/* not logged for as long as the others */
+			infoTextA[i]->SetLabel("");
+			infoTextV[i]->SetLabel("");
+			infoTextT[i]->SetLabel("");
+			continue;
+		}
 
 		infoTextA[i]->SetLabel(wxString::Format(_T("%.2fA"),
 		    (*A)[rec]));
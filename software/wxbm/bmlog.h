@@ -36,29 +36,50 @@ class bmLog: public wxFrame
 {
   public:
 	bmLog(wxWindow* parent);
-	void address(int);
-	void addLogEntry(int sid, double volts, double amps,
-		       int temp, int instance, int idx);
-	void logComplete(int sid);
-	void logError(int sid, int err);
-	void tick(void);
+	/* the device table changed, from the GUI thread */
+	void devicesChanged(void);
 	void setTimeMark(time_t time);
+	/* new entries in a log, from the N2K thread */
+	void logChanged(bmLogStorage *);
   private:
 	wxPanel *mainpanel;
+	wxChoice *devchoice;
+	int curdev;
 	wxTextCtrl *timescale;
 	wxStaticText *timerange;
-	wxWindow *InstLabel[NINST];
 	wxStaticText *infoTextD;
-	wxStaticText *infoTextA[NINST];
-	wxStaticText *infoTextV[NINST];
-	wxStaticText *infoTextT[NINST];
-	wxStaticText *InstAh[NINST];
-	wxStaticText *InstA[NINST];
-	wxStaticText *InstV[NINST];
-	wxStaticText *InstT[NINST];
-	bmFXYVector *Alayer[NINST];
-	bmFXYVector *Vlayer[NINST];
-	bmFXYVector *Tlayer[NINST];
+	wxBoxSizer *infosizerA, *infosizerV, *infosizerT;
+	wxFlexGridSizer *lsizerA, *lsizerV, *lsizerT;
+	/*
+	 * by instance, added when first seen in a log (addInst());
+	 * InstLabel is NULL for the ones not shown.
+	 */
+	std::vector<bool> InstKnown;
+	std::vector<wxWindow *> InstLabel;
+	std::vector<wxStaticText *> infoTextA;
+	std::vector<wxStaticText *> infoTextV;
+	std::vector<wxStaticText *> infoTextT;
+	std::vector<wxStaticText *> InstAh;
+	std::vector<wxStaticText *> InstA;
+	std::vector<wxStaticText *> InstV;
+	std::vector<wxStaticText *> InstT;
+	std::vector<bmFXYVector *> Alayer;
+	std::vector<bmFXYVector *> Vlayer;
+	std::vector<bmFXYVector *> Tlayer;
+	/* min/max during each log interval */
+	std::vector<bmFXYVector *> AminLayer;
+	std::vector<bmFXYVector *> AmaxLayer;
+	std::vector<bmFXYVector *> VminLayer;
+	std::vector<bool> InstTemp; /* Tlayer has real temperatures */
+	/* over the time range shown, see statsAdd() */
+	typedef struct bm_inst_stats {
+		int n;
+		double Asum;
+		double As; /* A x s over the intervals of the entries */
+		double Vmin, Vmax;
+		double Tmin, Tmax;
+	} bm_inst_stats_t;
+	std::vector<bm_inst_stats_t> InstStats;
 	mpWindow *plotA;
 	mpWindow *plotV;
 	mpWindow *plotT;
@@ -68,11 +89,15 @@ class bmLog: public wxFrame
 	double mp_scaleX;
 	double mp_posX;
 	time_t mp_startX, mp_endX;
-	bmLogStorage *bmlog_s;
+	bmLogStorage *bmlog_s; /* of the device shown, NULL if none */
 	int log_cookie;
+	bool log_live; /* showing the last block, follow new entries */
 	std::vector<struct bm_log_entry> log_entries;
 	void OnClose(wxCloseEvent & event);
 	void OnShow(wxShowEvent & event);
+	void OnDevice(wxCommandEvent & event);
+	void showLast(void);
+	void addInst(int);
 	void OnScale(wxCommandEvent & event);
 	void OnScaleChange(wxCommandEvent & event);
 	void OnPrevious(wxCommandEvent & event);
@@ -80,9 +105,17 @@ class bmLog: public wxFrame
 	void OnFit(wxCommandEvent & event);
 	void OnGraphToggle(wxMouseEvent & event);
 	void OnKeyPress(wxKeyEvent & event);
+	void OnLogChanged(wxCommandEvent & event);
 	void updateStats(void);
+	void showRange(void);
+	void statsAdd(int, int);
+	void showStats(int);
 	void logV2XY(std::vector<double> &, std::vector<double> &,
-	             std::vector<double> &, std::vector<double> &, int);
+	             std::vector<double> &, std::vector<double> &,
+	             std::vector<double> &, std::vector<double> &,
+	             std::vector<double> &, int, int);
 	void showGraphs(void);
+	void appendGraphs(int);
+	void clearGraph(int);
 	mpWindow *MakePlot(wxString, wxWindowID);
 };
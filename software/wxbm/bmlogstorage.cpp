@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <N2K/NMEA2000.h>
+#include "wxbm.h"
 #include "bmlogstorage.h"
 #include "bmlog.h"
 
@@ -41,18 +42,28 @@
 #define DBG(a) /* */
 #endif
 
-bmLogStorage::bmLogStorage(wxString logPath)
+bmLogStorage::bmLogStorage(wxString logPath) :
+    req_timer(std::bind(&bmLogStorage::req_timeout, this)),
+    poll_timer(std::bind(&bmLogStorage::poll, this))
 {
 	time_t previous_t = 0;
 	FilePath = logPath;
 	cur_log_entry = 0;
 	log_req_state = LOG_REQ_IDLE;
 	log_tx = (private_log_tx *)nmea2000P->get_frametx(nmea2000P->get_tx_bypgn(PRIVATE_LOG));
+	log_dst = -1;
 	if ((errno = pthread_mutex_init(&log_mtx, NULL)) != 0)
 		err(1, "init log_mtx");
 	log_state = LOG_INIT;
 	log_update_state = LOG_UP_IDLE;
+	last_block_ts.tv_sec = 0;
+	last_block_ts.tv_nsec = 0;
 	last_write_entry = 0;
+	log_mod = 0;
+	log_interval = LOG_INTERVAL_DEFAULT;
+	inst_base = 0;
+	dev_time.valid = false;
+	dev_time_idx = -1;
 
 	/* get exising entries from log file */
 	std::ifstream _log(FilePath);
@@ -76,7 +87,7 @@ bmLogStorage::bmLogStorage(wxString logPath)
 			warnx("separator not found: %s", l);
 			break;
 		}
-		log_entry.instance = strtoi(e, NULL, 0, 0, NINST - 1, &s);
+		log_entry.instance = strtoi(e, NULL, 0, 0, INST_MAX, &s);
 		if (s) {
 			warnx("instance: %s: conversion failed", e);
 			break;
@@ -153,6 +164,17 @@ bmLogStorage::bmLogStorage(wxString logPath)
 			warn("flags: %s: conversion failed", e);
 			break;
 		}
+
+		/* envelope; not in older files */
+		log_entry.volts_min = log_entry.volts;
+		log_entry.amps_min = log_entry.amps;
+		log_entry.amps_max = log_entry.amps;
+		if ((e = strsep(&l, ",")) != NULL)
+			log_entry.volts_min = strtod(e, NULL);
+		if ((e = strsep(&l, ",")) != NULL)
+			log_entry.amps_min = strtod(e, NULL);
+		if ((e = strsep(&l, ",")) != NULL)
+			log_entry.amps_max = strtod(e, NULL);
 #if 0
 		DBG(printf("idx 0x%06x inst %2d volts %2.2f amps %3.3f temp %3d time %ld flags 0x%02x\n", log_entry.id, log_entry.instance, log_entry.volts, log_entry.amps, log_entry.temp, log_entry.time, log_entry.flags));
 #else
@@ -166,12 +188,14 @@ bmLogStorage::bmLogStorage(wxString logPath)
 	}
 	_log.close();
 	last_write_entry = log_entries.size() - 1;
+	log_mod = log_entries.size();
 }
 
 void
 bmLogStorage::address(int a)
 {
 	log_lock();
+	log_dst = a;
 	if (log_req_state == LOG_REQ_IDLE && log_state == LOG_INIT) {
 		if (last_write_entry == 0) {
 			log_req.cmd = PRIVATE_LOG_REQUEST_FIRST;
@@ -184,7 +208,9 @@ bmLogStorage::address(int a)
 			log_update_state = LOG_UP_SEARCH;
 		}
 		sid_inc();
-		log_req_state = LOG_REQ_DOREQ;
+		doreq();
+		/* entries times depend on it */
+		log_tx->sendreq(log_dst, PRIVATE_LOG_INTERVAL, LOG_OOB_SID, 0);
 	}
 	log_unlock();
 }
@@ -195,11 +221,14 @@ bmLogStorage::addLogEntry(int sid, double volts, double amps,
 {
 	if (log_req_state != LOG_REQ_WAIT_BLOCK || log_req.sid != sid)
 		return; /* not waiting for that */
-	wxASSERT_MSG(cur_log_entry < LOG_ENTRIES && cur_log_entry >= 0,
+	wxASSERT_MSG(cur_log_entry < LOG_PAGE_ENTRIES && cur_log_entry >= 0,
 	    wxString::Format("cur_log_entry %d", cur_log_entry));
 
 	received_log_entries[cur_log_entry].volts = volts;
 	received_log_entries[cur_log_entry].amps = amps;
+	received_log_entries[cur_log_entry].volts_min = volts;
+	received_log_entries[cur_log_entry].amps_min = amps;
+	received_log_entries[cur_log_entry].amps_max = amps;
 	received_log_entries[cur_log_entry].temp = temp;
 	received_log_entries[cur_log_entry].instance = instance;
 	received_log_entries[cur_log_entry].id = (idx << ID_IDX_SHIFT) |
@@ -209,17 +238,88 @@ bmLogStorage::addLogEntry(int sid, double volts, double amps,
 	if (volts == 0 && amps == 0 && instance == 0 && temp == TEMP_NULL)
 		received_log_entries[cur_log_entry].flags = LOGE_BOUNDARY;
 	cur_log_entry++;
-	wxASSERT_MSG(cur_log_entry =< LOG_ENTRIES && cur_log_entry > 0,
+	wxASSERT_MSG(cur_log_entry <= LOG_PAGE_ENTRIES && cur_log_entry > 0,
 	    wxString::Format("cur_log_entry %d", cur_log_entry));
 }
 
 void
-bmLogStorage::logComplete(int sid)
+bmLogStorage::addLogEnvelope(int sid, int instance, double volts_min,
+    double amps_min, double amps_max)
 {
+	if (log_req_state != LOG_REQ_WAIT_BLOCK || log_req.sid != sid)
+		return; /* not waiting for that */
+	/* it follows the entry it belongs to */
+	for (int i = cur_log_entry - 1; i >= 0; i--) {
+		if (received_log_entries[i].instance != instance)
+			continue;
+		received_log_entries[i].volts_min = volts_min;
+		received_log_entries[i].amps_min = amps_min;
+		received_log_entries[i].amps_max = amps_max;
+		return;
+	}
+	printf("log envelope sid 0x%02x inst %d: no entry\n", sid, instance);
+}
+
+void
+bmLogStorage::addLogTime(int sid, time_t time, int interval)
+{
+	bm_log_time_t t;
+
+	if (log_req_state != LOG_REQ_WAIT_BLOCK || log_req.sid != sid)
+		return; /* not waiting for that */
+	t.entry = cur_log_entry;
+	t.time = time;
+	t.interval = interval;
+	received_times.push_back(t);
+}
+
+/* set the time of e from the device's time records, if we have one */
+void
+bmLogStorage::dev_time_entry(bm_log_entry_t &e)
+{
+	if (e.flags & LOGE_BOUNDARY) {
+		/* boot or interval change; wait for the next record */
+		dev_time.valid = false;
+		return;
+	}
+	if (!dev_time.valid)
+		return;
+	/* one entry per instance in a group */
+	if (dev_time.seen.count(e.instance) != 0) {
+		dev_time.time += dev_time.interval;
+		dev_time.seen.clear();
+	}
+	dev_time.seen.insert(e.instance);
+	e.time = dev_time.time;
+	e.flags |= LOGE_TRUSTTIME | LOGE_DEVTIME;
+}
+
+void
+bmLogStorage::logComplete(int sid, const struct timespec &ts)
+{
+	size_t t = 0;
+
 	if (log_req_state != LOG_REQ_WAIT_BLOCK || log_req.sid != sid)
 		return; /* not waiting for that */
 	log_lock();
+	last_block_ts = ts;
+	if (cur_log_entry > 0) {
+		int idx = (received_log_entries[0].id & ID_IDX_MASK) >>
+		    ID_IDX_SHIFT;
+		if (idx == dev_time_idx)
+			dev_time = dev_time_page; /* same page again */
+		dev_time_page = dev_time;
+		dev_time_idx = idx;
+	}
 	for (int i = 0; i < cur_log_entry; i++) {
+		for (; t < received_times.size() &&
+		    received_times[t].entry <= i; t++) {
+			dev_time.valid = true;
+			dev_time.time = received_times[t].time;
+			dev_time.interval = received_times[t].interval;
+			dev_time.seen.clear();
+		}
+		dev_time_entry(received_log_entries[i]);
 		printf("sid 0x%02x idx 0x%06x %3d inst %2d volts %2.2f amps %3.3f temp %3d",
 		    sid, received_log_entries[i].id, i,
 		    received_log_entries[i].instance,
@@ -248,11 +348,18 @@ bmLogStorage::logComplete(int sid)
 			break;
 		}
 	}
+	for (; t < received_times.size(); t++) {
+		dev_time.valid = true;
+		dev_time.time = received_times[t].time;
+		dev_time.interval = received_times[t].interval;
+		dev_time.seen.clear();
+	}
+	received_times.clear();
 	cur_log_entry = 0;
 	log_req.cmd = PRIVATE_LOG_REQUEST_NEXT;
 	sid_inc();
 	log_req.idx = (log_entries.back().id & ID_IDX_MASK) >> ID_IDX_SHIFT;
-	log_req_state = LOG_REQ_DOREQ;
+	doreq();
 	// sendreq();
 	log_unlock();
 }
@@ -268,15 +375,18 @@ bmLogStorage::logError(int sid, int err)
 		wxASSERT(log_req.cmd == PRIVATE_LOG_REQUEST);
 		printf("log idx 0x%x not found\n", log_req.idx);
 		/* assume the log was reset */
+		dev_time.valid = false;
+		dev_time_idx = -1;
 		log_req.cmd = PRIVATE_LOG_REQUEST_FIRST;
 		sid_inc();
 		log_req.idx = 0;
-		log_req_state = LOG_REQ_DOREQ;
+		doreq();
 		log_update_state = LOG_UP_DOUP;
 		break;
 	case PRIVATE_LOG_ERROR_LAST:
 		wxASSERT(log_req.cmd == PRIVATE_LOG_REQUEST_NEXT);
 		log_req_state = LOG_REQ_IDLE;
+		req_timer.cancel();
 		if (log_update_state == LOG_UP_DOUP_NEWDATA &&
 		    log_state != LOG_INIT) {
 			log_update();
@@ -285,14 +395,98 @@ bmLogStorage::logError(int sid, int err)
 		printf("log complete\n");
 		if (log_state == LOG_INIT)
 			log_state = LOG_IDLE;
-		gettimeofday(&last_data, NULL);
+		poll_timer.schedule(LOG_POLL_INTERVAL);
 		break;
 	}
 	log_unlock();
 }
 
 void
-bmLogStorage::tick(void)
+bmLogStorage::logInterval(int sid, int interval, int base)
+{
+	if (sid != LOG_OOB_SID)
+		return;
+	printf("log interval %ds, channel 0 is instance %d\n", interval, base);
+	log_lock();
+	log_interval = interval;
+	inst_base = base;
+	log_unlock();
+}
+
+void
+bmLogStorage::setLogInterval(int interval)
+{
+	log_lock();
+	if (log_dst >= 0) {
+		log_tx->sendreq(log_dst, PRIVATE_LOG_INTERVAL, LOG_OOB_SID,
+		    interval);
+	}
+	log_unlock();
+}
+
+void
+bmLogStorage::getBurst(const wxString &path)
+{
+	log_lock();
+	burst_path = path;
+	burst_samples.clear();
+	if (log_dst >= 0)
+		log_tx->sendreq(log_dst, PRIVATE_LOG_BURST, LOG_OOB_SID, 0);
+	log_unlock();
+}
+
+void
+bmLogStorage::addBurstSample(int sid, int seq, int chan,
+    double volts, double amps)
+{
+	bm_burst_sample_t s;
+
+	if (sid != LOG_OOB_SID)
+		return;
+	s.seq = seq;
+	s.volts = volts;
+	s.amps = amps;
+	log_lock();
+	s.instance = inst_base + chan;
+	if (!burst_path.IsEmpty())
+		burst_samples.push_back(s);
+	log_unlock();
+}
+
+void
+bmLogStorage::burstComplete(int sid, const struct timespec &ts)
+{
+	if (sid != LOG_OOB_SID)
+		return;
+	log_lock();
+	if (burst_path.IsEmpty()) {
+		/* not asked for, or already saved */
+	} else if (burst_samples.empty()) {
+		printf("no 1s samples\n");
+	} else {
+		/* the last sample is from the time we got it */
+		int last = burst_samples.back().seq;
+		std::ofstream _f(burst_path);
+		_f << "instance,seq,volts,amps,time" << std::endl;
+		for (auto &s : burst_samples) {
+			_f << s.instance << ",";
+			_f << s.seq << ",";
+			_f << s.volts << ",";
+			_f << s.amps << ",";
+			_f << ts.tv_sec - (time_t)((last - s.seq) & 0xffff);
+			_f << std::endl;
+		}
+		_f.close();
+		printf("%zu 1s samples saved to %s\n",
+		    burst_samples.size(), (const char *)burst_path.mb_str());
+	}
+	burst_samples.clear();
+	burst_path.Clear();
+	log_unlock();
+}
+
+void
+bmLogStorage::req_timeout(void)
 {
 	log_lock();
 	switch(log_req_state) {
@@ -302,36 +496,32 @@ bmLogStorage::tick(void)
 		sendreq();
 		break;
 	case LOG_REQ_WAIT_BLOCK:
-	    {
-		struct timeval now, diff;
-		gettimeofday(&now, NULL);
-		timersub(&now, &last_ev, &diff);
-		if (diff.tv_sec >= 1) {
-			/* timeout, resend last command */
-			printf("timeout cmd %d sid 0x%x idx 0x%x\n",
-			    log_req.cmd, log_req.sid, log_req.idx);
-			cur_log_entry = 0;
-			sendreq();
-		}
+		/* timeout, resend last command */
+		printf("timeout cmd %d sid 0x%x idx 0x%x\n",
+		    log_req.cmd, log_req.sid, log_req.idx);
+		cur_log_entry = 0;
+		received_times.clear();
+		sendreq();
 		break;
-	    }
 	}
+	log_unlock();
+}
+
+void
+bmLogStorage::poll(void)
+{
+	log_lock();
 	if (log_state == LOG_IDLE && log_req_state == LOG_REQ_IDLE) {
-		struct timeval now, diff;
-		gettimeofday(&now, NULL);
-		timersub(&now, &last_data, &diff);
-		if (diff.tv_sec >= 60) {
-			/* request new data */
-			log_req.cmd = PRIVATE_LOG_REQUEST;
-			sid_inc();
-			log_req.idx =
-			  (log_entries.back().id & ID_IDX_MASK) >> ID_IDX_SHIFT;
-			log_req_state = LOG_REQ_DOREQ;
-			log_update_state = LOG_UP_SEARCH;
-			printf("request new from 0x%04x\n", log_req.idx);
-			sendreq();
-		}
+		/* request new data */
+		log_req.cmd = PRIVATE_LOG_REQUEST;
+		sid_inc();
+		log_req.idx =
+		  (log_entries.back().id & ID_IDX_MASK) >> ID_IDX_SHIFT;
+		log_update_state = LOG_UP_SEARCH;
+		printf("request new from 0x%04x\n", log_req.idx);
+		sendreq();
 	}
+	/* else a sync is running, it will reschedule us when done */
 	log_unlock();
 }
 
@@ -340,31 +530,58 @@ bmLogStorage::log_update(void)
 {
 	int laste = log_entries.size() - 1;
 	int lasteinst = log_entries[laste].instance;
-	time_t now = time(NULL);
+	int first = laste;
+	time_t now = last_block_ts.tv_sec;
 	const char *home;
 	bool trusted = 1;
 
+	if (now == 0)
+		now = time(NULL);
+
 	/*
 	 * update log times for this log block. We know that the last entry
-	 * if from current time (with one minute precision) and we have 10mn
-	 * between entries so walk the log backware updating time, util
-	 * we find a boundary (i.e. BM boot) or non-0 time.
+	 * if from current time (with one minute precision) and we have
+	 * log_interval between entries so walk the log backware updating
+	 * time, util we find a boundary (i.e. BM boot or interval change)
+	 * or non-0 time.
 	 * We have one entry per instance, each with the same time so we have
 	 * to deal with that
+	 * Entries with the device time (LOGE_DEVTIME) are exact and don't
+	 * need this; but the entries logged before the device got the time
+	 * are log_interval apart from the first of them.
 	 */
 	for (int i = laste; i >= 0; i--) {
 		printf("entry %d fl 0x%x time %ld", i, log_entries[i].flags, log_entries[i].time);
 		if (log_entries[i].flags & LOGE_BOUNDARY)
 			break;
-		if (log_entries[i].time != 0)
-			break;
-		if (i != laste && lasteinst == log_entries[i].instance) {
-			now -= 600; /* one log every 10mn */
+		if (log_entries[i].time != 0) {
+			if ((log_entries[i].flags & LOGE_DEVTIME) == 0 ||
+			    i == 0 ||
+			    (log_entries[i - 1].flags & LOGE_BOUNDARY))
+				break;
+			if (log_entries[i - 1].time != 0) {
+				if (i <= last_write_entry)
+					break; /* already done */
+				printf("\n");
+				continue;
+			}
+			/* entry i starts a group */
+			now = log_entries[i].time - log_interval;
+			first = i - 1;
+			lasteinst = log_entries[first].instance;
+			trusted = 1;
+			printf(" first device time\n");
+			continue;
+		}
+		if (i != first && lasteinst == log_entries[i].instance) {
+			now -= log_interval;
 			trusted = 0;
 		}
 		log_entries[i].time = now;
 		if (trusted)
 			log_entries[i].flags |= LOGE_TRUSTTIME;
+		if (i < log_mod)
+			log_mod = i;
 		printf(" now 0x%ld\n", log_entries[i].time);
 		if (i < last_write_entry)
 			last_write_entry = 0; /* need to rewrite whole file */
@@ -373,32 +590,37 @@ bmLogStorage::log_update(void)
 	if (last_write_entry == 0) {
 		(void)rename(FilePath, FilePath+"~");
 		std::ofstream _logf(FilePath);
-		_logf << "instance,id,volts,amps,temp,time,flags" << std::endl;
-		for (int i = 0; i <= laste; i++) {
-			_logf << log_entries[i].instance << ",";
-			_logf << "0x" << std::hex << log_entries[i].id << std::dec <<",";
-			_logf << log_entries[i].volts << ",";
-			_logf << log_entries[i].amps << ",";
-			_logf << log_entries[i].temp << ",";
-			_logf << log_entries[i].time << ",";
-			_logf << "0x" << std::hex << log_entries[i].flags << std::endl;
-		}
+		_logf << "instance,id,volts,amps,temp,time,flags,"
+		    "volts_min,amps_min,amps_max" << std::endl;
+		for (int i = 0; i <= laste; i++)
+			log_write_entry(_logf, log_entries[i]);
 		_logf.close();
 		last_write_entry = laste;
 	} else {
 		std::ofstream _logf(FilePath, std::ios::out | std::ios::app);
-		for (int i = last_write_entry + 1; i <= laste; i++) {
-			_logf << log_entries[i].instance << ",";
-			_logf << "0x" << std::hex << log_entries[i].id << std::dec <<",";
-			_logf << log_entries[i].volts << ",";
-			_logf << log_entries[i].amps << ",";
-			_logf << log_entries[i].temp << ",";
-			_logf << log_entries[i].time << ",";
-			_logf << "0x" << std::hex << log_entries[i].flags << std::endl;
-		}
+		for (int i = last_write_entry + 1; i <= laste; i++)
+			log_write_entry(_logf, log_entries[i]);
 		_logf.close();
 		last_write_entry = laste;
 	}
+	/* the log window may show them */
+	if (wxp->bmlog != NULL)
+		wxp->bmlog->logChanged(this);
+}
+
+void
+bmLogStorage::log_write_entry(std::ofstream &_logf, const bm_log_entry_t &e)
+{
+	_logf << e.instance << ",";
+	_logf << "0x" << std::hex << e.id << std::dec <<",";
+	_logf << e.volts << ",";
+	_logf << e.amps << ",";
+	_logf << e.temp << ",";
+	_logf << e.time << ",";
+	_logf << "0x" << std::hex << e.flags << std::dec << ",";
+	_logf << e.volts_min << ",";
+	_logf << e.amps_min << ",";
+	_logf << e.amps_max << std::endl;
 }
 
 int
@@ -425,10 +647,60 @@ bmLogStorage::getLogBlock(int cookie, std::vector<bm_log_entry_t> &entries)
 			break;
 		entries.push_back(log_entries[i]);
 	}
+	log_mod = log_entries.size();
 	log_unlock();
 	return cookie;
 }
 
+/*
+ * append to entries the ones added to the block at cookie, after the
+ * first n already read, up to the last one log_update() completed.
+ * Returns how many, or -1 if the block has to be read again with
+ * getLogBlock(): the first n were changed (their time is set after
+ * the fact), or a new block was started after it.
+ */
+int
+bmLogStorage::getLogUpdate(int cookie, int n,
+    std::vector<bm_log_entry_t> &entries)
+{
+	int i;
+
+	log_lock();
+	if (cookie < 0 || cookie + n > log_entries.size() ||
+	    log_mod < cookie + n) {
+		log_unlock();
+		return -1;
+	}
+	for (i = cookie + n; i <= last_write_entry; i++) {
+		if (log_entries[i].flags & LOGE_BOUNDARY) {
+			log_unlock();
+			return -1;
+		}
+	}
+	for (i = cookie + n; i <= last_write_entry; i++)
+		entries.push_back(log_entries[i]);
+	log_mod = log_entries.size();
+	log_unlock();
+	return (i > cookie + n) ? i - (cookie + n) : 0;
+}
+
+/* no other block after the one at cookie */
+bool
+bmLogStorage::isLastBlock(int cookie)
+{
+	bool last = true;
+
+	log_lock();
+	for (int i = cookie; i < log_entries.size(); i++) {
+		if (log_entries[i].flags & LOGE_BOUNDARY) {
+			last = false;
+			break;
+		}
+	}
+	log_unlock();
+	return last;
+}
+
 int
 bmLogStorage::getNextLogBlock(int cookie, std::vector<bm_log_entry_t> &entries)
 {
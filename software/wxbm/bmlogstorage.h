@@ -27,18 +27,39 @@
 
 #include <wx/combobox.h>
 #include <N2K/nmea2000_defs_tx.h>
+#include <N2K/nmea2000_timer.h>
 #include <pthread.h>
 #include <err.h>
 #include <vector>
+#include <set>
+#include <fstream>
 
-#define NINST 4
+/* battery instances are 8 bits in NMEA2000 */
+#define INST_MAX 255
 
-/* max number of entries sent by bm per request */
-#define LOG_ENTRIES 51
+/* max number of entries sent by bm per request (delta records in a page) */
+#define LOG_PAGE_ENTRIES 255
+
+/* resend a request if no reply after LOG_REQ_TIMEOUT ms */
+#define LOG_REQ_TIMEOUT 1000
+/* ask for new entries every LOG_POLL_INTERVAL ms */
+#define LOG_POLL_INTERVAL 60000
+
+/* bm's default log interval, and its limits, in s */
+#define LOG_INTERVAL_DEFAULT 600
+#define LOG_INTERVAL_MIN 60
+#define LOG_INTERVAL_MAX 3600
+
+/* sid for the interval and burst requests; never used by log_req */
+#define LOG_OOB_SID 0xfe
 
 typedef struct bm_log_entry {
 	double volts;
 	double amps;
+	/* envelope over the log interval; the averages if not logged */
+	double volts_min;
+	double amps_min;
+	double amps_max;
 	int temp;
 #define TEMP_INVAL (-1)
 #define TEMP_NULL (233)
@@ -52,30 +73,81 @@ typedef struct bm_log_entry {
 	int flags;
 #define LOGE_BOUNDARY	0x01
 #define LOGE_TRUSTTIME	0x02
+#define LOGE_DEVTIME	0x04 /* time from the device's time records */
 } bm_log_entry_t;
 
 class bmLogStorage {
   public:
 	bmLogStorage(wxString logPath);
+	/* the device's current address; the first call starts the sync */
 	void address(int);
 	void addLogEntry(int sid, double volts, double amps,
 		       int temp, int instance, int idx);
-	void logComplete(int sid);
+	void addLogEnvelope(int sid, int instance, double volts_min,
+	    double amps_min, double amps_max);
+	void addLogTime(int sid, time_t time, int interval);
+	void logComplete(int sid, const struct timespec &ts);
 	void logError(int sid, int err);
-	void tick(void);
+	void logInterval(int sid, int interval, int inst_base);
+	inline int getLogInterval(void) { return log_interval; };
+	void setLogInterval(int interval);
+	void getBurst(const wxString &path);
+	void addBurstSample(int sid, int seq, int chan,
+	    double volts, double amps);
+	void burstComplete(int sid, const struct timespec &ts);
 	int getLogBlock(int cookie, std::vector<bm_log_entry_t> &entries);
 	int getNextLogBlock(int cookie, std::vector<bm_log_entry_t> &entries);
 	int getPrevLogBlock(int cookie, std::vector<bm_log_entry_t> &entries);
+	int getLogUpdate(int cookie, int n,
+	    std::vector<bm_log_entry_t> &entries);
+	bool isLastBlock(int cookie);
   private:
 	wxString FilePath;
 	private_log_tx *log_tx;
-	bm_log_entry_t received_log_entries[LOG_ENTRIES];
+	int log_dst; /* address of the device */
+	bm_log_entry_t received_log_entries[LOG_PAGE_ENTRIES];
 	int cur_log_entry;
-	struct timeval last_ev;
-	struct timeval last_data;
+	/* time records in the page, before received_log_entries[entry] */
+	typedef struct bm_log_time {
+		int entry;
+		time_t time;
+		int interval;
+	} bm_log_time_t;
+	std::vector<bm_log_time_t> received_times;
+	/*
+	 * time of the current group of entries from the last time record;
+	 * dev_time_page is its value at the start of page dev_time_idx,
+	 * as the last page is received again at each poll.
+	 */
+	typedef struct bm_dev_time {
+		bool valid;
+		time_t time;
+		int interval;
+		std::set<int> seen; /* instances already in this group */
+	} bm_dev_time_t;
+	bm_dev_time_t dev_time;
+	bm_dev_time_t dev_time_page;
+	int dev_time_idx;
+	nmea2000_timer req_timer;
+	nmea2000_timer poll_timer;
 	std::vector<bm_log_entry_t> log_entries;
 	int last_write_entry;
+	/* lowest entry changed by log_update() since the last get*Log*() */
+	int log_mod;
+	/* kernel receive time of the last block, the time of its last entry */
+	struct timespec last_block_ts;
 	pthread_mutex_t log_mtx;
+	int log_interval; /* s between entries */
+	int inst_base; /* instance of the device's channel 0, for bursts */
+	/* 1s samples being received */
+	typedef struct bm_burst_sample {
+		int seq;
+		int instance;
+		double volts;
+		double amps;
+	} bm_burst_sample_t;
+	std::vector<bm_burst_sample_t> burst_samples;
+	wxString burst_path;
 	struct log_req {
 		int cmd;
 		int sid;
@@ -103,9 +175,15 @@ class bmLogStorage {
 			log_req.sid = 1;
 	}
 	inline void sendreq(void) {
-		log_tx->sendreq(log_req.cmd, log_req.sid, log_req.idx);
-		gettimeofday(&last_ev, NULL);
+		log_tx->sendreq(log_dst, log_req.cmd, log_req.sid,
+		    log_req.idx);
 		log_req_state = LOG_REQ_WAIT_BLOCK;
+		req_timer.schedule(LOG_REQ_TIMEOUT);
+	};
+	/* send request from the N2K thread, as soon as possible */
+	inline void doreq(void) {
+		log_req_state = LOG_REQ_DOREQ;
+		req_timer.schedule(0);
 	};
 	inline void log_lock(void) {
 		if ((errno = pthread_mutex_lock(&log_mtx)) != 0)
@@ -116,4 +194,8 @@ class bmLogStorage {
 			err(1, "lock log_mtx");
 	};
 	void log_update(void);
+	void dev_time_entry(bm_log_entry_t &);
+	void log_write_entry(std::ofstream &, const bm_log_entry_t &);
+	void req_timeout(void);
+	void poll(void);
 };
@@ -57,6 +57,25 @@ class bmFXYVector : public mpFXYVector
 			x = &m_xs;
 			y = &m_ys;
 		}
+		/* append points, without copying again the existing ones */
+		inline void AddData(const std::vector<double> &x, const std::vector<double> &y) {
+			if (m_xs.empty()) {
+				SetData(x, y);
+				return;
+			}
+			for (size_t i = 0; i < x.size() && i < y.size(); i++) {
+				m_xs.push_back(x[i]);
+				m_ys.push_back(y[i]);
+				if (m_minX > x[i])
+					m_minX = x[i];
+				if (m_maxX < x[i])
+					m_maxX = x[i];
+				if (m_minY > y[i])
+					m_minY = y[i];
+				if (m_maxY < y[i])
+					m_maxY = y[i];
+			}
+		}
 		inline mpWindow *GetWindow(void) {
 			return m_w;
 		}
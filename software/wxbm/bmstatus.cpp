@@ -33,7 +33,7 @@
 bmStatus::bmStatus(wxWindow *parent, wxWindowID id)
 	: wxPanel(parent, id)
 {
-	bmsizer = new wxFlexGridSizer(4, NINST + 1, 5);
+	bmsizer = new wxFlexGridSizer(4, 5, 5);
 
 	wxSizerFlags datafl(0);
 	datafl.Expand().Right();
@@ -47,18 +47,6 @@ bmStatus::bmStatus(wxWindow *parent, wxWindowID id)
 	bmsizer->Add(LABELTEXT("voltage(V)"), labelfl);
 	bmsizer->Add(LABELTEXT("courant(A)"), labelfl);
 	bmsizer->Add(LABELTEXT("temperature(C)"), labelfl);
-	for(int i = 0; i < NINST; i++) {
-		wxWindow *Tlabel = wxp->getTlabel(i, this);
-		if (Tlabel == NULL)
-			continue;
-		Tvolts[i] = new wxStaticText(this, -1, wxT(""));
-		Tamps[i] = new wxStaticText(this, -1, wxT(""));
-		Ttemp[i] = new wxStaticText(this, -1, wxT(""));
-		bmsizer->Add(Tlabel, datafl);
-		bmsizer->Add(Tvolts[i], datafl);
-		bmsizer->Add(Tamps[i], datafl);
-		bmsizer->Add(Ttemp[i], datafl);
-	}
 
 	wxSizerFlags bmfl(0);
 	bmfl.Left();
@@ -79,8 +67,66 @@ bmStatus::address(int a)
 #endif
 }
 
+/* add the row of instance i, between the ones of the other instances */
+void
+bmStatus::addInst(int i)
+{
+	wxSizerFlags datafl(0);
+	datafl.Expand().Right();
+	size_t pos = 4; /* the titles */
+
+	if (i >= Tknown.size()) {
+		Tknown.resize(i + 1, false);
+		Tvolts.resize(i + 1, NULL);
+		Tamps.resize(i + 1, NULL);
+		Ttemp.resize(i + 1, NULL);
+	}
+	Tknown[i] = true;
+	wxWindow *Tlabel = wxp->getTlabel(i, this);
+	if (Tlabel == NULL)
+		return;
+	for (int j = 0; j < i; j++) {
+		if (Tvolts[j] != NULL)
+			pos += 4;
+	}
+	Tvolts[i] = new wxStaticText(this, -1, wxT(""));
+	Tamps[i] = new wxStaticText(this, -1, wxT(""));
+	Ttemp[i] = new wxStaticText(this, -1, wxT(""));
+	bmsizer->Insert(pos++, Tlabel, datafl);
+	bmsizer->Insert(pos++, Tvolts[i], datafl);
+	bmsizer->Insert(pos++, Tamps[i], datafl);
+	bmsizer->Insert(pos++, Ttemp[i], datafl);
+	mainsizer->SetSizeHints(this);
+	GetParent()->Layout();
+}
+
+void
+bmStatus::values(const std::vector<bmDevice::bm_inst_values_t> &vals)
+{
+	time_t last = 0;
+
+	for (int i = 0; i < vals.size(); i++) {
+		if (!vals[i].valid)
+			continue;
+		if (i >= Tknown.size() || !Tknown[i])
+			addInst(i);
+		if (last < vals[i].ts.tv_sec)
+			last = vals[i].ts.tv_sec;
+	}
+	for (int i = 0; i < Tvolts.size(); i++) {
+		if (i < vals.size()) {
+			/* not received for a while: not there any more */
+			setRow(i, vals[i].volts, vals[i].amps, vals[i].temp,
+			    vals[i].valid &&
+			    vals[i].ts.tv_sec + BM_STALE >= last);
+		} else {
+			setRow(i, 0, 0, 0, false);
+		}
+	}
+}
+
 void
-bmStatus::values(int i, double v, double a, double t, bool valid)
+bmStatus::setRow(int i, double v, double a, double t, bool valid)
 {
 	if (Tvolts[i] == NULL)
 		return;
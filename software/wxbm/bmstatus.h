@@ -27,16 +27,27 @@
 
 #include <wx/combobox.h>
 #include <wx/config.h>
+#include <vector>
+
+#define BM_STALE 10 /* s */
 
 class bmStatus: public wxPanel
 {
   public:
 	bmStatus(wxWindow *parent, wxWindowID id=wxID_ANY);
 	void address(int);
-	void values(int, double, double, double, bool);
+	/*
+	 * the values of a device, by instance; the others are blanked,
+	 * as are the ones BM_STALE s older than the device's last values.
+	 */
+	void values(const std::vector<bmDevice::bm_inst_values_t> &);
   private:
 	wxFlexGridSizer *mainsizer, *bmsizer;
-	wxStaticText *Tvolts[NINST];
-	wxStaticText *Tamps[NINST];
-	wxStaticText *Ttemp[NINST];
+	/* rows by instance, added when first seen; NULL if not shown */
+	std::vector<bool> Tknown;
+	std::vector<wxStaticText *> Tvolts;
+	std::vector<wxStaticText *> Tamps;
+	std::vector<wxStaticText *> Ttemp;
+	void addInst(int);
+	void setRow(int, double, double, double, bool);
 };
@@ -31,10 +31,13 @@
 #include "wxbm.h"
 #include "bmstatus.h"
 #include "bmlog.h"
+#include "bmlogstorage.h"
 #include "icons/icons8-car-battery-30.xpm"
 #include <N2K/NMEA2000.h>
 #include <N2K/NMEA2000Properties.h>
 #include <N2K/NMEA2000PropertiesDialog.h>
+#include <inttypes.h>
+#include <unistd.h>
 
 #ifdef DEBUG            
 #define DBG(a) {a;}
@@ -46,6 +49,9 @@ const int myID_F_N2KCONF =	wxID_HIGHEST + 10;
 const int myID_F_PLOAD =	wxID_HIGHEST + 11;
 const int myID_F_PSAVE =	wxID_HIGHEST + 12;
 const int myID_F_SHOWLOG =	wxID_HIGHEST + 13;
+const int myID_F_LOGINTERVAL =	wxID_HIGHEST + 14;
+const int myID_F_GETBURST =	wxID_HIGHEST + 15;
+const int myID_DEVICE =		wxID_HIGHEST + 16;
 const int myID_DATAUP =		wxID_HIGHEST + 100;
 
 class bmFrame : public wxFrame
@@ -55,15 +61,15 @@ public:
 	typedef enum dataup {
 		data_values = 0,
 		data_status,
+		data_devices,	/* device added or changed address */
 	} dataup_t;
 	void wake(dataup_t);
 	int addr;
 	int group;
 	wxString mode;
-	double volts[NINST];
-	double amps[NINST];
-	double temp[NINST];
-	bool instV[NINST];
+	/* the device shown, NULL if none yet */
+	inline bmDevice *curDevice(void)
+	    { return (curdev < 0) ? NULL : wxp->getDevice(curdev); };
 
 private:
 	wxPanel *mainpanel;
@@ -71,13 +77,18 @@ private:
 	wxMenuBar *menubar;
 	wxMenu *file;
 	wxMenu *view;
+	wxChoice *devchoice;
 	bmStatus *bmstatus;
+	int curdev;
 
 	void OnN2KConfig(wxCommandEvent & event);
+	void OnDevice(wxCommandEvent & event);
 	void OnDataUpdate(wxCommandEvent & event);
 	void OnQuit(wxCommandEvent & event);
 	void OnClose(wxCloseEvent & event);
 	void OnShowLog(wxCommandEvent & event);
+	void OnLogInterval(wxCommandEvent & event);
+	void OnGetBurst(wxCommandEvent & event);
 };
 
 bmFrame::bmFrame(const wxString& title)
@@ -94,8 +105,7 @@ bmFrame::bmFrame(const wxString& title)
 	} else {
 		x = y = w = h = -1;
 	}
-	for (int i = 0; i < NINST; i++)
-		instV[i] = false;
+	curdev = -1;
 	nmea2000P = new nmea2000;
 	NMEA2000PropertiesP = new NMEA2000Properties(config);
 	//mainpanel = new wxPanel(this, wxID_ANY);
@@ -103,6 +113,8 @@ bmFrame::bmFrame(const wxString& title)
 	menubar = new wxMenuBar;
 	file = new wxMenu;
 	file->Append(myID_F_N2KCONF, _T("N2k Config"));
+	file->Append(myID_F_LOGINTERVAL, _T("Log interval..."));
+	file->Append(myID_F_GETBURST, _T("Save 1s samples..."));
 	file->Append(wxID_EXIT, _T("&Quit"));
 	menubar->Append(file, _T("&File"));
 	view = new wxMenu;
@@ -119,7 +131,15 @@ bmFrame::bmFrame(const wxString& title)
 		wxCommandEventHandler(bmFrame::OnDataUpdate));
 	Connect(myID_F_SHOWLOG, wxEVT_COMMAND_MENU_SELECTED,
 		wxCommandEventHandler(bmFrame::OnShowLog));
-
+	Connect(myID_F_LOGINTERVAL, wxEVT_COMMAND_MENU_SELECTED,
+		wxCommandEventHandler(bmFrame::OnLogInterval));
+	Connect(myID_F_GETBURST, wxEVT_COMMAND_MENU_SELECTED,
+		wxCommandEventHandler(bmFrame::OnGetBurst));
+
+	devchoice = new wxChoice(this, myID_DEVICE);
+	devchoice->Connect(wxEVT_CHOICE,
+	    wxCommandEventHandler(bmFrame::OnDevice), NULL, this);
+	mainsizer->Add( devchoice, 0, wxEXPAND | wxALL, 5 );
 	bmstatus = new bmStatus(this);
 	mainsizer->Add( bmstatus, 0, wxEXPAND | wxALL, 5 );
 
@@ -150,20 +170,40 @@ void bmFrame::wake(dataup_t t)
 void bmFrame::OnDataUpdate(wxCommandEvent & event)
 {
 	dataup_t t;
+	bmDevice *d;
+	std::vector<bmDevice::bm_inst_values_t> vals;
+	int n;
+
 	t = (dataup_t)event.GetInt();
 	switch(t) {
 	case bmFrame::dataup_t::data_status:
 		bmstatus->address(addr);
 		break;
+	case bmFrame::dataup_t::data_devices:
+		n = wxp->getNDevices();
+		devchoice->Clear();
+		for (int i = 0; i < n; i++)
+			devchoice->Append(wxp->deviceLabel(wxp->getDevice(i)));
+		if (curdev < 0 && n > 0)
+			curdev = 0;
+		devchoice->SetSelection(curdev);
+		wxp->bmlog->devicesChanged();
+		/* FALLTHROUGH */
 	case bmFrame::dataup_t::data_values:
-		for (int i = 0; i < NINST; i++) {
-			bmstatus->values(i, volts[i], amps[i],
-			    temp[i], instV[i]);
-		}
+		d = curDevice();
+		if (d != NULL)
+			wxp->getValues(d, vals);
+		bmstatus->values(vals);
 		break;
 	}
 }
 
+void bmFrame::OnDevice(wxCommandEvent & WXUNUSED(event))
+{
+	curdev = devchoice->GetSelection();
+	wake(bmFrame::dataup_t::data_values);
+}
+
 void bmFrame::OnQuit(wxCommandEvent & WXUNUSED(event))
 {
 	Close(true);
@@ -202,6 +242,35 @@ void bmFrame::OnShowLog(wxCommandEvent & WXUNUSED(event))
 
 }
 
+void bmFrame::OnLogInterval(wxCommandEvent & WXUNUSED(event))
+{
+	long interval;
+	bmDevice *d = curDevice();
+
+	if (d == NULL)
+		return;
+	interval = wxGetNumberFromUser(_T("Seconds between log entries"),
+	    _T("Interval:"), _T("Log interval"),
+	    d->log_s->getLogInterval(), LOG_INTERVAL_MIN, LOG_INTERVAL_MAX,
+	    this);
+	if (interval > 0)
+		d->log_s->setLogInterval(interval);
+}
+
+void bmFrame::OnGetBurst(wxCommandEvent & WXUNUSED(event))
+{
+	bmDevice *d = curDevice();
+
+	if (d == NULL)
+		return;
+	wxFileDialog dialog(this, _T("Save 1s samples"), "", "burst.csv",
+	    _T("CSV files (*.csv)|*.csv"), wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+
+	if (dialog.ShowModal() != wxID_OK)
+		return;
+	d->log_s->getBurst(dialog.GetPath());
+}
+
 static const wxCmdLineEntryDesc g_cmdLineDesc [] =
 {
 	{ wxCMD_LINE_SWITCH, "h", "help",
@@ -209,6 +278,12 @@ static const wxCmdLineEntryDesc g_cmdLineDesc [] =
 	    wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
 	{ wxCMD_LINE_SWITCH, "L", "nolog",
 	    "disables reading log from device"},
+	{ wxCMD_LINE_OPTION, "r", "record",
+	    "record received CAN frames to file"},
+	{ wxCMD_LINE_OPTION, "R", "replay",
+	    "replay CAN frames from a capture file instead of the bus"},
+	{ wxCMD_LINE_SWITCH, "F", "fast",
+	    "replay as fast as possible"},
 	{ wxCMD_LINE_NONE }
 };
 
@@ -223,32 +298,31 @@ bool wxbm::OnInit()
 
 	config = new wxConfig(AppName());
 	wxIcon icon(icons8_car_battery_30);
-	int conf_valid = 0;
-	wxString path;
 
 	wxp = this;
-
-	for(int i = 0; i < NINST; i++) {
-		if (config) {
-			path = wxString::Format(wxT("/Instance/%d"), i);
-			if (config->Read(path, &Tname[i])) {
-				conf_valid++;
+	if ((errno = pthread_mutex_init(&dev_mtx, NULL)) != 0)
+		err(1, "init dev_mtx");
+
+	if (!config || !config->Read("/Log/path", &logPath)) {
+		const char *home = getenv("HOME");
+		if (home != NULL) {
+			logPath = wxString::Format(wxT("%s/.wxbm_log"), home);
+			if (config) {
+				config->Write("/Log/path", logPath);
 			}
-		}
-	}
-	if (conf_valid == 0 && config) {
-		for(int i = 0; i < NINST; i++) {
-			Tname[i] = wxString::Format(wxT("string:%d"), i);
-			path = wxString::Format(wxT("/Instance/%d"), i);
-			config->Write(path, Tname[i]);
+		} else {
+			err(1, "can't get log file name ($HOME not set)");
 		}
 	}
 
 	frame = new bmFrame(AppName());
 	frame->SetIcon(icon);
 	frame->Show(true);
+	if (!recordPath.IsEmpty())
+		nmea2000P->setrecord(recordPath);
+	if (!replayPath.IsEmpty())
+		nmea2000P->setreplay(replayPath, replayFast);
 	nmea2000P->Init();
-	bmAddress = -1;
 
 	return true;
 }
@@ -264,6 +338,9 @@ bool wxbm::OnCmdLineParsed(wxCmdLineParser& parser)
 	getlog = !parser.Found(_T("L"));
 	if (!getlog)
 		printf("log disabled\n");
+	parser.Found(_T("r"), &recordPath);
+	parser.Found(_T("R"), &replayPath);
+	replayFast = parser.Found(_T("F"));
 	return true;
 }
 
@@ -280,76 +357,281 @@ wxString wxbm::ErrMsgPrefix()
 	return s;
 }
 
-void wxbm::setStatus(int addr, int group, const wxString &mode)
+bmDevice::bmDevice(uint64_t n, int a, const wxString &logPath)
 {
-	frame->addr = addr;
-	frame->group = group;
-	frame->mode = mode;
-	frame->wake(bmFrame::dataup_t::data_status);
+	name = n;
+	addr = a;
+	log_s = new bmLogStorage(logPath);
+	log_started = false;
 }
 
-void wxbm::setBatt(int inst, double v, double i, double t, bool valid)
+/*
+ * the device sending from addr. With create, it's looked up by NAME
+ * (from a status message: it may have changed address) and added to
+ * the table if new; NULL if its NAME is still unknown.
+ * From the N2K thread, which is the only one changing the table.
+ */
+bmDevice *
+wxbm::findDevice(int addr, bool create)
 {
+	uint64_t name;
+	bmDevice *d = NULL;
+	bool isnew = false;
+
+	if (!create) {
+		dev_lock();
+		for (auto dev : devices) {
+			if (dev->addr == addr)
+				d = dev;
+		}
+		dev_unlock();
+		return d;
+	}
+
+	name = nmea2000P->getname(addr);
+	if (name == 0) {
+		if (nmea2000P->request_name(addr))
+			return NULL; /* wait for its address claim */
+		name = BM_NAME_ADDR(addr);
+	}
+	dev_lock();
+	for (auto dev : devices) {
+		if (dev->name == name)
+			d = dev;
+	}
+	if (d != NULL && d->addr == addr) {
+		dev_unlock();
+		return d;
+	}
+	if (d == NULL) {
+		wxString path = logPath +
+		    wxString::Format(".%016" PRIx64, name);
+		if (devices.empty() && access(path.c_str(), F_OK) != 0 &&
+		    access(logPath.c_str(), F_OK) == 0) {
+			/* log from before devices had their own */
+			printf("%s is now %s\n", (const char *)logPath.c_str(),
+			    (const char *)path.c_str());
+			(void)rename(logPath.c_str(), path.c_str());
+		}
+		dev_unlock();
+		/* reads the log file, don't hold the lock */
+		d = new bmDevice(name, -1, path);
+		dev_lock();
+		devices.push_back(d);
+		printf("new bm 0x%016" PRIx64 "\n", name);
+		isnew = true;
+	}
+	/* the address it had may be someone else's now */
+	for (auto dev : devices) {
+		if (dev->addr == addr)
+			dev->addr = -1;
+	}
+	d->addr = addr;
+	dev_unlock();
+	if (!isnew)
+		printf("bm 0x%016" PRIx64 " address %d\n", name, addr);
+	if (d->log_started)
+		d->log_s->address(addr);
+	frame->wake(bmFrame::dataup_t::data_devices);
+	return d;
+}
+
+int
+wxbm::getNDevices(void)
+{
+	int n;
+
+	dev_lock();
+	n = devices.size();
+	dev_unlock();
+	return n;
+}
+
+bmDevice *
+wxbm::getDevice(int i)
+{
+	bmDevice *d = NULL;
+
+	dev_lock();
+	if (i >= 0 && i < devices.size())
+		d = devices[i];
+	dev_unlock();
+	return d;
+}
+
+/* from the GUI thread */
+wxString
+wxbm::deviceLabel(const bmDevice *d)
+{
+	wxString path, label;
+
+	path = wxString::Format("/Device/%016" PRIx64, d->name);
+	if (config == NULL || !config->Read(path, &label)) {
+		/* the unique number */
+		label = wxString::Format(wxT("bm %06x"),
+		    (u_int)(d->name & 0x1fffff));
+		if (config)
+			config->Write(path, label);
+	}
+	if (d->addr < 0)
+		return label;
+	return label + wxString::Format(wxT(" (%d)"), d->addr);
+}
+
+void
+wxbm::getValues(const bmDevice *d,
+    std::vector<bmDevice::bm_inst_values_t> &vals)
+{
+	dev_lock();
+	vals = d->inst;
+	dev_unlock();
+}
+
+int
+wxbm::getBmAddress(void)
+{
+	bmDevice *d = frame->curDevice();
+
+	return (d == NULL) ? -1 : d->addr;
+}
+
+void wxbm::setBatt(int addr, int inst, double v, double i, double t,
+    bool valid, const struct timespec *ts)
+{
+	bmDevice *d = findDevice(addr, valid);
+
+	if (d == NULL)
+		return;
 	if (valid) {
-		if (inst < 0 || inst >= NINST)
+		if (inst < 0)
 			return;
-		frame->volts[inst] = v;
-		frame->amps[inst] = i;
-		frame->temp[inst] = t;
-		frame->instV[inst] = true;
-	} else {
-		for (int i = 0; i < NINST; i++) {
-			frame->instV[i] = false;
+		dev_lock();
+		if (inst >= d->inst.size()) {
+			/* a new one; the GUI adds it when woken up */
+			d->inst.resize(inst + 1);
+		}
+		bmDevice::bm_inst_values_t &iv = d->inst[inst];
+		iv.volts = v;
+		iv.amps = i;
+		iv.temp = t;
+		iv.valid = true;
+		if (ts != NULL)
+			iv.ts = *ts;
+		else
+			clock_gettime(CLOCK_REALTIME, &iv.ts);
+		dev_unlock();
+		/* we need an address to ask for the log */
+		if (getlog && !d->log_started &&
+		    nmea2000P->getaddress() != -1) {
+			d->log_started = true;
+			d->log_s->address(addr);
 		}
+	} else {
+		dev_lock();
+		for (auto &iv : d->inst)
+			iv.valid = false;
+		dev_unlock();
 	}
 	frame->wake(bmFrame::dataup_t::data_values);
 }
 
 void
-wxbm::setBmAddress(int a)
+wxbm::addLogEntry(int addr, int sid, double volts, double amps,
+                 int temp, int instance, int idx)
 {
-	if (getlog)
-		bmlog->address(a);
-	bmAddress = a;
+	bmDevice *d = findDevice(addr);
+
+	if (d != NULL && d->log_started)
+		d->log_s->addLogEntry(sid, volts, amps, temp, instance, idx);
 }
 
 void
-wxbm::addLogEntry(int sid, double volts, double amps,
-                 int temp, int instance, int idx)
+wxbm::addLogEnvelope(int addr, int sid, int instance, double volts_min,
+    double amps_min, double amps_max)
+{
+	bmDevice *d = findDevice(addr);
+
+	if (d != NULL && d->log_started)
+		d->log_s->addLogEnvelope(sid, instance, volts_min,
+		    amps_min, amps_max);
+}
+
+void
+wxbm::addLogTime(int addr, int sid, time_t time, int interval)
+{
+	bmDevice *d = findDevice(addr);
+
+	if (d != NULL && d->log_started)
+		d->log_s->addLogTime(sid, time, interval);
+}
+
+void
+wxbm::logComplete(int addr, int sid, const struct timespec &ts)
+{
+	bmDevice *d = findDevice(addr);
+
+	if (d != NULL && d->log_started)
+		d->log_s->logComplete(sid, ts);
+}
+
+void
+wxbm::logError(int addr, int sid, int err)
 {
-	if (getlog)
-		bmlog->addLogEntry(sid, volts, amps, temp, instance, idx);
+	bmDevice *d = findDevice(addr);
+
+	if (d != NULL && d->log_started)
+		d->log_s->logError(sid, err);
 }
 
 void
-wxbm::logComplete(int sid)
+wxbm::logInterval(int addr, int sid, int interval, int inst_base)
 {
-	if (getlog)
-		bmlog->logComplete(sid);
+	bmDevice *d = findDevice(addr);
+
+	if (d != NULL && d->log_started)
+		d->log_s->logInterval(sid, interval, inst_base);
 }
 
 void
-wxbm::logError(int sid, int err)
+wxbm::addBurstSample(int addr, int sid, int seq, int chan,
+    double volts, double amps)
 {
-	if (getlog)
-		bmlog->logError(sid, err);
+	bmDevice *d = findDevice(addr);
+
+	if (d != NULL && d->log_started)
+		d->log_s->addBurstSample(sid, seq, chan, volts, amps);
 }
 
 void
-wxbm::logTick(void)
+wxbm::burstComplete(int addr, int sid, const struct timespec &ts)
 {
-	if (getlog)
-		bmlog->tick();
+	bmDevice *d = findDevice(addr);
+
+	if (d != NULL && d->log_started)
+		d->log_s->burstComplete(sid, ts);
 }
 
 
+/*
+ * the label of instance i, from the config. A new instance gets a
+ * default one, written back so that it can be changed; it's not shown
+ * if its type is not "string" or "img".
+ */
 wxWindow *
 wxbm::getTlabel(int i, wxWindow * parent)
 {
-	wxString type = Tname[i].BeforeFirst(':');
-	wxString name = Tname[i].AfterFirst(':');
+	wxString path = wxString::Format(wxT("/Instance/%d"), i);
+	wxString Tname;
+
+	if (config == NULL || !config->Read(path, &Tname)) {
+		Tname = wxString::Format(wxT("string:%d"), i);
+		if (config)
+			config->Write(path, Tname);
+	}
+	wxString type = Tname.BeforeFirst(':');
+	wxString name = Tname.AfterFirst(':');
 
-	DBG(std::cout << "getTlabel " << i << " " << Tname[i] << " " << type << " " << name << std::endl);
+	DBG(std::cout << "getTlabel " << i << " " << Tname << " " << type << " " << name << std::endl);
 	if (type.IsSameAs(_T("string"))) {
 		return new wxStaticText(parent, -1, name);
 	} else if (type.IsSameAs(_T("img"))) {
@@ -29,11 +29,44 @@
 #define _WXbm_H_
 
 #include <wx/config.h>
+#include <pthread.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
 
 class bmFrame;
 class bmLog;
+class bmLogStorage;
 
-#define NINST 4
+/*
+ * a battery monitor on the bus. Devices are keyed by the ISO NAME from
+ * their address claim, so that a device keeps its log when its address
+ * changes. They're created from the N2K thread when their first status
+ * is received, and never removed.
+ */
+class bmDevice {
+  public:
+	bmDevice(uint64_t name, int addr, const wxString &logPath);
+	uint64_t name;
+	int addr; /* current address, -1 if taken by another device */
+	bmLogStorage *log_s;
+	bool log_started;
+	/* the last values, indexed by battery instance, grown as received */
+	typedef struct bm_inst_values {
+		double volts;
+		double amps;
+		double temp;
+		bool valid;
+		/* receive time; see bmStatus::values() */
+		struct timespec ts;
+	} bm_inst_values_t;
+	std::vector<bm_inst_values_t> inst;
+};
+
+/* no NAME and we can't ask for it (replay): key on the address */
+#define BM_NAME_ADDR(a) (0xffffffff00000000ULL | (uint64_t)(a))
 
 class wxbm : public wxApp
 {
@@ -43,25 +76,51 @@ class wxbm : public wxApp
 	virtual bool OnCmdLineParsed(wxCmdLineParser& parser);
 	static wxString AppName();
 	static wxString ErrMsgPrefix();
-	void setBatt(int instance, double v, double i, double t, bool);
-	void setStatus(int, int, const wxString &);
-	void setBmAddress(int);
-	void addLogEntry(int sid, double volts, double amps,
+	/* from the N2K thread; addr is the source of the message */
+	void setBatt(int addr, int instance, double v, double i, double t,
+	    bool, const struct timespec *ts = NULL);
+	void addLogEntry(int addr, int sid, double volts, double amps,
 	    int temp, int instance, int idx);
-	void logComplete(int sid);
-	void logError(int sid, int err);
-	void logTick(void);
+	void addLogEnvelope(int addr, int sid, int instance, double volts_min,
+	    double amps_min, double amps_max);
+	void addLogTime(int addr, int sid, time_t time, int interval);
+	void logComplete(int addr, int sid, const struct timespec &ts);
+	void logError(int addr, int sid, int err);
+	void logInterval(int addr, int sid, int interval, int inst_base);
+	void addBurstSample(int addr, int sid, int seq, int chan,
+	    double volts, double amps);
+	void burstComplete(int addr, int sid, const struct timespec &ts);
+	/* device table; devices are never removed so indexes stay valid */
+	int getNDevices(void);
+	bmDevice *getDevice(int);
+	wxString deviceLabel(const bmDevice *);
+	/* copy of the device's values, from the GUI thread */
+	void getValues(const bmDevice *,
+	    std::vector<bmDevice::bm_inst_values_t> &);
 	wxWindow *getTlabel(int, wxWindow *);
 	inline wxConfig *getConfig(void) { return config; };
-	inline int getBmAddress(void) { return bmAddress; };
+	int getBmAddress(void);
 
 	bmLog *bmlog;
   private:
 	wxConfig *config;
 	bmFrame *frame;
 	bool getlog;
-	wxString Tname[NINST];
-	int bmAddress;
+	wxString recordPath;
+	wxString replayPath;
+	bool replayFast;
+	wxString logPath; /* device logs are logPath.<NAME> */
+	std::vector<bmDevice *> devices;
+	pthread_mutex_t dev_mtx;
+	bmDevice *findDevice(int addr, bool create = false);
+	inline void dev_lock(void) {
+		if ((errno = pthread_mutex_lock(&dev_mtx)) != 0)
+			err(1, "lock dev_mtx");
+	};
+	inline void dev_unlock(void) {
+		if ((errno = pthread_mutex_unlock(&dev_mtx)) != 0)
+			err(1, "unlock dev_mtx");
+	};
 };
 
 extern wxbm *wxp;